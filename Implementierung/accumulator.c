@@ -0,0 +1,190 @@
+#include "accumulator.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+#include "workspace.h"
+
+/// @brief helper: number of hash table slots of an accumulator with capacity touched columns, 0 if it is dense
+static uint64_t helper_hash_slots(uint64_t noCols, uint64_t capacity) {
+    if (noCols <= ACC_HASH_MIN_COLS || capacity * 16 >= noCols) {
+        return 0;
+    }
+    // at most half of the slots are in use
+    uint64_t slots = 1;
+    while (slots < 2 * capacity) {
+        slots <<= 1;
+    }
+    return slots;
+}
+
+/// @brief creates an accumulator for rows of a matrix with noCols columns
+/// @param noCols number of columns
+/// @param maxRowEntries expected maximum number of distinct columns in a row (grows if exceeded)
+struct ACCUMULATOR acc_init(uint64_t noCols, uint64_t maxRowEntries) {
+    struct ACCUMULATOR acc = {.noCols = noCols, .noTouched = 0, .bitmap = NULL, .keys = NULL, .hashMask = 0};
+    acc.capacity = maxRowEntries < 16 ? 16 : maxRowEntries;
+    acc.touched = (uint64_t*)scratch_alloc(acc.capacity * sizeof(uint64_t));
+
+    uint64_t slots = helper_hash_slots(noCols, acc.capacity);
+    if (slots > 0) {
+        acc.hashMask = slots - 1;
+        acc.sum = (float*)scratch_calloc(slots * sizeof(float));
+        acc.keys = (uint64_t*)scratch_alloc(slots * sizeof(uint64_t));
+        memset(acc.keys, 0xFF, slots * sizeof(uint64_t));
+    } else {
+        acc.sum = (float*)scratch_calloc(noCols * sizeof(float));
+        acc.bitmap = (uint64_t*)scratch_calloc((noCols + 63) / 64 * sizeof(uint64_t));
+    }
+    return acc;
+}
+
+/// @brief memory of an accumulator of acc_init(noCols, maxRowEntries) before it grows
+/// @param noCols number of columns
+/// @param maxRowEntries expected maximum number of distinct columns in a row
+/// @return bytes
+uint64_t acc_bytes(uint64_t noCols, uint64_t maxRowEntries) {
+    uint64_t capacity = maxRowEntries < 16 ? 16 : maxRowEntries;
+    uint64_t slots = helper_hash_slots(noCols, capacity);
+    uint64_t tableBytes = slots > 0 ? slots * (sizeof(float) + sizeof(uint64_t))
+                                    : noCols * sizeof(float) + (noCols + 63) / 64 * sizeof(uint64_t);
+    return capacity * sizeof(uint64_t) + tableBytes;
+}
+
+/// @brief frees the memory of an accumulator
+void acc_free(struct ACCUMULATOR acc) {
+    scratch_free(acc.touched);
+    scratch_free(acc.sum);
+    scratch_free(acc.bitmap);
+    scratch_free(acc.keys);
+}
+
+/// @brief slow path of acc_add: makes room for another touched column
+void acc_grow(struct ACCUMULATOR* acc) {
+    uint64_t* oldTouched = acc->touched;
+    acc->touched = (uint64_t*)scratch_alloc(2 * acc->capacity * sizeof(uint64_t));
+    memcpy(acc->touched, oldTouched, acc->capacity * sizeof(uint64_t));
+    scratch_free(oldTouched);
+    acc->capacity *= 2;
+    if (!acc->hashMask || 2 * acc->capacity <= acc->hashMask + 1) {
+        return;
+    }
+    // rehash into a table twice as large, keeping at most half of the slots in use
+    uint64_t oldMask = acc->hashMask;
+    float* oldSum = acc->sum;
+    uint64_t* oldKeys = acc->keys;
+    acc->hashMask = 2 * oldMask + 1;
+    acc->sum = (float*)scratch_calloc((acc->hashMask + 1) * sizeof(float));
+    acc->keys = (uint64_t*)scratch_alloc((acc->hashMask + 1) * sizeof(uint64_t));
+    memset(acc->keys, 0xFF, (acc->hashMask + 1) * sizeof(uint64_t));
+    acc->noTouched = 0;  // the same columns are re-inserted, in a different order
+    for (uint64_t slot = 0; slot <= oldMask; slot++) {
+        if (oldKeys[slot] != ACC_EMPTY_KEY) {
+            acc->sum[acc_hash_slot(acc, oldKeys[slot])] = oldSum[slot];
+        }
+    }
+    scratch_free(oldSum);
+    scratch_free(oldKeys);
+}
+
+/// @brief writes the non-zero entries of the current row in ascending column order and resets the accumulator
+/// @param acc accumulator
+/// @param indices output: columns
+/// @param values output: values
+/// @return number of written entries
+uint64_t acc_flush(struct ACCUMULATOR* acc, elpk_index_t* indices, float* values) {
+    uint64_t count = 0;
+    sort_indices(acc->touched, acc->noTouched);
+    for (uint64_t t = 0; t < acc->noTouched; t++) {
+        uint64_t col = acc->touched[t];
+        float value;
+        if (acc->hashMask) {
+            uint64_t slot = acc_hash_slot(acc, col);
+            value = acc->sum[slot];
+            acc->touched[t] = slot;  // slots are cleared after all lookups, clearing now would break probing
+        } else {
+            value = acc->sum[col];
+            acc->sum[col] = 0.f;
+            acc->bitmap[col >> 6] = 0;  // every other bit of the word belongs to this row as well
+        }
+        if (value != 0.f) {
+            indices[count] = col;
+            values[count++] = value;
+        }
+    }
+    if (acc->hashMask) {
+        for (uint64_t t = 0; t < acc->noTouched; t++) {
+            acc->sum[acc->touched[t]] = 0.f;
+            acc->keys[acc->touched[t]] = ACC_EMPTY_KEY;  // the whole row is removed, so no tombstones are needed
+        }
+    }
+    acc->noTouched = 0;
+    return count;
+}
+
+/// @brief resets the accumulator without emitting anything
+/// @return number of distinct columns touched in the current row
+uint64_t acc_clear(struct ACCUMULATOR* acc) {
+    uint64_t noTouched = acc->noTouched;
+    if (acc->hashMask) {
+        for (uint64_t t = 0; t < noTouched; t++) {  // look up all slots before clearing any of them
+            acc->touched[t] = acc_hash_slot(acc, acc->touched[t]);
+        }
+        for (uint64_t t = 0; t < noTouched; t++) {
+            acc->keys[acc->touched[t]] = ACC_EMPTY_KEY;
+            acc->sum[acc->touched[t]] = 0.f;
+        }
+    } else {
+        for (uint64_t t = 0; t < noTouched; t++) {
+            acc->sum[acc->touched[t]] = 0.f;
+            acc->bitmap[acc->touched[t] >> 6] = 0;
+        }
+    }
+    acc->noTouched = 0;
+    return noTouched;
+}
+
+/// @brief sorts n indices ascending: quicksort with a median of three pivot down to runs of 32 entries, then
+/// insertion sort; in place (glibc's qsort allocates a merge buffer for larger arrays)
+void sort_indices(uint64_t* a, uint64_t n) {
+    while (n > 32) {
+        uint64_t x = a[0], y = a[n / 2], z = a[n - 1];
+        uint64_t pivot = x < y ? (y < z ? y : (x < z ? z : x)) : (x < z ? x : (y < z ? z : y));
+        // Hoare partition: afterwards a[0..j] <= pivot <= a[j + 1..n - 1]
+        int64_t i = -1, j = n;
+        for (;;) {
+            do {
+                i++;
+            } while (a[i] < pivot);
+            do {
+                j--;
+            } while (a[j] > pivot);
+            if (i >= j) {
+                break;
+            }
+            uint64_t t = a[i];
+            a[i] = a[j];
+            a[j] = t;
+        }
+        // recurse into the smaller part, loop on the larger one (O(log n) stack)
+        uint64_t split = j + 1;
+        if (split < n - split) {
+            sort_indices(a, split);
+            a += split;
+            n -= split;
+        } else {
+            sort_indices(a + split, n - split);
+            n = split;
+        }
+    }
+    for (uint64_t i = 1; i < n; i++) {  // insertion sort for the common short rows
+        uint64_t x = a[i];
+        uint64_t j = i;
+        for (; j > 0 && a[j - 1] > x; j--) {
+            a[j] = a[j - 1];
+        }
+        a[j] = x;
+    }
+}
@@ -0,0 +1,94 @@
+#ifndef GUARD_ACCUMULATOR
+#define GUARD_ACCUMULATOR
+
+#include <stdint.h>
+
+#include "ellpack.h"
+
+// matrices with more columns than this use a hash table instead of a dense array of noCols floats
+#define ACC_HASH_MIN_COLS (1ul << 21)
+
+#define ACC_EMPTY_KEY UINT64_MAX
+
+/// @brief sparse accumulator for one result row: sums products by column and remembers the touched columns, so
+/// emitting and resetting a row costs O(entries of the row) instead of O(noCols)
+struct ACCUMULATOR {
+    uint64_t noCols;
+    uint64_t noTouched;
+    uint64_t capacity;  // size of touched
+    uint64_t* touched;  // columns touched in the current row, unsorted
+    float* sum;         // dense: noCols entries; hash: hashMask + 1 entries
+    uint64_t* bitmap;   // dense: one bit per column, set if the column is in touched
+    uint64_t* keys;     // hash: column stored in every slot, ACC_EMPTY_KEY if empty
+    uint64_t hashMask;  // hash: number of slots - 1; 0 if dense
+};
+
+/// @brief creates an accumulator for rows of a matrix with noCols columns
+/// @param noCols number of columns
+/// @param maxRowEntries expected maximum number of distinct columns in a row (grows if exceeded)
+struct ACCUMULATOR acc_init(uint64_t noCols, uint64_t maxRowEntries);
+
+/// @brief memory of an accumulator of acc_init(noCols, maxRowEntries) before it grows
+/// @param noCols number of columns
+/// @param maxRowEntries expected maximum number of distinct columns in a row
+/// @return bytes
+uint64_t acc_bytes(uint64_t noCols, uint64_t maxRowEntries);
+
+/// @brief frees the memory of an accumulator
+void acc_free(struct ACCUMULATOR acc);
+
+/// @brief slow path of acc_add: makes room for another touched column
+void acc_grow(struct ACCUMULATOR* acc);
+
+/// @brief hash slot of col, inserts the column if not present
+__attribute__((always_inline)) inline uint64_t acc_hash_slot(struct ACCUMULATOR* acc, uint64_t col) {
+    uint64_t slot = (col * 0x9E3779B97F4A7C15ul) >> 20 & acc->hashMask;
+    while (acc->keys[slot] != col) {
+        if (acc->keys[slot] == ACC_EMPTY_KEY) {
+            if (acc->noTouched == acc->capacity) {
+                acc_grow(acc);  // may rehash, so start probing again
+                slot = (col * 0x9E3779B97F4A7C15ul) >> 20 & acc->hashMask;
+                continue;
+            }
+            acc->keys[slot] = col;
+            acc->touched[acc->noTouched++] = col;
+            return slot;
+        }
+        slot = (slot + 1) & acc->hashMask;
+    }
+    return slot;
+}
+
+/// @brief adds value to the entry of column col in the current row
+__attribute__((always_inline)) inline void acc_add(struct ACCUMULATOR* acc, uint64_t col, float value) {
+    if (acc->hashMask) {
+        uint64_t slot = acc_hash_slot(acc, col);  // may grow the table, so sum is loaded afterwards
+        acc->sum[slot] += value;
+        return;
+    }
+    uint64_t bit = 1ul << (col & 63);
+    if (!(acc->bitmap[col >> 6] & bit)) {
+        if (acc->noTouched == acc->capacity) {
+            acc_grow(acc);
+        }
+        acc->bitmap[col >> 6] |= bit;
+        acc->touched[acc->noTouched++] = col;
+    }
+    acc->sum[col] += value;
+}
+
+/// @brief writes the non-zero entries of the current row in ascending column order and resets the accumulator
+/// @param acc accumulator
+/// @param indices output: columns
+/// @param values output: values
+/// @return number of written entries
+uint64_t acc_flush(struct ACCUMULATOR* acc, elpk_index_t* indices, float* values);
+
+/// @brief resets the accumulator without emitting anything
+/// @return number of distinct columns touched in the current row
+uint64_t acc_clear(struct ACCUMULATOR* acc);
+
+/// @brief sorts n indices ascending
+void sort_indices(uint64_t* a, uint64_t n);
+
+#endif
@@ -0,0 +1,152 @@
+#include "autoselect.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ellpack.h"
+#include "mult.h"
+#include "util.h"
+
+// number of entries of a sampled row of left whose rows of right are looked up
+#define AUTO_SAMPLE_ENTRIES 64
+
+struct AUTO_THRESHOLDS autoThresholds = {.sparseNsPerFlop = 6.0, .denseNsPerFlop = 0.05, .sellSkew = 26.0};
+
+/// @brief replaces autoThresholds by the values in the file at path (missing names keep their value)
+void read_auto_thresholds(const char* path) {
+    FILE* file = (FILE*)abortIfNULL_msg(fopen(path, "r"), "could not open thresholds file");
+    char line[256];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char name[64];
+        double value;
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+        if (sscanf(line, " %63[^= ] = %lf", name, &value) != 2) {
+            fprintf(stderr, "ERROR: invalid line in thresholds file: %s", line);
+            exit(EXIT_FAILURE);
+        }
+        if (strcmp(name, "sparseNsPerFlop") == 0) {
+            autoThresholds.sparseNsPerFlop = value;
+        } else if (strcmp(name, "denseNsPerFlop") == 0) {
+            autoThresholds.denseNsPerFlop = value;
+        } else if (strcmp(name, "sellSkew") == 0) {
+            autoThresholds.sellSkew = value;
+        } else {
+            fprintf(stderr, "ERROR: unknown name in thresholds file: '%s'\n", name);
+            exit(EXIT_FAILURE);
+        }
+    }
+    fclose(file);
+}
+
+/// @brief helper: number of entries of row i without trailing padding, binary search for the first padding entry
+/// (rows are entries followed by padding)
+static uint64_t helper_row_length(const struct ELLPACK matrix, uint64_t i) {
+    const float* values = &matrix.values[i * matrix.maxNoNonZero];
+    uint64_t lo = 0, hi = matrix.maxNoNonZero;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (values[mid] != 0.f) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/// @brief helper: average row length of up to AUTO_SAMPLE_ROWS evenly spaced rows
+static double helper_sample_row_length(const struct ELLPACK matrix) {
+    uint64_t samples = matrix.noRows < AUTO_SAMPLE_ROWS ? matrix.noRows : AUTO_SAMPLE_ROWS;
+    double sum = 0;
+    for (uint64_t s = 0; s < samples; s++) {
+        sum += helper_row_length(matrix, s * matrix.noRows / samples);
+    }
+    return samples ? sum / samples : 0;
+}
+
+/// @brief evaluates the cost model for left * right, reads at most AUTO_SAMPLE_ROWS rows of left and the rows of
+/// right they reference
+struct AUTO_ESTIMATE estimate_cost(const struct ELLPACK left, const struct ELLPACK right) {
+    struct AUTO_ESTIMATE estimate;
+    estimate.rowLengthLeft = helper_sample_row_length(left);
+    estimate.rowLengthRight = helper_sample_row_length(right);
+    estimate.skew = 1;
+    if (estimate.rowLengthLeft > 0 && left.maxNoNonZero / estimate.rowLengthLeft > estimate.skew) {
+        estimate.skew = left.maxNoNonZero / estimate.rowLengthLeft;
+    }
+    if (estimate.rowLengthRight > 0 && right.maxNoNonZero / estimate.rowLengthRight > estimate.skew) {
+        estimate.skew = right.maxNoNonZero / estimate.rowLengthRight;
+    }
+
+    // flops of the sampled rows of left: lengths of the referenced rows of right (at most AUTO_SAMPLE_ENTRIES per row)
+    uint64_t samples = left.noRows < AUTO_SAMPLE_ROWS ? left.noRows : AUTO_SAMPLE_ROWS;
+    double flops = 0;
+    for (uint64_t s = 0; s < samples; s++) {
+        uint64_t i = s * left.noRows / samples;
+        uint64_t length = helper_row_length(left, i);
+        uint64_t entries = length < AUTO_SAMPLE_ENTRIES ? length : AUTO_SAMPLE_ENTRIES;
+        double rowFlops = 0;
+        for (uint64_t e = 0; e < entries; e++) {
+            rowFlops += helper_row_length(right, left.indices[i * left.maxNoNonZero + e * length / entries]);
+        }
+        flops += entries ? rowFlops * length / entries : 0;
+    }
+    estimate.flops = samples ? flops / samples * left.noRows : 0;
+    estimate.storedEntries = (double)left.noRows * left.maxNoNonZero + (double)right.noRows * right.maxNoNonZero;
+    estimate.denseFlops = (double)left.noRows * left.noCols * right.noCols;
+    estimate.sparseNs = (estimate.flops + estimate.storedEntries) * autoThresholds.sparseNsPerFlop;
+    estimate.denseNs = estimate.denseFlops * autoThresholds.denseNsPerFlop;
+
+    if (estimate.denseNs < estimate.sparseNs) {
+        estimate.version = 4;
+    } else if (estimate.skew > autoThresholds.sellSkew) {
+        estimate.version = 6;
+    } else {
+        estimate.version = 0;
+    }
+    return estimate;
+}
+
+/// @brief prints an estimate as `name=value` lines (read by tests/bench.py calibrate)
+void print_estimate(FILE* file, const struct AUTO_ESTIMATE estimate) {
+    fprintf(file, "rowLengthLeft=%g\n", estimate.rowLengthLeft);
+    fprintf(file, "rowLengthRight=%g\n", estimate.rowLengthRight);
+    fprintf(file, "skew=%g\n", estimate.skew);
+    fprintf(file, "flops=%g\n", estimate.flops);
+    fprintf(file, "storedEntries=%g\n", estimate.storedEntries);
+    fprintf(file, "denseFlops=%g\n", estimate.denseFlops);
+    fprintf(file, "sparseNs=%g\n", estimate.sparseNs);
+    fprintf(file, "denseNs=%g\n", estimate.denseNs);
+    fprintf(file, "version=%d\n", estimate.version);
+}
+
+/// @brief automatic version: chooses the implementation with estimate_cost and runs it
+/// @param a Pointer to left matrix
+/// @param b Pointer to right matrix
+/// @param res Pointer to result of multiplication
+void matr_mult_ellpack_auto(const void* a, const void* b, void* res) {
+    const struct ELLPACK left = *(struct ELLPACK*)a;
+    const struct ELLPACK right = *(struct ELLPACK*)b;
+    validate_inputs(left, right);
+    const struct AUTO_ESTIMATE estimate = estimate_cost(left, right);
+#ifdef DEBUG
+    pdebug("auto: %lux%lu (maxNoNonZero %lu) * %lux%lu (maxNoNonZero %lu)\n", left.noRows, left.noCols,
+           left.maxNoNonZero, right.noRows, right.noCols, right.maxNoNonZero);
+    print_estimate(stderr, estimate);
+#endif
+
+    switch (estimate.version) {
+        case 4:
+            matr_mult_ellpack_V4(a, b, res);
+            break;
+        case 6:
+            matr_mult_ellpack_V6(a, b, res);
+            break;
+        default:
+            matr_mult_ellpack(a, b, res);
+    }
+}
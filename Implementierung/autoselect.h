@@ -0,0 +1,57 @@
+#ifndef GUARD_AUTOSELECT
+#define GUARD_AUTOSELECT
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "ellpack.h"
+
+// impl version of `-V auto`
+#define AUTO_IMPL_VERSION -1
+
+// number of evenly spaced rows of every operand the cost model looks at
+#define AUTO_SAMPLE_ROWS 1024
+
+/// @brief machine dependent parameters of the cost model, can be measured with `tests/bench.py calibrate` and loaded
+/// with -C; every line of the file is `name=value`, lines starting with '#' are ignored
+struct AUTO_THRESHOLDS {
+    double sparseNsPerFlop;  // time of the main version per multiply-add or stored entry (padding included)
+    double denseNsPerFlop;   // time of the dense version (V4) per multiply-add of the dense product
+    double sellSkew;         // V6 is used if maxNoNonZero / average row length of an operand is larger
+};
+
+/// @brief thresholds used by matr_mult_ellpack_auto (defaults measured on an AVX-512 machine, can be replaced with -C)
+extern struct AUTO_THRESHOLDS autoThresholds;
+
+/// @brief inputs and result of the cost model
+struct AUTO_ESTIMATE {
+    double rowLengthLeft;   // average number of entries per row without padding (sampled)
+    double rowLengthRight;  // average number of entries per row without padding (sampled)
+    double skew;            // largest maxNoNonZero / rowLength of both operands
+    double flops;           // estimated multiply-adds of the sparse product (sampled)
+    double storedEntries;   // entries of both operands including padding: noRows * maxNoNonZero
+    double denseFlops;      // multiply-adds of the dense product: noRows * noCols of left * noCols of right
+    double sparseNs;        // estimated time of the main version
+    double denseNs;         // estimated time of the dense version
+    int version;            // chosen impl version
+};
+
+/// @brief replaces autoThresholds by the values in the file at path (missing names keep their value)
+void read_auto_thresholds(const char* path);
+
+/// @brief evaluates the cost model for left * right: the main version costs sparseNsPerFlop per multiply-add and
+/// stored entry, the dense version denseNsPerFlop per multiply-add of the dense product; V6 replaces the main version
+/// if the rows of an operand are skewed (a few long rows make most stored entries padding), reads at most
+/// AUTO_SAMPLE_ROWS rows of left and the rows of right they reference
+struct AUTO_ESTIMATE estimate_cost(const struct ELLPACK left, const struct ELLPACK right);
+
+/// @brief prints an estimate as `name=value` lines (read by tests/bench.py calibrate)
+void print_estimate(FILE* file, const struct AUTO_ESTIMATE estimate);
+
+/// @brief automatic version: chooses the implementation with estimate_cost and runs it
+/// @param a Pointer to left matrix
+/// @param b Pointer to right matrix
+/// @param res Pointer to result of multiplication
+void matr_mult_ellpack_auto(const void* a, const void* b, void* res);
+
+#endif
@@ -0,0 +1,266 @@
+#include "benchmark.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "autoselect.h"
+#include "ellpack.h"
+#include "masked.h"
+#include "parallel.h"
+#include "perfcount.h"
+#include "sell.h"
+#include "simd.h"
+#include "spmm.h"
+#include "spmv.h"
+#include "util.h"
+#include "workspace.h"
+
+/// @brief seconds between start and end
+double elapsed_seconds(struct timespec start, struct timespec end) {
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1.0e9;
+}
+
+/// @brief seconds since start
+double seconds_since(struct timespec start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return elapsed_seconds(start, now);
+}
+
+/// @brief comparator for qsort
+static int helper_compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/// @brief helper: computes min, median, p95, max and mean of the measured times of stats
+static void helper_summarize(struct BENCH_STATS* stats) {
+    const int iterations = stats->iterations;
+    if (iterations == 0) {
+        return;
+    }
+
+    double* sorted = (double*)abortIfNULL(malloc(iterations * sizeof(double)));
+    memcpy(sorted, stats->times, iterations * sizeof(double));
+    qsort(sorted, iterations, sizeof(double), helper_compare_doubles);
+    stats->min = sorted[0];
+    stats->max = sorted[iterations - 1];
+    stats->median =
+        iterations % 2 ? sorted[iterations / 2] : (sorted[iterations / 2 - 1] + sorted[iterations / 2]) / 2;
+    stats->p95 = sorted[(iterations * 95 + 99) / 100 - 1];  // ceil(0.95 * n) - 1
+    stats->mean = 0;
+    for (int i = 0; i < iterations; i++) {
+        stats->mean += sorted[i] / iterations;
+    }
+    free(sorted);
+}
+
+/// @brief runs mult warmup times untimed and then iterations times, only the multiplication is timed (the result of
+/// every iteration is freed and boundWorkspace is reset outside the timed region); the result of the last iteration is
+/// returned in res; the warmup runs are not measured by the perf counters either
+/// @param mult multiplication to benchmark
+/// @param a left matrix
+/// @param b right matrix
+/// @param warmup number of untimed runs
+/// @param iterations number of timed runs
+/// @param res output: result of the last run (if iterations + warmup > 0), free with elpk_free
+/// @return stats, free with bench_free
+struct BENCH_STATS bench_multiply(void (*mult)(const void*, const void*, void*), const struct ELLPACK* a,
+                                  const struct ELLPACK* b, int warmup, int iterations, struct ELLPACK* res) {
+    struct BENCH_STATS stats = {.iterations = iterations};
+    stats.times = (double*)abortIfNULL(malloc((iterations + 1) * sizeof(double)));
+
+    const bool perf = perfEnabled;
+    for (int i = 0; i < warmup + iterations; i++) {
+        if (i > 0) {
+            elpk_free(*res);
+        }
+        if (boundWorkspace != NULL) {
+            workspace_reset(boundWorkspace);  // the previous result is released here
+        }
+        perfEnabled = perf && i >= warmup;
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        perf_begin(PHASE_MULTIPLY);
+        mult(a, b, res);
+        perf_end(PHASE_MULTIPLY);
+        if (i >= warmup) {
+            stats.times[i - warmup] = seconds_since(start);
+        }
+    }
+    perfEnabled = perf;
+    helper_summarize(&stats);
+    return stats;
+}
+
+/// @brief runs spmv warmup times untimed and then iterations times, every run multiplies matrix with the whole batch x
+/// @param matrix matrix converted with spmv_prepare
+/// @param kernel kernel matrix was prepared for
+/// @param x vectors, one per row
+/// @param y output: result of the last run, allocated by the caller
+/// @param warmup number of untimed runs
+/// @param iterations number of timed runs
+/// @return stats, free with bench_free
+struct BENCH_STATS bench_spmv(const struct SELL* matrix, const struct SPMV_KERNEL kernel, const struct DENSE_MATRIX x,
+                              struct DENSE_MATRIX y, int warmup, int iterations) {
+    struct BENCH_STATS stats = {.iterations = iterations};
+    stats.times = (double*)abortIfNULL(malloc((iterations + 1) * sizeof(double)));
+
+    const bool perf = perfEnabled;
+    for (int i = 0; i < warmup + iterations; i++) {
+        perfEnabled = perf && i >= warmup;
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        perf_begin(PHASE_MULTIPLY);
+        spmv(matrix, kernel, x, y);
+        perf_end(PHASE_MULTIPLY);
+        if (i >= warmup) {
+            stats.times[i - warmup] = seconds_since(start);
+        }
+    }
+    perfEnabled = perf;
+    helper_summarize(&stats);
+    return stats;
+}
+
+/// @brief runs spmm warmup times untimed and then iterations times; with dense the product is written into dense,
+/// otherwise it is computed in ELLPACK format and freed (and boundWorkspace reset) between the runs like in
+/// bench_multiply
+/// @param left left operand in ELLPACK format
+/// @param right right operand packed with spmm_pack
+/// @param kernel kernel right was packed for
+/// @param dense output: dense result of the last run, allocated by the caller; NULL to compute ELLPACK results
+/// @param res output: ELLPACK result of the last run (if dense is NULL and iterations + warmup > 0)
+/// @param warmup number of untimed runs
+/// @param iterations number of timed runs
+/// @return stats, free with bench_free
+struct BENCH_STATS bench_spmm(const struct ELLPACK* left, const struct SPMM_PANEL* right,
+                              const struct SPMM_KERNEL kernel, struct DENSE_MATRIX* dense, struct ELLPACK* res,
+                              int warmup, int iterations) {
+    struct BENCH_STATS stats = {.iterations = iterations};
+    stats.times = (double*)abortIfNULL(malloc((iterations + 1) * sizeof(double)));
+
+    const bool perf = perfEnabled;
+    for (int i = 0; i < warmup + iterations; i++) {
+        if (dense == NULL && i > 0) {
+            elpk_free(*res);
+        }
+        if (dense == NULL && boundWorkspace != NULL) {
+            workspace_reset(boundWorkspace);  // the panel is not taken from the workspace
+        }
+        perfEnabled = perf && i >= warmup;
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        perf_begin(PHASE_MULTIPLY);
+        if (dense != NULL) {
+            spmm_dense(*left, *right, kernel, *dense);
+        } else {
+            *res = spmm_ellpack(*left, *right, kernel);
+        }
+        perf_end(PHASE_MULTIPLY);
+        if (i >= warmup) {
+            stats.times[i - warmup] = seconds_since(start);
+        }
+    }
+    perfEnabled = perf;
+    helper_summarize(&stats);
+    return stats;
+}
+
+/// @brief runs masked_multiply warmup times untimed and then iterations times, the results are freed (and
+/// boundWorkspace reset) between the runs like in bench_multiply
+/// @param left left matrix
+/// @param right right matrix
+/// @param mask pattern of the result
+/// @param warmup number of untimed runs
+/// @param iterations number of timed runs
+/// @param res output: result of the last run (if iterations + warmup > 0)
+/// @return stats, free with bench_free
+struct BENCH_STATS bench_masked(const struct ELLPACK* left, const struct ELLPACK* right, const struct ELLPACK* mask,
+                                int warmup, int iterations, struct ELLPACK* res) {
+    struct BENCH_STATS stats = {.iterations = iterations};
+    stats.times = (double*)abortIfNULL(malloc((iterations + 1) * sizeof(double)));
+
+    const bool perf = perfEnabled;
+    for (int i = 0; i < warmup + iterations; i++) {
+        if (i > 0) {
+            elpk_free(*res);
+        }
+        if (boundWorkspace != NULL) {
+            workspace_reset(boundWorkspace);
+        }
+        perfEnabled = perf && i >= warmup;
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        perf_begin(PHASE_MULTIPLY);
+        *res = masked_multiply(*left, *right, *mask);
+        perf_end(PHASE_MULTIPLY);
+        if (i >= warmup) {
+            stats.times[i - warmup] = seconds_since(start);
+        }
+    }
+    perfEnabled = perf;
+    helper_summarize(&stats);
+    return stats;
+}
+
+/// @brief convenience/wrapper function to free BENCH_STATS struct
+void bench_free(struct BENCH_STATS stats) { free(stats.times); }
+
+/// @brief prints the result either human readable or as one JSON object
+/// @param result result of the benchmark
+/// @param version impl version (AUTO_IMPL_VERSION is printed as auto)
+/// @param json print JSON instead of text
+void print_bench(const struct BENCH_RESULT result, int version, bool json) {
+    const struct BENCH_STATS m = result.multiply;
+    if (!json) {
+        if (version == AUTO_IMPL_VERSION) {
+            printf("version auto, ");
+        } else {
+            printf("version %d, ", version);
+        }
+        printf("%d threads, %s, %d iterations after %d warmup runs\n", noThreads, simd_level_name(simdLevel),
+               m.iterations, result.warmup);
+        printf("parse a:  %.6f seconds\n", result.parseA);
+        printf("parse b:  %.6f seconds\n", result.parseB);
+        if (result.bytes > 0) {
+            printf("convert:  %.6f seconds\n", result.convert);
+        }
+        if (m.iterations > 0) {
+            printf("multiply: min %.6f, median %.6f, p95 %.6f, max %.6f seconds\n", m.min, m.median, m.p95, m.max);
+            printf("          %lu multiplications, %.3f GFLOP/s (median)\n", result.multiplications, result.gflops);
+            if (result.bytes > 0) {
+                printf("          %lu bytes, %.3f GB/s (median)\n", result.bytes, result.gbps);
+            }
+        }
+        printf("write:    %.6f seconds\n", result.write);
+        return;
+    }
+
+    if (version == AUTO_IMPL_VERSION) {
+        printf("{\"version\": \"auto\", ");
+    } else {
+        printf("{\"version\": %d, ", version);
+    }
+    printf("\"threads\": %d, \"simd\": \"%s\", \"warmup\": %d, \"iterations\": %d, ", noThreads,
+           simd_level_name(simdLevel), result.warmup, m.iterations);
+    printf("\"parse_a\": %.9f, \"parse_b\": %.9f, \"write\": %.9f, ", result.parseA, result.parseB, result.write);
+    if (result.bytes > 0) {
+        printf("\"convert\": %.9f, \"bytes\": %lu, \"gbps\": %.6f, ", result.convert, result.bytes, result.gbps);
+    }
+    printf("\"multiplications\": %lu, \"gflops\": %.6f, \"multiply\": {", result.multiplications, result.gflops);
+    if (m.iterations > 0) {
+        printf("\"min\": %.9f, \"median\": %.9f, \"p95\": %.9f, \"max\": %.9f, \"mean\": %.9f, ", m.min, m.median,
+               m.p95, m.max, m.mean);
+    }
+    printf("\"times\": [");
+    for (int i = 0; i < m.iterations; i++) {
+        printf(i ? ", %.9f" : "%.9f", m.times[i]);
+    }
+    printf("]}}\n");
+}
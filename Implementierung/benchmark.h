@@ -0,0 +1,105 @@
+#ifndef GUARD_BENCHMARK
+#define GUARD_BENCHMARK
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "ellpack.h"
+#include "sell.h"
+#include "spmm.h"
+#include "spmv.h"
+
+/// @brief summary of the timings of all measured iterations of one phase
+struct BENCH_STATS {
+    int iterations;
+    double min;
+    double median;
+    double p95;  // nearest rank
+    double max;
+    double mean;
+    double* times;  // every iteration in seconds, in the order they were measured
+};
+
+/// @brief timings of one benchmark run
+struct BENCH_RESULT {
+    int warmup;
+    double parseA;  // seconds
+    double parseB;
+    double write;
+    struct BENCH_STATS multiply;
+    uint64_t multiplications;  // products of non-zero entries (a multiply-add is counted as 2 flops)
+    double gflops;             // 2 * multiplications / median multiply time
+    // SpMV and SpMM only (bytes = 0 otherwise)
+    double convert;  // seconds to convert an operand to the layout of the kernel
+    uint64_t bytes;  // bytes moved by one run at least
+    double gbps;     // bytes / median multiply time / 1e9
+};
+
+/// @brief seconds between start and end
+double elapsed_seconds(struct timespec start, struct timespec end);
+
+/// @brief seconds since start
+double seconds_since(struct timespec start);
+
+/// @brief runs mult warmup times untimed and then iterations times, only the multiplication is timed (the result of
+/// every iteration is freed and boundWorkspace is reset outside the timed region); the result of the last iteration is
+/// returned in res; the warmup runs are not measured by the perf counters either
+/// @param mult multiplication to benchmark
+/// @param a left matrix
+/// @param b right matrix
+/// @param warmup number of untimed runs
+/// @param iterations number of timed runs
+/// @param res output: result of the last run (if iterations + warmup > 0), free with elpk_free
+/// @return stats, free with bench_free
+struct BENCH_STATS bench_multiply(void (*mult)(const void*, const void*, void*), const struct ELLPACK* a,
+                                  const struct ELLPACK* b, int warmup, int iterations, struct ELLPACK* res);
+
+/// @brief runs spmv warmup times untimed and then iterations times, every run multiplies matrix with the whole batch x
+/// @param matrix matrix converted with spmv_prepare
+/// @param kernel kernel matrix was prepared for
+/// @param x vectors, one per row
+/// @param y output: result of the last run, allocated by the caller
+/// @param warmup number of untimed runs
+/// @param iterations number of timed runs
+/// @return stats, free with bench_free
+struct BENCH_STATS bench_spmv(const struct SELL* matrix, const struct SPMV_KERNEL kernel, const struct DENSE_MATRIX x,
+                              struct DENSE_MATRIX y, int warmup, int iterations);
+
+/// @brief runs spmm warmup times untimed and then iterations times; with dense the product is written into dense,
+/// otherwise it is computed in ELLPACK format and freed (and boundWorkspace reset) between the runs like in
+/// bench_multiply
+/// @param left left operand in ELLPACK format
+/// @param right right operand packed with spmm_pack
+/// @param kernel kernel right was packed for
+/// @param dense output: dense result of the last run, allocated by the caller; NULL to compute ELLPACK results
+/// @param res output: ELLPACK result of the last run (if dense is NULL and iterations + warmup > 0)
+/// @param warmup number of untimed runs
+/// @param iterations number of timed runs
+/// @return stats, free with bench_free
+struct BENCH_STATS bench_spmm(const struct ELLPACK* left, const struct SPMM_PANEL* right,
+                              const struct SPMM_KERNEL kernel, struct DENSE_MATRIX* dense, struct ELLPACK* res,
+                              int warmup, int iterations);
+
+/// @brief runs masked_multiply warmup times untimed and then iterations times, the results are freed (and
+/// boundWorkspace reset) between the runs like in bench_multiply
+/// @param left left matrix
+/// @param right right matrix
+/// @param mask pattern of the result
+/// @param warmup number of untimed runs
+/// @param iterations number of timed runs
+/// @param res output: result of the last run (if iterations + warmup > 0)
+/// @return stats, free with bench_free
+struct BENCH_STATS bench_masked(const struct ELLPACK* left, const struct ELLPACK* right, const struct ELLPACK* mask,
+                                int warmup, int iterations, struct ELLPACK* res);
+
+/// @brief convenience/wrapper function to free BENCH_STATS struct
+void bench_free(struct BENCH_STATS stats);
+
+/// @brief prints the result either human readable or as one JSON object
+/// @param result result of the benchmark
+/// @param version impl version (AUTO_IMPL_VERSION is printed as auto)
+/// @param json print JSON instead of text
+void print_bench(const struct BENCH_RESULT result, int version, bool json);
+
+#endif
@@ -0,0 +1,119 @@
+#include "chain.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "autoselect.h"
+#include "ellpack.h"
+#include "mult.h"
+#include "util.h"
+
+/// @brief helper: estimated non-zero entries of a noRows x noCols product of the given multiply-adds, assuming they
+/// hit the entries uniformly at random (the expected number of entries hit at least once)
+static double helper_product_nnz(double noRows, double noCols, double flops) {
+    double size = noRows * noCols;
+    return size > 0 ? size * -expm1(-flops / size) : 0;
+}
+
+/// @brief chooses the cheapest parenthesization of matrices[0] * ... * matrices[n - 1] (matrix chain ordering on
+/// estimated costs): the non-zero entries of the inputs and the multiply-adds of adjacent inputs are sampled with
+/// estimate_cost, products of longer ranges are estimated assuming uniformly spread entries
+/// @param matrices n matrices with matching dimensions
+/// @param n number of matrices
+/// @return n x n table, entry i * n + j describes the range [i, j] (only j >= i is set), free with free
+struct CHAIN_ESTIMATE* chain_order(const struct ELLPACK* matrices, uint64_t n) {
+    struct CHAIN_ESTIMATE* table = (struct CHAIN_ESTIMATE*)abortIfNULL(malloc(n * n * sizeof(struct CHAIN_ESTIMATE)));
+    double* pairFlops = (double*)abortIfNULL(malloc(n * sizeof(double)));  // flops of matrices[i] * matrices[i + 1]
+
+    for (uint64_t i = 0; i + 1 < n; i++) {
+        const struct AUTO_ESTIMATE estimate = estimate_cost(matrices[i], matrices[i + 1]);
+        table[i * n + i] = (struct CHAIN_ESTIMATE){.nnz = estimate.rowLengthLeft * matrices[i].noRows, .split = i};
+        pairFlops[i] = estimate.flops;
+        if (i + 2 == n) {
+            table[n * n - 1] = (struct CHAIN_ESTIMATE){.nnz = estimate.rowLengthRight * matrices[n - 1].noRows,
+                                                       .split = n - 1};
+        }
+    }
+    if (n == 1) {
+        table[0] = (struct CHAIN_ESTIMATE){.nnz = 0, .cost = 0, .split = 0};
+    }
+
+    // ranges by increasing length: the cheapest split of [i, j] only depends on shorter ranges
+    for (uint64_t length = 2; length <= n; length++) {
+        for (uint64_t i = 0; i + length <= n; i++) {
+            uint64_t j = i + length - 1;
+            struct CHAIN_ESTIMATE* best = &table[i * n + j];
+            best->cost = INFINITY;
+            for (uint64_t k = i; k < j; k++) {
+                const struct CHAIN_ESTIMATE left = table[i * n + k];
+                const struct CHAIN_ESTIMATE right = table[(k + 1) * n + j];
+                double flops = length == 2 ? pairFlops[i]
+                               : matrices[k + 1].noRows > 0 ? left.nnz * right.nnz / matrices[k + 1].noRows
+                                                            : 0;
+                double nnz = helper_product_nnz(matrices[i].noRows, matrices[j].noCols, flops);
+                double cost = left.cost + right.cost + flops + nnz;
+                if (cost < best->cost) {
+                    *best = (struct CHAIN_ESTIMATE){.nnz = nnz, .cost = cost, .split = k};
+                }
+            }
+        }
+    }
+    free(pairFlops);
+    return table;
+}
+
+#ifdef DEBUG
+/// @brief helper: prints the order of the range [i, j] like ((0 1) 2)
+static void helper_print_order(const struct CHAIN_ESTIMATE* table, uint64_t n, uint64_t i, uint64_t j) {
+    if (i == j) {
+        fprintf(stderr, "%lu", i);
+        return;
+    }
+    fputc('(', stderr);
+    helper_print_order(table, n, i, table[i * n + j].split);
+    fputc(' ', stderr);
+    helper_print_order(table, n, table[i * n + j].split + 1, j);
+    fputc(')', stderr);
+}
+#endif
+
+/// @brief helper: computes the product of the range [i, j] and frees its operands
+static struct ELLPACK helper_chain_range(void (*mult)(const void*, const void*, void*), struct ELLPACK* matrices,
+                                        const struct CHAIN_ESTIMATE* table, uint64_t n, uint64_t i, uint64_t j) {
+    if (i == j) {
+        return matrices[i];
+    }
+    uint64_t split = table[i * n + j].split;
+    struct ELLPACK left = helper_chain_range(mult, matrices, table, n, i, split);
+    struct ELLPACK right = helper_chain_range(mult, matrices, table, n, split + 1, j);
+    struct ELLPACK result;
+    mult(&left, &right, &result);
+    pdebug("chain: [%lu, %lu] * [%lu, %lu]: %lu x %lu, maxNoNonZero %lu (estimated nnz %.0f)\n", i, split, split + 1,
+           j, result.noRows, result.noCols, result.maxNoNonZero, table[i * n + j].nnz);
+    elpk_free(left);
+    elpk_free(right);
+    return result;
+}
+
+/// @brief multiplies matrices[0] * ... * matrices[n - 1] in the order chosen by chain_order; every input and
+/// intermediate is freed (elpk_free) as soon as its product is computed
+/// @param mult multiplication used for every product (signature of the matr_mult_ellpack versions)
+/// @param matrices n >= 1 matrices with matching dimensions, consumed
+/// @param n number of matrices
+/// @return product, free with elpk_free
+struct ELLPACK chain_multiply(void (*mult)(const void*, const void*, void*), struct ELLPACK* matrices, uint64_t n) {
+    for (uint64_t i = 0; i + 1 < n; i++) {
+        validate_inputs(matrices[i], matrices[i + 1]);
+    }
+    struct CHAIN_ESTIMATE* table = chain_order(matrices, n);
+#ifdef DEBUG
+    pdebug("chain order: ");
+    helper_print_order(table, n, 0, n - 1);
+    fprintf(stderr, ", estimated cost %g\n", table[n - 1].cost);
+#endif
+    struct ELLPACK result = helper_chain_range(mult, matrices, table, n, 0, n - 1);
+    free(table);
+    return result;
+}
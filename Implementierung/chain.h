@@ -0,0 +1,31 @@
+#ifndef GUARD_CHAIN
+#define GUARD_CHAIN
+
+#include <stdint.h>
+
+#include "ellpack.h"
+
+/// @brief estimated size and cost of the product of a range of the chain
+struct CHAIN_ESTIMATE {
+    double nnz;      // estimated non-zero entries of the product
+    double cost;     // estimated multiply-adds plus written entries of the cheapest order of the range
+    uint64_t split;  // the range [i, j] is computed as [i, split] * [split + 1, j]
+};
+
+/// @brief chooses the cheapest parenthesization of matrices[0] * ... * matrices[n - 1] (matrix chain ordering on
+/// estimated costs): the non-zero entries of the inputs and the multiply-adds of adjacent inputs are sampled with
+/// estimate_cost, products of longer ranges are estimated assuming uniformly spread entries
+/// @param matrices n matrices with matching dimensions
+/// @param n number of matrices
+/// @return n x n table, entry i * n + j describes the range [i, j] (only j >= i is set), free with free
+struct CHAIN_ESTIMATE* chain_order(const struct ELLPACK* matrices, uint64_t n);
+
+/// @brief multiplies matrices[0] * ... * matrices[n - 1] in the order chosen by chain_order; every input and
+/// intermediate is freed (elpk_free) as soon as its product is computed
+/// @param mult multiplication used for every product (signature of the matr_mult_ellpack versions)
+/// @param matrices n >= 1 matrices with matching dimensions, consumed
+/// @param n number of matrices
+/// @return product, free with elpk_free
+struct ELLPACK chain_multiply(void (*mult)(const void*, const void*, void*), struct ELLPACK* matrices, uint64_t n);
+
+#endif
@@ -4,9 +4,47 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "half.h"
 #include "util.h"
 
+/// @brief returns a copy of matrix (on the heap) with its values stored as type, matrix is not changed
+/// @param matrix matrix of any value type
+/// @param type value type of the copy
+/// @return copy, free with elpk_free
+struct ELLPACK elpk_with_value_type(const struct ELLPACK matrix, enum VALUE_TYPE type) {
+    struct ELLPACK copy = {.noRows = matrix.noRows,
+                           .noCols = matrix.noCols,
+                           .maxNoNonZero = matrix.maxNoNonZero,
+                           .valueType = type,
+                           .storage = ELPK_HEAP};
+    uint64_t itemsCount = matrix.noRows * matrix.maxNoNonZero;
+    copy.indices = (elpk_index_t*)abortIfNULL(malloc(itemsCount * sizeof(elpk_index_t) + 1));
+    memcpy(copy.indices, matrix.indices, itemsCount * sizeof(elpk_index_t));
+
+    if (type == VALUE_FP32) {
+        copy.values = (float*)abortIfNULL(malloc(itemsCount * sizeof(float) + 1));
+        if (matrix.valueType == VALUE_FP32) {
+            memcpy(copy.values, matrix.values, itemsCount * sizeof(float));
+        } else {
+            half_widen(matrix.valueType, matrix.halfValues, copy.values, itemsCount);
+        }
+    } else {
+        copy.halfValues = (uint16_t*)abortIfNULL(malloc(itemsCount * sizeof(uint16_t) + 1));
+        if (matrix.valueType == VALUE_FP32) {
+            half_narrow(type, matrix.values, copy.halfValues, itemsCount);
+        } else if (matrix.valueType == type) {
+            memcpy(copy.halfValues, matrix.halfValues, itemsCount * sizeof(uint16_t));
+        } else {
+            for (uint64_t k = 0; k < itemsCount; k++) {
+                copy.halfValues[k] = float_to_half(type, half_to_float(matrix.valueType, matrix.halfValues[k]));
+            }
+        }
+    }
+    return copy;
+}
+
 /// @brief checks wether two ELLPACK matrices are equal (enough)
 /// @param a matrix a
 /// @param b matrix b
@@ -39,7 +77,7 @@ void elpk_check_equal(struct ELLPACK a, struct ELLPACK b, float max_diff) {
             printf(
                 "values or index at entry '%lu' greater than "
                 "tolerated error (%s): reldev %f: a(val: %s, rowind: %lu) vs b(val: %s, rowind: %lu) \n",
-                i, s_max_diff, reldeviation, s1, a.indices[i], s2, b.indices[i]);
+                i, s_max_diff, reldeviation, s1, (uint64_t)a.indices[i], s2, (uint64_t)b.indices[i]);
 
             exit(EXIT_FAILURE);
         }
@@ -1,22 +1,51 @@
 #ifndef GUARD_ELLPACK
 #define GUARD_ELLPACK
 
+#include <stdbool.h>
 #include <stdint.h>
-#include <xmmintrin.h>
+#include <stdlib.h>
+#include <sys/mman.h>
 
-struct ELLPACK {
-    uint64_t noRows;
-    uint64_t noCols;
-    uint64_t maxNoNonZero;
-    float* values;  // asterisk is stored as 0.0
-    uint64_t* indices;
+#include "half.h"
+
+// width of the column indices in bits, set with `make INDEX_BITS=N` (16, 32 or 64); matrices with more columns than
+// an index can address are rejected when they are read
+#ifndef INDEX_BITS
+#define INDEX_BITS 32
+#endif
+
+#if INDEX_BITS == 64
+typedef uint64_t elpk_index_t;
+#elif INDEX_BITS == 32
+typedef uint32_t elpk_index_t;
+#elif INDEX_BITS == 16
+typedef uint16_t elpk_index_t;
+#else
+#error "INDEX_BITS has to be 16, 32 or 64"
+#endif
+
+#define ELPK_INDEX_MAX ((uint64_t)(elpk_index_t)-1)
+
+/// @brief owner of the values and indices of an ELLPACK matrix, decides what elpk_free does
+enum ELPK_STORAGE {
+    ELPK_HEAP,       // allocated with malloc (the default of a zeroed struct)
+    ELPK_MAPPED,     // point into mapping, an mmap-ed file
+    ELPK_WORKSPACE,  // taken from the result arena of a workspace, released by workspace_reset (see workspace.h)
 };
 
-struct DENSE_MATRIX_XMM {
+struct ELLPACK {
     uint64_t noRows;
     uint64_t noCols;
-    uint64_t noQuadCols;
-    __m128* values;
+    uint64_t maxNoNonZero;
+    float* values;  // asterisk is stored as 0.0; NULL unless valueType is VALUE_FP32
+    elpk_index_t* indices;
+    // values of binary files may be stored as bf16/fp16 (see half.h): they are read by file_io, the main version and
+    // spmv, every other kernel expects VALUE_FP32 (elpk_with_value_type)
+    enum VALUE_TYPE valueType;
+    uint16_t* halfValues;  // values of the 16 bit types, NULL for VALUE_FP32
+    enum ELPK_STORAGE storage;
+    void* mapping;  // ELPK_MAPPED: the mmap-ed file values and indices point into
+    uint64_t mappingSize;
 };
 
 struct DENSE_MATRIX {
@@ -25,6 +54,23 @@ struct DENSE_MATRIX {
     float* values;
 };
 
+/// @brief true if entry k of matrix is 0 (padding is stored as 0), for every value type
+__attribute__((always_inline)) inline bool elpk_is_zero(const struct ELLPACK* matrix, uint64_t k) {
+    return matrix->valueType == VALUE_FP32 ? matrix->values[k] == 0.f : (matrix->halfValues[k] & 0x7fffu) == 0;
+}
+
+/// @brief entry k of matrix as float, for every value type
+__attribute__((always_inline)) inline float elpk_value(const struct ELLPACK* matrix, uint64_t k) {
+    return matrix->valueType == VALUE_FP32 ? matrix->values[k]
+                                           : half_to_float(matrix->valueType, matrix->halfValues[k]);
+}
+
+/// @brief returns a copy of matrix (on the heap) with its values stored as type, matrix is not changed
+/// @param matrix matrix of any value type
+/// @param type value type of the copy
+/// @return copy, free with elpk_free
+struct ELLPACK elpk_with_value_type(const struct ELLPACK matrix, enum VALUE_TYPE type);
+
 /// @brief checks wether two ELLPACK matrices are equal (enough)
 /// @param a matrix a
 /// @param b matrix b
@@ -33,8 +79,17 @@ void elpk_check_equal(struct ELLPACK a, struct ELLPACK b, float max_diff);
 
 /// @brief convenience/wrapper function to free ELLPACK struct
 __attribute__((always_inline)) inline void elpk_free(struct ELLPACK e) {
-    free(e.values);
-    free(e.indices);
+    switch (e.storage) {
+        case ELPK_MAPPED:
+            munmap(e.mapping, e.mappingSize);
+            break;
+        case ELPK_WORKSPACE:
+            break;
+        default:
+            free(e.values);
+            free(e.halfValues);
+            free(e.indices);
+    }
 }
 
 #endif
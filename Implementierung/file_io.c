@@ -1,12 +1,18 @@
 #include "file_io.h"
 
+#include <errno.h>
 #include <math.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "ellpack.h"
+#include "parallel.h"
 #include "util.h"
 
 /// @brief helper: read int from string
@@ -77,169 +83,1034 @@ float helper_read_float(const char* string, long* pos, char end, char* field_for
     }
 }
 
+/// @brief check row i for no indices larger than matrix dimensions and only ascending indices
+static void helper_validate_row(const struct ELLPACK matrix, uint64_t i) {
+    int padding = 0;  // works as boolean to check if padded value was found
+    for (uint64_t j = 0; j < matrix.maxNoNonZero; j++) {
+        uint64_t accessIndex = i * matrix.maxNoNonZero + j;
+        if (matrix.indices[accessIndex] >= matrix.noCols) {
+            fprintf(stderr, "ERROR: Index %lu too large for a %lux%lu matrix.\n",
+                    (uint64_t)matrix.indices[accessIndex], matrix.noRows, matrix.noCols);
+            exit(EXIT_FAILURE);
+        }
+        if (padding == 0 && matrix.indices[accessIndex] == 0 && elpk_is_zero(&matrix, accessIndex)) {
+            padding = 1;
+        }
+        if (j != 0 && padding == 0 && matrix.indices[accessIndex] <= matrix.indices[accessIndex - 1]) {
+            fprintf(stderr,
+                    "ERROR: Indices not in ascending order in row %lu at index %lu: index %lu not greater than "
+                    "previous index %lu.\n",
+                    i, j, (uint64_t)matrix.indices[accessIndex], (uint64_t)matrix.indices[accessIndex - 1]);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
 /// @brief check for no indices larger than matrix dimensions and only ascending indices
 /// @param matrix matrix to check
 void validate_matrix(const struct ELLPACK matrix) {
-    uint64_t index = 0;
-    int padding;  // works as boolean to check if padded value was found
-    for (uint64_t j = 0; j < matrix.maxNoNonZero; j++) {
-        padding = 0;
-        for (uint64_t i = 0; i < matrix.noRows; i++) {
-            uint64_t accessIndex = i * matrix.maxNoNonZero + j;
-            if (matrix.indices[accessIndex] >= matrix.noCols) {
-                fprintf(stderr, "ERROR: Index %lu too large for a %lux%lu matrix.\n", matrix.indices[accessIndex],
-                        matrix.noRows, matrix.noCols);
-                exit(EXIT_FAILURE);
-            }
-            if (padding == 0 && matrix.indices[accessIndex] == 0 && matrix.values[accessIndex] == 0.f) {
-                padding = 1;
-            }
-            if (matrix.indices[accessIndex] <= index && j != 0 && padding == 0) {
-                fprintf(stderr,
-                        "ERROR: Indices not in ascending order in row %lu at index %lu: index %lu not greater than "
-                        "previous index %lu.\n",
-                        i, j, matrix.indices[accessIndex], matrix.indices[accessIndex - 1]);
-                exit(EXIT_FAILURE);
-            }
-            index = matrix.indices[accessIndex];
+    for (uint64_t i = 0; i < matrix.noRows; i++) {
+        helper_validate_row(matrix, i);
+    }
+}
+
+/// @brief exact powers of ten as float (10^10 = 2^10 * 5^10 still fits the 24 bit mantissa)
+static const float pow10f[] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+
+/// @brief helper: fast path of helper_read_float; a mantissa of at most 2^24 and at most 10 decimals are exact
+/// floats, so one correctly rounded division gives the same result as strtof; everything else (and all errors) is
+/// handed to helper_read_float
+/// @param string line
+/// @param pos current position in line, afterwards at end
+/// @param end character after float
+/// @return read float
+__attribute__((always_inline)) static inline float helper_parse_float(const char* string, long* pos, char end) {
+    const char* p = &string[*pos];
+    if (*p == '*') {
+        return helper_read_float(string, pos, end, "values");
+    }
+    bool negative = *p == '-';
+    p += negative;
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int decimals = -1;  // -1: no decimal point yet
+    for (;; p++) {
+        unsigned digit = (unsigned char)*p - '0';
+        if (digit <= 9) {
+            mantissa = mantissa * 10 + digit;
+            digits++;
+            decimals += decimals >= 0;
+        } else if (*p == '.' && decimals < 0) {
+            decimals = 0;
+        } else {
+            break;
         }
     }
+    if (*p != end || digits > 18 || mantissa > (1u << 24) || decimals > 10) {
+        return helper_read_float(string, pos, end, "values");
+    }
+    *pos = p - string;
+    float value = decimals > 0 ? (float)mantissa / pow10f[decimals] : (float)mantissa;
+    return negative ? -value : value;
 }
 
-/// @brief reads and validates a matrix
-/// @param file pointer to the file
-/// @result matrix in ELLPACK format
-struct ELLPACK elpk_read_validate(FILE* file) {
-    char* string = NULL;
-    size_t len = 0;
-    struct ELLPACK result;
-    long pos = 0;
+/// @brief helper: fast path of helper_read_int for the indices line, errors are handed to helper_read_int
+/// @param string line
+/// @param pos current position in line, afterwards at end
+/// @param end character after int
+/// @return read int
+__attribute__((always_inline)) static inline uint64_t helper_parse_index(const char* string, long* pos, char end) {
+    const char* p = &string[*pos];
+    if (*p == '*' && p[1] == end) {
+        (*pos)++;
+        return 0;
+    }
+    uint64_t res = 0;
+    for (unsigned digit; (digit = (unsigned char)*p - '0') <= 9; p++) {
+        res = res * 10 + digit;
+    }
+    if (*p != end) {
+        return helper_read_int(string, pos, end, "indices", 3);
+    }
+    *pos = p - string;
+    return res;
+}
 
-    abortIfNULL_msg((void*)(getline(&string, &len, file) + 1), "could not read from file");
+// lines shorter than this are not split between threads
+#define PARSE_MIN_CHUNK (1l << 16)
 
-    result.noRows = helper_read_int(string, &pos, ',', "noRows", 1);
-    pos++;
+/// @brief arguments shared by all threads parsing one line of a matrix
+struct PARSE_ARGS {
+    const char* line;      // values or indices line, ends with '\n' (or '\0' if malformed)
+    long length;           // length of line without '\n'
+    uint64_t itemsCount;   // number of comma separated items in line
+    long* chunkStart;      // n + 1 positions in line, chunk t is [chunkStart[t], chunkStart[t + 1])
+    uint64_t* firstItem;   // n + 1 item numbers, chunk t contains items [firstItem[t], firstItem[t + 1])
+    struct ELLPACK* matrix;
+};
+
+/// @brief pass 1: counts the items starting in chunk id (every item but the last one ends with a comma)
+static void helper_chunk_count(int id, int n, void* p) {
+    const struct PARSE_ARGS* args = (struct PARSE_ARGS*)p;
+    uint64_t count = id == n - 1 && args->length > 0;  // the last item ends with '\n'
+    for (long pos = args->chunkStart[id]; pos < args->chunkStart[id + 1]; pos++) {
+        count += args->line[pos] == ',';
+    }
+    args->firstItem[id + 1] = count;
+}
+
+/// @brief pass 2: parses the values of chunk id
+static void helper_chunk_values(int id, int n, void* p) {
+    (void)n;
+    const struct PARSE_ARGS* args = (struct PARSE_ARGS*)p;
+    float* values = args->matrix->values;
+    long pos = args->chunkStart[id];
+    for (uint64_t i = args->firstItem[id]; i < args->firstItem[id + 1]; i++) {
+        char end = i == args->itemsCount - 1 ? '\n' : ',';
+        values[i] = helper_parse_float(args->line, &pos, end);
+        pos++;
+    }
+}
+
+/// @brief pass 2: parses the indices of chunk id and validates every row as soon as it is complete (rows that start
+/// in an earlier chunk are validated after all threads finished)
+static void helper_chunk_indices(int id, int n, void* p) {
+    (void)n;
+    const struct PARSE_ARGS* args = (struct PARSE_ARGS*)p;
+    const struct ELLPACK matrix = *args->matrix;
+    long pos = args->chunkStart[id];
+    for (uint64_t i = args->firstItem[id]; i < args->firstItem[id + 1]; i++) {
+        char end = i == args->itemsCount - 1 ? '\n' : ',';
+        uint64_t index = helper_parse_index(args->line, &pos, end);
+        if (index >= matrix.noCols) {  // checked before it is narrowed to elpk_index_t
+            fprintf(stderr, "ERROR: Index %lu too large for a %lux%lu matrix.\n", index, matrix.noRows,
+                    matrix.noCols);
+            exit(EXIT_FAILURE);
+        }
+        matrix.indices[i] = index;
+        pos++;
+        if ((i + 1) % matrix.maxNoNonZero == 0 && i + 1 - matrix.maxNoNonZero >= args->firstItem[id]) {
+            helper_validate_row(matrix, i / matrix.maxNoNonZero);
+        }
+    }
+}
+
+/// @brief parses one line of values (indices = false) or indices (indices = true) on up to noThreads threads
+static void helper_parse_line(const char* line, long length, struct ELLPACK* matrix, bool indices) {
+    uint64_t itemsCount = matrix->noRows * matrix->maxNoNonZero;
+    if (itemsCount == 0) {
+        return;
+    }
+    int n = noThreads < 1 ? 1 : noThreads;
+    if (n > length / PARSE_MIN_CHUNK + 1) {
+        n = length / PARSE_MIN_CHUNK + 1;
+    }
+    long chunkStart[n + 1];
+    uint64_t firstItem[n + 1];
+    struct PARSE_ARGS args = {.line = line,
+                              .length = length,
+                              .itemsCount = itemsCount,
+                              .chunkStart = chunkStart,
+                              .firstItem = firstItem,
+                              .matrix = matrix};
+
+    // every chunk starts at the beginning of an item
+    chunkStart[0] = 0;
+    for (int t = 1; t < n; t++) {
+        const char* comma = memchr(&line[length * t / n], ',', length - length * t / n);
+        chunkStart[t] = comma == NULL ? length : comma - line + 1;
+        if (chunkStart[t] < chunkStart[t - 1]) {
+            chunkStart[t] = chunkStart[t - 1];
+        }
+    }
+    chunkStart[n] = length;
+
+    parallel_run(n, helper_chunk_count, &args);
+    firstItem[0] = 0;
+    for (int t = 0; t < n; t++) {
+        firstItem[t + 1] += firstItem[t];
+    }
+    if (firstItem[n] != itemsCount) {
+        fprintf(stderr, "<%s> contains %lu instead of %lu entries\n", indices ? "indices" : "values", firstItem[n],
+                itemsCount);
+        exit(EXIT_FAILURE);
+    }
 
-    result.noCols = helper_read_int(string, &pos, ',', "noCols", 1);
+    if (!indices) {
+        parallel_run(n, helper_chunk_values, &args);
+        return;
+    }
+    parallel_run(n, helper_chunk_indices, &args);
+    for (int t = 1; t < n; t++) {  // rows split between chunks
+        if (firstItem[t] % matrix->maxNoNonZero != 0 && firstItem[t] < itemsCount) {
+            helper_validate_row(*matrix, firstItem[t] / matrix->maxNoNonZero);
+        }
+    }
+}
+
+/// @brief helper: aborts if the column indices of matrix do not fit into elpk_index_t
+static void helper_check_index_width(const struct ELLPACK matrix) {
+    if (matrix.noCols != 0 && matrix.noCols - 1 > ELPK_INDEX_MAX) {
+        fprintf(stderr, "ERROR: %lu columns do not fit into %d bit indices (rebuild with a larger INDEX_BITS)\n",
+                matrix.noCols, INDEX_BITS);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/// @brief parses the three lines of a matrix, every line ends with '\n' (or '\0' if malformed)
+/// @param header first line (noRows,noCols,maxNoNonZero), has to be terminated with '\0'
+static struct ELLPACK helper_parse_matrix(const char* header, const char* valuesLine, long valuesLength,
+                                          const char* indicesLine, long indicesLength) {
+    struct ELLPACK result = {0};
+    long pos = 0;
+
+    result.noRows = helper_read_int(header, &pos, ',', "noRows", 1);
     pos++;
 
-    result.maxNoNonZero = helper_read_int(string, &pos, '\n', "maxNoNonZero", 1);
+    result.noCols = helper_read_int(header, &pos, ',', "noCols", 1);
+    pos++;
 
-    abortIfNULL_msg((void*)(getline(&string, &len, file) + 1), "could not read from file");
-    pos = 0;
+    result.maxNoNonZero = helper_read_int(header, &pos, '\n', "maxNoNonZero", 1);
+    result.storage = ELPK_HEAP;
+    helper_check_index_width(result);
 
     long itemsCount = result.noRows * result.maxNoNonZero;
 
     result.values = (float*)abortIfNULL_msg(malloc(itemsCount * sizeof(float)), "could not allocate memory");
-    for (long i = 0; i < itemsCount; i++) {
-        char end = i == itemsCount - 1 ? '\n' : ',';
-        result.values[i] = helper_read_float(string, &pos, end, "values");
-        pos++;
+    helper_parse_line(valuesLine, valuesLength, &result, false);
+
+    result.indices =
+        (elpk_index_t*)abortIfNULL_msg(malloc(itemsCount * sizeof(elpk_index_t)), "could not allocate memory");
+    helper_parse_line(indicesLine, indicesLength, &result, true);
+
+    return result;
+}
+
+/// @brief reads and validates a matrix; regular files are mmap-ed and every line is parsed in parallel chunks,
+/// validation happens while parsing; anything else (pipes) is read line by line with getline first
+/// @param file pointer to the file
+/// @result matrix in ELLPACK format
+struct ELLPACK elpk_read_validate(FILE* file) {
+    struct ELLPACK result;
+    struct stat st;
+    off_t start = ftello(file);
+
+    if (start >= 0 && fstat(fileno(file), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > start) {
+        const char* mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+        if (mapping == MAP_FAILED) {
+            abortIfNULL_msg(0, "could not mmap file");
+        }
+
+        const char* lines[4];  // start of the three lines and end of the third line
+        lines[0] = &mapping[start];
+        for (int i = 1; i < 4; i++) {
+            const char* newline = memchr(lines[i - 1], '\n', &mapping[st.st_size] - lines[i - 1]);
+            abortIfNULL_msg((void*)newline, "could not read from file");
+            lines[i] = newline + 1;
+        }
+
+        char header[256];
+        snprintf(header, sizeof(header), "%.*s", (int)(lines[1] - lines[0] < 255 ? lines[1] - lines[0] : 255),
+                 lines[0]);
+        result = helper_parse_matrix(header, lines[1], lines[2] - lines[1] - 1, lines[2], lines[3] - lines[2] - 1);
+
+        // b may follow a in the same file (stdin), continue behind the third line
+        fseeko(file, lines[3] - mapping, SEEK_SET);
+        munmap((void*)mapping, st.st_size);
+        return result;
     }
 
-    abortIfNULL_msg((void*)(getline(&string, &len, file) + 1), "could not read from file");
-    pos = 0;
+    char* lines[3] = {NULL, NULL, NULL};
+    size_t len[3] = {0, 0, 0};
+    ssize_t length[3];
+    for (int i = 0; i < 3; i++) {
+        length[i] = getline(&lines[i], &len[i], file);
+        abortIfNULL_msg((void*)(length[i] + 1), "could not read from file");
+        if (lines[i][length[i] - 1] == '\n') {
+            length[i]--;
+        }
+    }
+    result = helper_parse_matrix(lines[0], lines[1], length[1], lines[2], length[2]);
 
-    result.indices = (uint64_t*)abortIfNULL_msg(malloc(itemsCount * sizeof(uint64_t)), "could not allocate memory");
-    for (long i = 0; i < itemsCount; i++) {
-        char end = i == itemsCount - 1 ? '\n' : ',';
-        result.indices[i] = helper_read_int(string, &pos, end, "indices", 3);
-        pos++;
+    for (int i = 0; i < 3; i++) {
+        free(lines[i]);
     }
+    return result;
+}
 
-    free(string);
+// number of items formatted by one thread at once, and the longest item (",-" + 39 digits + "." + 6 decimals)
+#define WRITE_BLOCK_ITEMS (1ul << 18)
+#define WRITE_MAX_ITEM_CHARS 48
 
-    validate_matrix(result);
+/// @brief helper: formats val exactly like ftostr (snprintf "%.6f" without trailing zeros); |val| * 10^6 is exact
+/// in a double (24 + 14 mantissa bits), so rounding it to an integer (ties to even, like printf) gives the decimals
+/// @param out output buffer, at least WRITE_MAX_ITEM_CHARS chars
+/// @return position behind the written chars
+__attribute__((always_inline)) static inline char* helper_format_float(char* out, float val) {
+    if (!(fabsf(val) < 9e12f)) {  // llrint would overflow, also handles nan and inf
+        char s[256];
+        ftostr(sizeof(s), s, val);
+        size_t len = strlen(s);
+        memcpy(out, s, len);
+        return out + len;
+    }
+    int64_t scaled = llrint((double)val * 1e6);
+    if (scaled < 0) {
+        *out++ = '-';
+        scaled = -scaled;
+    }
+    uint64_t integer = scaled / 1000000;
+    uint64_t decimals = scaled % 1000000;
+    char digits[20];
+    int n = 0;
+    do {
+        digits[n++] = '0' + integer % 10;
+        integer /= 10;
+    } while (integer != 0);
+    while (n > 0) {
+        *out++ = digits[--n];
+    }
+    if (decimals != 0) {
+        *out++ = '.';
+        for (uint64_t div = 100000; decimals != 0; div /= 10) {
+            *out++ = '0' + decimals / div;
+            decimals %= div;
+        }
+    }
+    return out;
+}
 
-    return result;
+/// @brief helper: formats an index like "%lu"
+/// @param out output buffer, at least 20 chars
+/// @return position behind the written chars
+__attribute__((always_inline)) static inline char* helper_format_index(char* out, uint64_t index) {
+    char digits[20];
+    int n = 0;
+    do {
+        digits[n++] = '0' + index % 10;
+        index /= 10;
+    } while (index != 0);
+    while (n > 0) {
+        *out++ = digits[--n];
+    }
+    return out;
+}
+
+/// @brief arguments shared by all threads formatting one round of blocks of a line
+struct WRITE_ARGS {
+    const struct ELLPACK* matrix;
+    bool indices;      // format the indices line instead of the values line
+    uint64_t first;    // first item of this round, thread t formats the t-th block of WRITE_BLOCK_ITEMS items
+    char** buffers;    // one buffer per thread, WRITE_BLOCK_ITEMS * WRITE_MAX_ITEM_CHARS chars
+    size_t* lengths;   // number of chars written into every buffer
+};
+
+/// @brief formats block id of the current round (padding is written as '*', every item but the first gets a ',')
+static void helper_format_block(int id, int n, void* p) {
+    (void)n;
+    const struct WRITE_ARGS* args = (struct WRITE_ARGS*)p;
+    const struct ELLPACK matrix = *args->matrix;
+    uint64_t itemsCount = matrix.noRows * matrix.maxNoNonZero;
+    uint64_t first = args->first + id * WRITE_BLOCK_ITEMS;
+    uint64_t last = first + WRITE_BLOCK_ITEMS < itemsCount ? first + WRITE_BLOCK_ITEMS : itemsCount;
+    char* out = args->buffers[id];
+
+    for (uint64_t index = first; index < last; index++) {
+        if (index != 0) {
+            *out++ = ',';
+        }
+        float val = elpk_value(&matrix, index);
+        if (fabsf(val) < 0.000001) {
+#ifdef DEBUG
+            if (val != 0 && !args->indices) {
+                pdebug(
+                    "elpk_write: detected value not eq 0 but smaller"
+                    " than 0.000001 at index %lu: %.*f\n",
+                    index, 50, val);
+            }
+#endif
+            *out++ = '*';
+        } else if (args->indices) {
+            out = helper_format_index(out, matrix.indices[index]);
+        } else {
+            out = helper_format_float(out, val);
+        }
+    }
+    args->lengths[id] = out - args->buffers[id];
 }
 
-/// @brief writes the matrix to the file
+/// @brief helper: writes all n bytes with write(2), retrying after partial writes
+static void helper_write_all(int fd, const char* buffer, size_t n) {
+    while (n > 0) {
+        ssize_t written = write(fd, buffer, n);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            abortIfNULL_msg(0, "could not write to file");
+        }
+        buffer += written;
+        n -= written;
+    }
+}
+
+/// @brief writes the matrix to the file; every line is formatted in blocks on noThreads threads into preallocated
+/// buffers which are emitted with large write calls, the output is the same as printing every value with ftostr
 /// @param matrix matrix to convert
 /// @param result pointer to file
 void elpk_write(struct ELLPACK matrix, FILE* file) {
-    uint64_t index, i, j;
-    float val, absval;
+    uint64_t itemsCount = matrix.noRows * matrix.maxNoNonZero;
+    int n = noThreads < 1 ? 1 : noThreads;
+    if ((uint64_t)n > (itemsCount + WRITE_BLOCK_ITEMS - 1) / WRITE_BLOCK_ITEMS) {
+        n = itemsCount == 0 ? 1 : (itemsCount + WRITE_BLOCK_ITEMS - 1) / WRITE_BLOCK_ITEMS;
+    }
+    char* buffers[n];
+    size_t lengths[n];
+    for (int t = 0; t < n; t++) {
+        buffers[t] = (char*)abortIfNULL(malloc(WRITE_BLOCK_ITEMS * WRITE_MAX_ITEM_CHARS));
+    }
+    struct WRITE_ARGS args = {.matrix = &matrix, .buffers = buffers, .lengths = lengths};
 
     // first line info
     fprintf(file, "%lu,%lu,%lu\n", matrix.noRows, matrix.noCols, matrix.maxNoNonZero);
+    fflush(file);  // everything else bypasses the FILE buffer
+
+    for (int line = 0; line < 2; line++) {  // values, then indices
+        args.indices = line == 1;
+        for (args.first = 0; args.first < itemsCount; args.first += n * WRITE_BLOCK_ITEMS) {
+            parallel_run(n, helper_format_block, &args);
+            for (int t = 0; t < n; t++) {
+                helper_write_all(fileno(file), buffers[t], lengths[t]);
+            }
+        }
+        helper_write_all(fileno(file), "\n", 1);
+    }
 
-    index = 0;
-    bool first = true;  // just a helper bool to not print ',' at start; not that nice ik but whatever
-    char s[256];        // buffer for storing a single float in nice format
+    for (int t = 0; t < n; t++) {
+        free(buffers[t]);
+    }
+}
 
-    // print values
-    for (j = 0; j < matrix.maxNoNonZero; j++) {
-        for (i = 0; i < matrix.noRows; i++) {
-            val = matrix.values[index];
-            absval = fabsf(val);
+/// @brief checks (without consuming anything) if file starts with the magic number of the binary format
+/// @param file pointer to the file
+/// @return true if the binary format has to be used to read file
+bool elpk_is_bin(FILE* file) {
+    int c = getc(file);
+    ungetc(c, file);
+    return c == (unsigned char)ELPK_BIN_MAGIC[0];
+}
 
-            if (absval < 0.000001) {
-#ifdef DEBUG
-                if (val != 0) {
-                    fputs("\n", stderr);
-                    pdebug(
-                        "elpk_write: detected value not eq 0 but smaller"
-                        " than 0.000001 at index %lu: %.*f\n",
-                        index, 50, matrix.values[index]);
-                }
-#endif
+/// @brief helper: reads exactly n bytes or aborts
+static void helper_read_exactly(void* dest, size_t n, FILE* file) {
+    if (fread(dest, 1, n, file) != n) {
+        fputs("ERROR: unexpected end of binary ELLPACK file\n", stderr);
+        exit(EXIT_FAILURE);
+    }
+}
 
-                if (first) {
-                    fputs("*", file);
-                    first = false;
-                } else {
-                    fputs(",*", file);
-                }
+/// @brief helper: skips bytes until position pos (counted from the start of the file), works on pipes
+static void helper_skip_to(uint64_t* current, uint64_t pos, FILE* file) {
+    for (; *current < pos; (*current)++) {
+        if (getc(file) == EOF) {
+            fputs("ERROR: unexpected end of binary ELLPACK file\n", stderr);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
 
-                index++;
+/// @brief helper: seeks to pos (counted from the start of the file) or aborts
+static void helper_seek(FILE* file, uint64_t pos) {
+    if (fseeko(file, pos, SEEK_SET) != 0) {
+        fputs("ERROR: unexpected end of binary ELLPACK file\n", stderr);
+        exit(EXIT_FAILURE);
+    }
+}
 
+/// @brief helper: reads the indices of matrix stored with width bytes each and converts them to elpk_index_t, indices
+/// that do not address a column are rejected before they are narrowed
+static void helper_read_indices_converted(struct ELLPACK matrix, uint32_t width, FILE* file) {
+    uint64_t itemsCount = matrix.noRows * matrix.maxNoNonZero;
+    unsigned char buffer[1 << 16];
+    for (uint64_t done = 0; done < itemsCount;) {
+        uint64_t count = itemsCount - done < sizeof(buffer) / width ? itemsCount - done : sizeof(buffer) / width;
+        helper_read_exactly(buffer, count * width, file);
+        for (uint64_t i = 0; i < count; i++) {
+            uint64_t index;
+            if (width == 2) {
+                uint16_t v;
+                memcpy(&v, buffer + i * 2, 2);
+                index = v;
+            } else if (width == 4) {
+                uint32_t v;
+                memcpy(&v, buffer + i * 4, 4);
+                index = v;
             } else {
-                ftostr(sizeof(s), s, matrix.values[index++]);
-
-                if (first) {
-                    fprintf(file, "%s", s);
-                    first = false;
-                } else {
-                    fprintf(file, ",%s", s);
-                }
+                memcpy(&index, buffer + i * 8, 8);
+            }
+            if (index >= matrix.noCols) {
+                fprintf(stderr, "ERROR: Index %lu too large for a %lux%lu matrix.\n", index, matrix.noRows,
+                        matrix.noCols);
+                exit(EXIT_FAILURE);
             }
+            matrix.indices[done + i] = index;
+        }
+        done += count;
+    }
+}
+
+/// @brief helper: reads the header of a binary matrix and checks it (plain format: also the array offsets)
+static struct ELPK_BIN_HEADER helper_read_header(FILE* file) {
+    struct ELPK_BIN_HEADER header;
+    helper_read_exactly(&header, sizeof(header), file);
+    if (memcmp(header.magic, ELPK_BIN_MAGIC, sizeof(header.magic)) != 0 ||
+        (header.version != ELPK_BIN_VERSION && header.version != ELPK_BIN_VERSION_BLOCKED)) {
+        fputs("ERROR: not a binary ELLPACK file or unsupported version\n", stderr);
+        exit(EXIT_FAILURE);
+    }
+    if (header.indexWidth != 2 && header.indexWidth != 4 && header.indexWidth != 8) {
+        fprintf(stderr, "ERROR: unsupported index width in binary ELLPACK file: %u bytes\n", header.indexWidth);
+        exit(EXIT_FAILURE);
+    }
+    if (header.valueType > VALUE_FP16) {
+        fprintf(stderr, "ERROR: unsupported value type in binary ELLPACK file: %u\n", header.valueType);
+        exit(EXIT_FAILURE);
+    }
+    helper_check_index_width((struct ELLPACK){.noRows = header.noRows, .noCols = header.noCols});
+    if (header.version == ELPK_BIN_VERSION_BLOCKED) {
+        if (header.valuesOffset < sizeof(header) || header.valuesOffset % ELPK_BIN_ALIGNMENT != 0) {
+            fputs("ERROR: invalid block offset in binary ELLPACK file\n", stderr);
+            exit(EXIT_FAILURE);
         }
+        return header;
     }
 
-    fputs("\n", file);
+    uint64_t itemsCount = header.noRows * header.maxNoNonZero;
+    if (header.maxNoNonZero != 0 && itemsCount / header.maxNoNonZero != header.noRows) {
+        fputs("ERROR: binary ELLPACK file too large\n", stderr);
+        exit(EXIT_FAILURE);
+    }
+    uint64_t valuesEnd = header.valuesOffset + itemsCount * value_bytes(header.valueType);
+    if (header.valuesOffset < sizeof(header) || header.indicesOffset < valuesEnd ||
+        header.valuesOffset % ELPK_BIN_ALIGNMENT != 0 || header.indicesOffset % ELPK_BIN_ALIGNMENT != 0) {
+        fputs("ERROR: invalid array offsets in binary ELLPACK file\n", stderr);
+        exit(EXIT_FAILURE);
+    }
+    return header;
+}
 
-    // reset
-    index = 0;
-    first = true;
+/// @brief helper: allocates itemsCount values of matrix->valueType (values or halfValues)
+/// @return the allocated array
+static void* helper_alloc_values(struct ELLPACK* matrix, uint64_t itemsCount) {
+    if (matrix->valueType == VALUE_FP32) {
+        matrix->values = (float*)abortIfNULL_msg(malloc(itemsCount * sizeof(float)), "could not allocate memory");
+        return matrix->values;
+    }
+    matrix->halfValues =
+        (uint16_t*)abortIfNULL_msg(malloc(itemsCount * sizeof(uint16_t)), "could not allocate memory");
+    return matrix->halfValues;
+}
 
-    // print indices
-    for (j = 0; j < matrix.maxNoNonZero; j++) {
-        for (i = 0; i < matrix.noRows; i++) {
-            val = matrix.values[index];
-            absval = val > 0 ? val : -val;
+/// @brief helper: reads count indices stored with width bytes each into matrix.indices (converted if width differs)
+static void helper_read_indices(struct ELLPACK matrix, uint32_t width, FILE* file) {
+    if (width == sizeof(elpk_index_t)) {
+        helper_read_exactly(matrix.indices, matrix.noRows * matrix.maxNoNonZero * sizeof(elpk_index_t), file);
+    } else {
+        helper_read_indices_converted(matrix, width, file);
+    }
+}
 
-            if (absval < 0.000001) {
-                if (first) {
-                    fputs("*", file);
-                    first = false;
-                } else {
-                    fputs(",*", file);
-                }
+/// @brief helper: joins the blocks of a row-blocked matrix into one matrix padded to the longest row
+static struct ELLPACK helper_read_blocked(struct ELPK_STREAM* stream) {
+    uint64_t noBlocks = 0;
+    uint64_t capacity = 16;
+    struct ELLPACK* blocks = (struct ELLPACK*)abortIfNULL(malloc(capacity * sizeof(struct ELLPACK)));
+    struct ELLPACK result = {.noRows = stream->header.noRows,
+                             .noCols = stream->header.noCols,
+                             .maxNoNonZero = 0,
+                             .valueType = stream->header.valueType};
+    uint64_t firstRow;
 
-            } else if (first) {
-                fprintf(file, "%lu", matrix.indices[index]);
-                first = false;
+    while (elpk_stream_next(stream, 0, &blocks[noBlocks], &firstRow)) {
+        if (blocks[noBlocks].maxNoNonZero > result.maxNoNonZero) {
+            result.maxNoNonZero = blocks[noBlocks].maxNoNonZero;
+        }
+        if (++noBlocks == capacity) {
+            capacity *= 2;
+            blocks = (struct ELLPACK*)abortIfNULL(realloc(blocks, capacity * sizeof(struct ELLPACK)));
+        }
+    }
 
-            } else {
-                fprintf(file, ",%lu", matrix.indices[index]);
+    uint64_t itemsCount = result.noRows * result.maxNoNonZero;
+    const uint64_t valueBytes = value_bytes(result.valueType);
+    char* values = (char*)helper_alloc_values(&result, itemsCount);
+    result.indices =
+        (elpk_index_t*)abortIfNULL_msg(malloc(itemsCount * sizeof(elpk_index_t)), "could not allocate memory");
+    uint64_t row = 0;
+    for (uint64_t b = 0; b < noBlocks; b++) {
+        const struct ELLPACK block = blocks[b];
+        const char* blockValues = block.valueType == VALUE_FP32 ? (char*)block.values : (char*)block.halfValues;
+        for (uint64_t i = 0; i < block.noRows; i++, row++) {
+            // the stored part of the row, then padding (all bits 0 is 0 in every value type)
+            memcpy(&values[row * result.maxNoNonZero * valueBytes], &blockValues[i * block.maxNoNonZero * valueBytes],
+                   block.maxNoNonZero * valueBytes);
+            memset(&values[(row * result.maxNoNonZero + block.maxNoNonZero) * valueBytes], 0,
+                   (result.maxNoNonZero - block.maxNoNonZero) * valueBytes);
+            for (uint64_t j = 0; j < result.maxNoNonZero; j++) {
+                bool stored = j < block.maxNoNonZero;
+                result.indices[row * result.maxNoNonZero + j] = stored ? block.indices[i * block.maxNoNonZero + j] : 0;
             }
+        }
+        elpk_free(block);
+    }
+    free(blocks);
+    return result;
+}
+
+/// @brief reads a matrix in binary format: regular files are mmap-ed (values and indices point into the mapping, no
+/// copy), anything else (pipes, files written with a different INDEX_BITS) is read into allocated memory; the matrix
+/// is validated like a text matrix; matrices in the row-blocked format are read block by block and joined
+/// @param file pointer to the file, positioned at the start of the header
+/// @result matrix in ELLPACK format, free with elpk_free
+struct ELLPACK elpk_read_bin(FILE* file) {
+    // the matrix does not have to start at the beginning of the file (b may follow a on stdin), all offsets of the
+    // header are counted from base
+    off_t base = ftello(file);
+    struct ELPK_BIN_HEADER header = helper_read_header(file);
+    if (header.version == ELPK_BIN_VERSION_BLOCKED) {
+        struct ELPK_STREAM stream = {.file = file, .header = header, .nextRow = 0, .pos = sizeof(header)};
+        return helper_read_blocked(&stream);
+    }
+
+    struct ELLPACK result = {0};
+    result.noRows = header.noRows;
+    result.noCols = header.noCols;
+    result.maxNoNonZero = header.maxNoNonZero;
+    result.valueType = header.valueType;
+    result.storage = ELPK_HEAP;
+    uint64_t itemsCount = header.noRows * header.maxNoNonZero;
+    uint64_t valuesBytes = itemsCount * value_bytes(header.valueType);
+    uint64_t valuesEnd = header.valuesOffset + valuesBytes;
+    uint64_t indicesEnd = header.indicesOffset + itemsCount * header.indexWidth;
+
+    // a matrix behind other data is only mapped if its arrays stay aligned, otherwise it is read like from a pipe
+    struct stat st;
+    if (header.indexWidth == sizeof(elpk_index_t) && base >= 0 && base % ELPK_BIN_ALIGNMENT == 0 &&
+        fstat(fileno(file), &st) == 0 && S_ISREG(st.st_mode)) {
+        if ((uint64_t)st.st_size < base + indicesEnd) {
+            fputs("ERROR: unexpected end of binary ELLPACK file\n", stderr);
+            exit(EXIT_FAILURE);
+        }
+        // mmap needs a page aligned offset, the mapping starts up to a page before base
+        off_t mapStart = base - base % sysconf(_SC_PAGESIZE);
+        uint64_t skip = base - mapStart;
+        // private writable mapping: nothing is written back, kernels may still treat the arrays as ordinary memory
+        void* mapping = mmap(NULL, skip + indicesEnd, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(file), mapStart);
+        if (mapping == MAP_FAILED) {
+            abortIfNULL_msg(0, "could not mmap binary ELLPACK file");
+        }
+        result.storage = ELPK_MAPPED;
+        result.mapping = mapping;
+        result.mappingSize = skip + indicesEnd;
+        if (header.valueType == VALUE_FP32) {
+            result.values = (float*)((char*)mapping + skip + header.valuesOffset);
+        } else {
+            result.halfValues = (uint16_t*)((char*)mapping + skip + header.valuesOffset);
+        }
+        result.indices = (elpk_index_t*)((char*)mapping + skip + header.indicesOffset);
+        // continue behind the matrix
+        helper_seek(file, base + indicesEnd);
+    } else {
+        uint64_t pos = sizeof(header);
+        void* values = helper_alloc_values(&result, itemsCount);
+        result.indices =
+            (elpk_index_t*)abortIfNULL_msg(malloc(itemsCount * sizeof(elpk_index_t)), "could not allocate memory");
+        helper_skip_to(&pos, header.valuesOffset, file);
+        helper_read_exactly(values, valuesBytes, file);
+        pos = valuesEnd;
+        helper_skip_to(&pos, header.indicesOffset, file);
+        helper_read_indices(result, header.indexWidth, file);
+    }
+
+    validate_matrix(result);
+
+    return result;
+}
+
+/// @brief writes the matrix to the file in binary format (header, values, indices; arrays aligned to
+/// ELPK_BIN_ALIGNMENT bytes), file does not need to be seekable
+/// @param matrix matrix to write
+/// @param file pointer to file
+void elpk_write_bin(struct ELLPACK matrix, FILE* file) {
+    static const char zeros[ELPK_BIN_ALIGNMENT] = {0};
+    uint64_t itemsCount = matrix.noRows * matrix.maxNoNonZero;
+    struct ELPK_BIN_HEADER header = {.version = ELPK_BIN_VERSION,
+                                     .indexWidth = sizeof(elpk_index_t),
+                                     .noRows = matrix.noRows,
+                                     .noCols = matrix.noCols,
+                                     .maxNoNonZero = matrix.maxNoNonZero,
+                                     .valuesOffset = sizeof(header),
+                                     .valueType = matrix.valueType,
+                                     .reserved = 0};
+    memcpy(header.magic, ELPK_BIN_MAGIC, sizeof(header.magic));
+    const uint64_t valueBytes = value_bytes(matrix.valueType);
+    uint64_t valuesEnd = header.valuesOffset + itemsCount * valueBytes;
+    header.indicesOffset = (valuesEnd + ELPK_BIN_ALIGNMENT - 1) / ELPK_BIN_ALIGNMENT * ELPK_BIN_ALIGNMENT;
+    const void* values = matrix.valueType == VALUE_FP32 ? (void*)matrix.values : (void*)matrix.halfValues;
+
+    if (fwrite(&header, sizeof(header), 1, file) != 1 ||
+        fwrite(values, valueBytes, itemsCount, file) != itemsCount ||
+        fwrite(zeros, 1, header.indicesOffset - valuesEnd, file) != header.indicesOffset - valuesEnd ||
+        fwrite(matrix.indices, sizeof(elpk_index_t), itemsCount, file) != itemsCount) {
+        abortIfNULL_msg(0, "could not write binary ELLPACK file");
+    }
+    fflush(file);
+}
+
+/// @brief writes the header of the row-blocked binary format, the blocks follow with elpk_write_block
+/// @param noRows number of rows of the whole matrix
+/// @param noCols number of columns of the whole matrix
+/// @param valueType value type of all blocks
+/// @param file pointer to file
+void elpk_write_blocked_header(uint64_t noRows, uint64_t noCols, enum VALUE_TYPE valueType, FILE* file) {
+    struct ELPK_BIN_HEADER header = {.version = ELPK_BIN_VERSION_BLOCKED,
+                                     .indexWidth = sizeof(elpk_index_t),
+                                     .noRows = noRows,
+                                     .noCols = noCols,
+                                     .maxNoNonZero = 0,
+                                     .valuesOffset = sizeof(header),
+                                     .indicesOffset = 0,
+                                     .valueType = valueType,
+                                     .reserved = 0};
+    memcpy(header.magic, ELPK_BIN_MAGIC, sizeof(header.magic));
+    if (fwrite(&header, sizeof(header), 1, file) != 1) {
+        abortIfNULL_msg(0, "could not write binary ELLPACK file");
+    }
+}
+
+/// @brief appends block as rows [firstRow, firstRow + block.noRows) to a file started with elpk_write_blocked_header
+/// (the blocks have to be written in order of their rows and have the value type of the header)
+/// @param block rows to write
+/// @param firstRow row of the whole matrix the block starts with
+/// @param file pointer to file
+void elpk_write_block(struct ELLPACK block, uint64_t firstRow, FILE* file) {
+    static const char zeros[ELPK_BIN_ALIGNMENT] = {0};
+    if (block.noRows == 0) {
+        return;
+    }
+    uint64_t itemsCount = block.noRows * block.maxNoNonZero;
+    const uint64_t valueBytes = value_bytes(block.valueType);
+    uint64_t valuesEnd = sizeof(struct ELPK_BLOCK_HEADER) + itemsCount * valueBytes;
+    struct ELPK_BLOCK_HEADER header = {
+        .firstRow = firstRow, .noRows = block.noRows, .maxNoNonZero = block.maxNoNonZero, .reserved = {0}};
+    header.indicesOffset = (valuesEnd + ELPK_BIN_ALIGNMENT - 1) / ELPK_BIN_ALIGNMENT * ELPK_BIN_ALIGNMENT;
+    uint64_t indicesEnd = header.indicesOffset + itemsCount * sizeof(elpk_index_t);
+    header.size = (indicesEnd + ELPK_BIN_ALIGNMENT - 1) / ELPK_BIN_ALIGNMENT * ELPK_BIN_ALIGNMENT;
+    const void* values = block.valueType == VALUE_FP32 ? (void*)block.values : (void*)block.halfValues;
+
+    if (fwrite(&header, sizeof(header), 1, file) != 1 ||
+        fwrite(values, valueBytes, itemsCount, file) != itemsCount ||
+        fwrite(zeros, 1, header.indicesOffset - valuesEnd, file) != header.indicesOffset - valuesEnd ||
+        fwrite(block.indices, sizeof(elpk_index_t), itemsCount, file) != itemsCount ||
+        fwrite(zeros, 1, header.size - indicesEnd, file) != header.size - indicesEnd) {
+        abortIfNULL_msg(0, "could not write binary ELLPACK file");
+    }
+    fflush(file);
+}
+
+/// @brief writes the matrix to the file in the row-blocked binary format (blocks of about ELPK_BLOCK_BYTES), file does
+/// not need to be seekable
+/// @param matrix matrix to write
+/// @param file pointer to file
+void elpk_write_blocked(struct ELLPACK matrix, FILE* file) {
+    uint64_t rowBytes = matrix.maxNoNonZero * (value_bytes(matrix.valueType) + sizeof(elpk_index_t));
+    uint64_t rowsPerBlock = rowBytes > 0 && ELPK_BLOCK_BYTES / rowBytes > 0 ? ELPK_BLOCK_BYTES / rowBytes : 1;
+    rowsPerBlock = rowBytes == 0 ? matrix.noRows : rowsPerBlock;
+
+    elpk_write_blocked_header(matrix.noRows, matrix.noCols, matrix.valueType, file);
+    for (uint64_t first = 0; first < matrix.noRows; first += rowsPerBlock) {
+        struct ELLPACK block = matrix;
+        block.noRows = matrix.noRows - first < rowsPerBlock ? matrix.noRows - first : rowsPerBlock;
+        if (matrix.valueType == VALUE_FP32) {
+            block.values = &matrix.values[first * matrix.maxNoNonZero];
+        } else {
+            block.halfValues = &matrix.halfValues[first * matrix.maxNoNonZero];
+        }
+        block.indices = &matrix.indices[first * matrix.maxNoNonZero];
+        elpk_write_block(block, first, file);
+    }
+    fflush(file);
+}
+
+/// @brief starts reading a binary matrix block by block: the row-blocked format is read in the order of its stored
+/// blocks (pipes work), the plain binary format in blocks of any size (the file has to be seekable)
+/// @param file pointer to the file, positioned at the start of the header
+/// @return stream, the file stays owned by the caller
+struct ELPK_STREAM elpk_stream_open(FILE* file) {
+    struct ELPK_STREAM stream = {.file = file, .nextRow = 0};
+    off_t base = ftello(file);
+    stream.header = helper_read_header(file);
+    stream.pos = sizeof(stream.header);
+    stream.base = base < 0 ? 0 : base;
+    stream.seekable = base >= 0 && fseeko(file, 0, SEEK_CUR) == 0;
+    if (stream.header.version == ELPK_BIN_VERSION && !stream.seekable) {
+        fputs("ERROR: a binary ELLPACK file can only be read in blocks if it is seekable (or row-blocked)\n", stderr);
+        exit(EXIT_FAILURE);
+    }
+    return stream;
+}
+
+/// @brief helper: reads block->noRows rows of block->maxNoNonZero entries from a seekable stream, the values and
+/// indices of the first row are at the given positions (counted from the start of the matrix)
+static void helper_read_rows_at(const struct ELPK_STREAM* stream, struct ELLPACK* block, uint64_t valuesPos,
+                                uint64_t indicesPos) {
+    uint64_t itemsCount = block->noRows * block->maxNoNonZero;
+    void* values = helper_alloc_values(block, itemsCount);
+    block->indices =
+        (elpk_index_t*)abortIfNULL_msg(malloc(itemsCount * sizeof(elpk_index_t)), "could not allocate memory");
+    helper_seek(stream->file, stream->base + valuesPos);
+    helper_read_exactly(values, itemsCount * value_bytes(block->valueType), stream->file);
+    helper_seek(stream->file, stream->base + indicesPos);
+    helper_read_indices(*block, stream->header.indexWidth, stream->file);
+}
+
+/// @brief helper: reads and checks the header of the next stored block of a row-blocked stream
+static void helper_next_stored_block(struct ELPK_STREAM* stream) {
+    const struct ELPK_BIN_HEADER header = stream->header;
+    struct ELPK_BLOCK_HEADER blockHeader;
+    if (stream->seekable) {
+        helper_seek(stream->file, stream->base + stream->pos);  // the last part may have been read from anywhere
+    }
+    helper_read_exactly(&blockHeader, sizeof(blockHeader), stream->file);
+    uint64_t itemsCount = blockHeader.noRows * blockHeader.maxNoNonZero;
+    if (blockHeader.firstRow != stream->nextRow || blockHeader.noRows == 0 ||
+        blockHeader.noRows > header.noRows - stream->nextRow ||
+        (blockHeader.maxNoNonZero != 0 && itemsCount / blockHeader.maxNoNonZero != blockHeader.noRows) ||
+        blockHeader.indicesOffset < sizeof(blockHeader) + itemsCount * value_bytes(header.valueType) ||
+        blockHeader.indicesOffset % ELPK_BIN_ALIGNMENT != 0 ||
+        blockHeader.size < blockHeader.indicesOffset + itemsCount * header.indexWidth) {
+        fprintf(stderr, "ERROR: invalid block at row %lu of binary ELLPACK file\n", stream->nextRow);
+        exit(EXIT_FAILURE);
+    }
+    stream->stored = blockHeader;
+    stream->storedStart = stream->pos;
+    stream->storedRow = 0;
+    stream->pos += sizeof(blockHeader);
+}
+
+/// @brief helper: reads the current stored block as a whole, the stream is positioned right behind its header
+static struct ELLPACK helper_read_stored_block(struct ELPK_STREAM* stream) {
+    const struct ELPK_BLOCK_HEADER stored = stream->stored;
+    struct ELLPACK block = {.noRows = stored.noRows,
+                            .noCols = stream->header.noCols,
+                            .maxNoNonZero = stored.maxNoNonZero,
+                            .valueType = stream->header.valueType,
+                            .storage = ELPK_HEAP};
+    uint64_t itemsCount = block.noRows * block.maxNoNonZero;
+    uint64_t itemsBytes = itemsCount * value_bytes(block.valueType);
+    void* values = helper_alloc_values(&block, itemsCount);
+    block.indices =
+        (elpk_index_t*)abortIfNULL_msg(malloc(itemsCount * sizeof(elpk_index_t)), "could not allocate memory");
+    helper_read_exactly(values, itemsBytes, stream->file);
+    stream->pos += itemsBytes;
+    helper_skip_to(&stream->pos, stream->storedStart + stored.indicesOffset, stream->file);
+    helper_read_indices(block, stream->header.indexWidth, stream->file);
+    stream->pos += itemsCount * stream->header.indexWidth;
+    helper_skip_to(&stream->pos, stream->storedStart + stored.size, stream->file);
+    return block;
+}
 
-            index++;
+/// @brief helper: copies noRows rows of matrix starting at row first into a new matrix
+static struct ELLPACK helper_copy_rows(const struct ELLPACK matrix, uint64_t first, uint64_t noRows) {
+    struct ELLPACK rows = {.noRows = noRows,
+                           .noCols = matrix.noCols,
+                           .maxNoNonZero = matrix.maxNoNonZero,
+                           .valueType = matrix.valueType,
+                           .storage = ELPK_HEAP};
+    uint64_t itemsCount = noRows * matrix.maxNoNonZero;
+    uint64_t firstItem = first * matrix.maxNoNonZero;
+    uint64_t valueBytes = value_bytes(matrix.valueType);
+    void* values = helper_alloc_values(&rows, itemsCount);
+    const char* matrixValues = matrix.valueType == VALUE_FP32 ? (char*)matrix.values : (char*)matrix.halfValues;
+    memcpy(values, &matrixValues[firstItem * valueBytes], itemsCount * valueBytes);
+    rows.indices =
+        (elpk_index_t*)abortIfNULL_msg(malloc(itemsCount * sizeof(elpk_index_t)), "could not allocate memory");
+    memcpy(rows.indices, &matrix.indices[firstItem], itemsCount * sizeof(elpk_index_t));
+    return rows;
+}
+
+/// @brief maximum number of non-zero entries per row of the rows elpk_stream_next reads next (row-blocked: of the
+/// current stored block, whose header is read if needed)
+/// @param stream stream of elpk_stream_open
+/// @return 0 if all rows were read
+uint64_t elpk_stream_row_length(struct ELPK_STREAM* stream) {
+    if (stream->nextRow >= stream->header.noRows) {
+        return 0;
+    }
+    if (stream->header.version != ELPK_BIN_VERSION_BLOCKED) {
+        return stream->header.maxNoNonZero;
+    }
+    if (stream->storedRow == stream->stored.noRows) {
+        helper_next_stored_block(stream);
+    }
+    return stream->stored.maxNoNonZero;
+}
+
+/// @brief reads the next block of rows and validates it; block.noCols is the number of columns of the whole matrix
+/// @param stream stream of elpk_stream_open
+/// @param maxRows maximum number of rows (row-blocked format: stored blocks are split, 0 returns the stored blocks)
+/// @param block output: next rows, free with elpk_free
+/// @param firstRow output: row of the whole matrix the block starts with
+/// @return false if all rows were read
+bool elpk_stream_next(struct ELPK_STREAM* stream, uint64_t maxRows, struct ELLPACK* block, uint64_t* firstRow) {
+    const struct ELPK_BIN_HEADER header = stream->header;
+    if (stream->nextRow >= header.noRows) {
+        return false;
+    }
+    *block = (struct ELLPACK){.noCols = header.noCols, .valueType = header.valueType, .storage = ELPK_HEAP};
+    const uint64_t valueBytes = value_bytes(header.valueType);
+    *firstRow = stream->nextRow;
+
+    if (header.version == ELPK_BIN_VERSION_BLOCKED) {
+        if (stream->storedRow == stream->stored.noRows) {
+            helper_next_stored_block(stream);
+        }
+        const struct ELPK_BLOCK_HEADER stored = stream->stored;
+        uint64_t rows = stored.noRows - stream->storedRow;
+        rows = maxRows != 0 && maxRows < rows ? maxRows : rows;
+        if (rows == stored.noRows) {
+            *block = helper_read_stored_block(stream);
+        } else if (stream->seekable) {
+            // the rows of a stored block are contiguous in its values and in its indices
+            block->noRows = rows;
+            block->maxNoNonZero = stored.maxNoNonZero;
+            uint64_t firstItem = stream->storedRow * stored.maxNoNonZero;
+            helper_read_rows_at(stream, block, stream->storedStart + sizeof(stored) + firstItem * valueBytes,
+                                stream->storedStart + stored.indicesOffset + firstItem * header.indexWidth);
+        } else {
+            // a pipe cannot go back from the values to the indices: the stored block is read whole and split
+            if (stream->storedRow == 0) {
+                stream->pending = helper_read_stored_block(stream);
+            }
+            *block = helper_copy_rows(stream->pending, stream->storedRow, rows);
         }
+        stream->storedRow += rows;
+        if (stream->storedRow == stored.noRows) {
+            stream->pos = stream->storedStart + stored.size;
+            elpk_free(stream->pending);
+            stream->pending = (struct ELLPACK){0};
+        }
+        stream->nextRow += rows;
+        validate_matrix(*block);
+        return true;
+    }
+
+    // plain binary format: the rows of the block are contiguous in both arrays
+    maxRows = maxRows < 1 ? 1 : maxRows;
+    block->noRows = header.noRows - stream->nextRow < maxRows ? header.noRows - stream->nextRow : maxRows;
+    block->maxNoNonZero = header.maxNoNonZero;
+    uint64_t firstItem = stream->nextRow * header.maxNoNonZero;
+    helper_read_rows_at(stream, block, header.valuesOffset + firstItem * valueBytes,
+                        header.indicesOffset + firstItem * header.indexWidth);
+    stream->nextRow += block->noRows;
+    validate_matrix(*block);
+    return true;
+}
+
+/// @brief reads a dense matrix in text format: the first line is "noRows,noCols", then every row follows on its own
+/// line as noCols comma separated values (a batch of vectors is stored as one vector per row)
+/// @param file pointer to the file
+/// @result dense matrix, free values with free
+struct DENSE_MATRIX dense_read(FILE* file) {
+    struct DENSE_MATRIX result;
+    char* line = NULL;
+    size_t size = 0;
+    if (getline(&line, &size, file) < 0) {
+        fputs("ERROR: missing header of dense matrix\n", stderr);
+        exit(EXIT_FAILURE);
     }
+    long pos = 0;
+    result.noRows = helper_read_int(line, &pos, ',', "noRows", 1);
+    pos++;
+    result.noCols = helper_read_int(line, &pos, '\n', "noCols", 1);
+    result.values = (float*)abortIfNULL_msg(malloc(result.noRows * result.noCols * sizeof(float) + 1),
+                                            "could not allocate memory");
 
-    fputs("\n", file);
+    for (uint64_t i = 0; i < result.noRows; i++) {
+        ssize_t length = getline(&line, &size, file);
+        if (length < 0) {
+            fprintf(stderr, "ERROR: dense matrix has %lu instead of %lu rows\n", i, result.noRows);
+            exit(EXIT_FAILURE);
+        }
+        if (length > 0 && line[length - 1] == '\n') {
+            line[length - 1] = '\0';
+        }
+        pos = 0;
+        for (uint64_t j = 0; j < result.noCols; j++) {
+            result.values[i * result.noCols + j] =
+                helper_read_float(line, &pos, j + 1 < result.noCols ? ',' : '\0', "dense values");
+            pos++;
+        }
+    }
+    free(line);
+    return result;
+}
 
-    fseek(file, 0, SEEK_SET);
+/// @brief writes a dense matrix in the text format of dense_read, values are formatted like elpk_write
+/// @param matrix matrix to write
+/// @param file pointer to file
+void dense_write(struct DENSE_MATRIX matrix, FILE* file) {
+    char* buffer = (char*)abortIfNULL(malloc(matrix.noCols * WRITE_MAX_ITEM_CHARS + 1));
+    fprintf(file, "%lu,%lu\n", matrix.noRows, matrix.noCols);
+    for (uint64_t i = 0; i < matrix.noRows; i++) {
+        char* out = buffer;
+        for (uint64_t j = 0; j < matrix.noCols; j++) {
+            if (j != 0) {
+                *out++ = ',';
+            }
+            out = helper_format_float(out, matrix.values[i * matrix.noCols + j]);
+        }
+        *out++ = '\n';
+        fwrite(buffer, 1, out - buffer, file);
+    }
+    free(buffer);
 }
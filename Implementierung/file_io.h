@@ -1,12 +1,59 @@
 #ifndef GUARD_FILE_IO
 #define GUARD_FILE_IO
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 
 #include "ellpack.h"
 
-void validate_matrix(const struct ELLPACK matrix);
+// binary format: little endian, native float (or bf16/fp16, see valueType) and index arrays
+#define ELPK_BIN_MAGIC "\x89" "ELLPACK"
+#define ELPK_BIN_VERSION 1
+#define ELPK_BIN_ALIGNMENT 64
+
+// row-blocked binary format: the header is followed by blocks of consecutive rows, every block has its own maxNoNonZero
+// and holds its values and then its indices, so a matrix can be written and read one block at a time
+#define ELPK_BIN_VERSION_BLOCKED 2
+// size of the blocks written by elpk_write_blocked
+#define ELPK_BLOCK_BYTES (64 << 20)
+
+struct ELPK_BIN_HEADER {
+    char magic[8];  // ELPK_BIN_MAGIC without terminating 0, first byte is no digit to tell it apart from text
+    uint32_t version;
+    uint32_t indexWidth;  // bytes per index
+    uint64_t noRows;
+    uint64_t noCols;
+    uint64_t maxNoNonZero;   // blocked: 0, every block has its own
+    uint64_t valuesOffset;   // from start of file, multiple of ELPK_BIN_ALIGNMENT; blocked: offset of the first block
+    uint64_t indicesOffset;  // from start of file, multiple of ELPK_BIN_ALIGNMENT; blocked: 0
+    uint32_t valueType;      // enum VALUE_TYPE of the values (and of the values of every block), 0 is fp32
+    uint32_t reserved;
+};
+
+/// @brief header of a block of the row-blocked binary format, the values follow directly
+struct ELPK_BLOCK_HEADER {
+    uint64_t firstRow;
+    uint64_t noRows;
+    uint64_t maxNoNonZero;
+    uint64_t indicesOffset;  // from start of the block, multiple of ELPK_BIN_ALIGNMENT
+    uint64_t size;           // bytes of the block including this header, multiple of ELPK_BIN_ALIGNMENT
+    uint64_t reserved[3];
+};
+
+/// @brief reader for a binary matrix that hands out blocks of rows (elpk_stream_open, elpk_stream_next)
+struct ELPK_STREAM {
+    FILE* file;
+    struct ELPK_BIN_HEADER header;
+    uint64_t nextRow;  // first row of the next block
+    uint64_t pos;      // bytes consumed from the start of the matrix (pipes cannot tell)
+    uint64_t base;     // position of the header in the file, the offsets are counted from it (seekable files)
+    bool seekable;     // row-blocked: parts of a stored block are read with seeks, else the stored block is read whole
+    struct ELPK_BLOCK_HEADER stored;  // row-blocked: header of the current stored block
+    uint64_t storedStart;             // row-blocked: position of the current stored block from the start of the matrix
+    uint64_t storedRow;               // row-blocked: rows of the current stored block handed out so far
+    struct ELLPACK pending;           // row-blocked, not seekable: the stored block while it is handed out in parts
+};
 
 /// @brief helper: read int from string
 /// @param string string
@@ -28,14 +75,85 @@ float helper_read_float(const char* string, long* pos, char end, char* field_for
 /// @param matrix matrix to check
 void validate_matrix(const struct ELLPACK matrix);
 
-/// @brief reads and validates a matrix
+/// @brief reads and validates a matrix; regular files are mmap-ed and every line is parsed in parallel chunks,
+/// validation happens while parsing; anything else (pipes) is read line by line with getline first
 /// @param file pointer to the file
 /// @result matrix in ELLPACK format
 struct ELLPACK elpk_read_validate(FILE* file);
 
-/// @brief writes the matrix to the file
+/// @brief writes the matrix to the file; every line is formatted in blocks on noThreads threads into preallocated
+/// buffers which are emitted with large write calls, the output is the same as printing every value with ftostr
 /// @param matrix matrix to convert
 /// @param result pointer to file
 void elpk_write(struct ELLPACK matrix, FILE* file);
 
+/// @brief checks (without consuming anything) if file starts with the magic number of the binary format
+/// @param file pointer to the file
+/// @return true if the binary format has to be used to read file
+bool elpk_is_bin(FILE* file);
+
+/// @brief reads a matrix in binary format: regular files are mmap-ed (values and indices point into the mapping, no
+/// copy), anything else (pipes) is read into allocated memory; the matrix is validated like a text matrix; matrices in
+/// the row-blocked format are read block by block and joined
+/// @param file pointer to the file, positioned at the start of the header
+/// @result matrix in ELLPACK format, free with elpk_free
+struct ELLPACK elpk_read_bin(FILE* file);
+
+/// @brief writes the matrix to the file in binary format (header, values, indices; arrays aligned to
+/// ELPK_BIN_ALIGNMENT bytes), file does not need to be seekable
+/// @param matrix matrix to write
+/// @param file pointer to file
+void elpk_write_bin(struct ELLPACK matrix, FILE* file);
+
+/// @brief writes the matrix to the file in the row-blocked binary format (blocks of about ELPK_BLOCK_BYTES), file does
+/// not need to be seekable
+/// @param matrix matrix to write
+/// @param file pointer to file
+void elpk_write_blocked(struct ELLPACK matrix, FILE* file);
+
+/// @brief writes the header of the row-blocked binary format, the blocks follow with elpk_write_block
+/// @param noRows number of rows of the whole matrix
+/// @param noCols number of columns of the whole matrix
+/// @param valueType value type of all blocks
+/// @param file pointer to file
+void elpk_write_blocked_header(uint64_t noRows, uint64_t noCols, enum VALUE_TYPE valueType, FILE* file);
+
+/// @brief appends block as rows [firstRow, firstRow + block.noRows) to a file started with elpk_write_blocked_header
+/// (the blocks have to be written in order of their rows and have the value type of the header)
+/// @param block rows to write
+/// @param firstRow row of the whole matrix the block starts with
+/// @param file pointer to file
+void elpk_write_block(struct ELLPACK block, uint64_t firstRow, FILE* file);
+
+/// @brief starts reading a binary matrix block by block: the row-blocked format is read in the order of its stored
+/// blocks (pipes work), the plain binary format in blocks of any size (the file has to be seekable)
+/// @param file pointer to the file, positioned at the start of the header
+/// @return stream, the file stays owned by the caller
+struct ELPK_STREAM elpk_stream_open(FILE* file);
+
+/// @brief maximum number of non-zero entries per row of the rows elpk_stream_next reads next (row-blocked: of the
+/// current stored block, whose header is read if needed)
+/// @param stream stream of elpk_stream_open
+/// @return 0 if all rows were read
+uint64_t elpk_stream_row_length(struct ELPK_STREAM* stream);
+
+/// @brief reads the next block of rows and validates it; block.noCols is the number of columns of the whole matrix
+/// @param stream stream of elpk_stream_open
+/// @param maxRows maximum number of rows (row-blocked format: stored blocks are split, 0 returns the stored blocks)
+/// @param block output: next rows, free with elpk_free
+/// @param firstRow output: row of the whole matrix the block starts with
+/// @return false if all rows were read
+bool elpk_stream_next(struct ELPK_STREAM* stream, uint64_t maxRows, struct ELLPACK* block, uint64_t* firstRow);
+
+/// @brief reads a dense matrix in text format: the first line is "noRows,noCols", then every row follows on its own
+/// line as noCols comma separated values (a batch of vectors is stored as one vector per row)
+/// @param file pointer to the file
+/// @result dense matrix, free values with free
+struct DENSE_MATRIX dense_read(FILE* file);
+
+/// @brief writes a dense matrix in the text format of dense_read, values are formatted like elpk_write
+/// @param matrix matrix to write
+/// @param file pointer to file
+void dense_write(struct DENSE_MATRIX matrix, FILE* file);
+
 #endif
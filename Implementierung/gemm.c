@@ -0,0 +1,271 @@
+#include "gemm.h"
+
+#include <immintrin.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ellpack.h"
+#include "parallel.h"
+#include "simd.h"
+#include "util.h"
+#include "workspace.h"
+
+/// @brief 4 x 8 microkernel with 128 bit lanes: 8 accumulators, every entry of a is broadcast once per k
+static void helper_kernel_sse41(uint64_t kc, const float* a, const float* b, float* c, uint64_t ldc) {
+    __m128 acc[4][2];
+#pragma GCC unroll 4
+    for (int r = 0; r < 4; r++) {
+        acc[r][0] = _mm_loadu_ps(c + r * ldc);
+        acc[r][1] = _mm_loadu_ps(c + r * ldc + 4);
+    }
+    for (uint64_t k = 0; k < kc; k++) {
+        __m128 b0 = _mm_load_ps(b + k * 8);
+        __m128 b1 = _mm_load_ps(b + k * 8 + 4);
+#pragma GCC unroll 4
+        for (int r = 0; r < 4; r++) {
+            __m128 ar = _mm_set1_ps(a[k * 4 + r]);
+            acc[r][0] = _mm_add_ps(acc[r][0], _mm_mul_ps(ar, b0));
+            acc[r][1] = _mm_add_ps(acc[r][1], _mm_mul_ps(ar, b1));
+        }
+    }
+#pragma GCC unroll 4
+    for (int r = 0; r < 4; r++) {
+        _mm_storeu_ps(c + r * ldc, acc[r][0]);
+        _mm_storeu_ps(c + r * ldc + 4, acc[r][1]);
+    }
+}
+
+/// @brief 6 x 16 microkernel with 256 bit lanes and fused multiply-add: 12 accumulators
+__attribute__((target("avx2,fma"))) static void helper_kernel_avx2(uint64_t kc, const float* a, const float* b,
+                                                                   float* c, uint64_t ldc) {
+    __m256 acc[6][2];
+#pragma GCC unroll 6
+    for (int r = 0; r < 6; r++) {
+        acc[r][0] = _mm256_loadu_ps(c + r * ldc);
+        acc[r][1] = _mm256_loadu_ps(c + r * ldc + 8);
+    }
+    for (uint64_t k = 0; k < kc; k++) {
+        __m256 b0 = _mm256_load_ps(b + k * 16);
+        __m256 b1 = _mm256_load_ps(b + k * 16 + 8);
+#pragma GCC unroll 6
+        for (int r = 0; r < 6; r++) {
+            __m256 ar = _mm256_broadcast_ss(a + k * 6 + r);
+            acc[r][0] = _mm256_fmadd_ps(ar, b0, acc[r][0]);
+            acc[r][1] = _mm256_fmadd_ps(ar, b1, acc[r][1]);
+        }
+    }
+#pragma GCC unroll 6
+    for (int r = 0; r < 6; r++) {
+        _mm256_storeu_ps(c + r * ldc, acc[r][0]);
+        _mm256_storeu_ps(c + r * ldc + 8, acc[r][1]);
+    }
+}
+
+/// @brief 8 x 32 microkernel with 512 bit lanes: 16 accumulators
+__attribute__((target("avx512f"))) static void helper_kernel_avx512(uint64_t kc, const float* a, const float* b,
+                                                                    float* c, uint64_t ldc) {
+    __m512 acc[8][2];
+#pragma GCC unroll 8
+    for (int r = 0; r < 8; r++) {
+        acc[r][0] = _mm512_loadu_ps(c + r * ldc);
+        acc[r][1] = _mm512_loadu_ps(c + r * ldc + 16);
+    }
+    for (uint64_t k = 0; k < kc; k++) {
+        __m512 b0 = _mm512_load_ps(b + k * 32);
+        __m512 b1 = _mm512_load_ps(b + k * 32 + 16);
+#pragma GCC unroll 8
+        for (int r = 0; r < 8; r++) {
+            __m512 ar = _mm512_set1_ps(a[k * 8 + r]);
+            acc[r][0] = _mm512_fmadd_ps(ar, b0, acc[r][0]);
+            acc[r][1] = _mm512_fmadd_ps(ar, b1, acc[r][1]);
+        }
+    }
+#pragma GCC unroll 8
+    for (int r = 0; r < 8; r++) {
+        _mm512_storeu_ps(c + r * ldc, acc[r][0]);
+        _mm512_storeu_ps(c + r * ldc + 16, acc[r][1]);
+    }
+}
+
+/// @brief returns the microkernel for simdLevel
+struct GEMM_KERNEL gemm_kernel(void) {
+    switch (simdLevel) {
+        case SIMD_AVX512:
+            return (struct GEMM_KERNEL){.mr = 8, .nr = 32, .func = helper_kernel_avx512};
+        case SIMD_AVX2:
+            return (struct GEMM_KERNEL){.mr = 6, .nr = 16, .func = helper_kernel_avx2};
+        default:
+            return (struct GEMM_KERNEL){.mr = 4, .nr = 8, .func = helper_kernel_sse41};
+    }
+}
+
+/// @brief helper: allocates 64 byte aligned panels for count rows or columns of the given depth (not zeroed)
+static struct PACKED_MATRIX helper_packed_alloc(uint64_t count, uint64_t depth, uint64_t width) {
+    struct PACKED_MATRIX packed;
+    packed.noPanels = (count + width - 1) / width;
+    packed.width = width;
+    packed.depth = depth;
+    uint64_t size = (packed.noPanels * depth * width * sizeof(float) + 63) / 64 * 64;
+    packed.values = (float*)scratch_alloc(size);
+    return packed;
+}
+
+/// @brief arguments shared by all threads packing one matrix
+struct PACK_ARGS {
+    const struct ELLPACK* matrix;
+    struct PACKED_MATRIX* packed;
+};
+
+/// @brief zeroes the panels of one thread and scatters the rows of matrix they contain
+static void helper_pack_rows(int id, int n, void* p) {
+    const struct PACK_ARGS* args = (struct PACK_ARGS*)p;
+    const struct ELLPACK matrix = *args->matrix;
+    const struct PACKED_MATRIX packed = *args->packed;
+    const uint64_t width = packed.width;
+    uint64_t firstPanel = packed.noPanels * id / n;
+    uint64_t lastPanel = packed.noPanels * (id + 1) / n;
+
+    memset(&packed.values[firstPanel * packed.depth * width], 0,
+           (lastPanel - firstPanel) * packed.depth * width * sizeof(float));
+    for (uint64_t i = firstPanel * width; i < lastPanel * width && i < matrix.noRows; i++) {
+        float* panel = &packed.values[i / width * packed.depth * width + i % width];
+        for (uint64_t j = i * matrix.maxNoNonZero; j < (i + 1) * matrix.maxNoNonZero; j++) {
+            panel[matrix.indices[j] * width] += matrix.values[j];  // padding adds 0 to column 0
+        }
+    }
+}
+
+/// @brief zeroes the panels of one thread and scatters the entries of matrix whose columns they contain; every
+/// thread reads all rows but only writes its own panels
+static void helper_pack_cols(int id, int n, void* p) {
+    const struct PACK_ARGS* args = (struct PACK_ARGS*)p;
+    const struct ELLPACK matrix = *args->matrix;
+    const struct PACKED_MATRIX packed = *args->packed;
+    const uint64_t width = packed.width;
+    uint64_t firstPanel = packed.noPanels * id / n;
+    uint64_t lastPanel = packed.noPanels * (id + 1) / n;
+    uint64_t firstCol = firstPanel * width;
+    uint64_t lastCol = lastPanel * width;
+
+    memset(&packed.values[firstPanel * packed.depth * width], 0,
+           (lastPanel - firstPanel) * packed.depth * width * sizeof(float));
+    for (uint64_t k = 0; k < matrix.noRows; k++) {
+        for (uint64_t j = k * matrix.maxNoNonZero; j < (k + 1) * matrix.maxNoNonZero; j++) {
+            uint64_t col = matrix.indices[j];
+            if (col >= firstCol && col < lastCol) {
+                packed.values[(col / width * packed.depth + k) * width + col % width] += matrix.values[j];
+            }
+        }
+    }
+}
+
+/// @brief helper: number of threads for packing noPanels panels
+static int helper_pack_threads(uint64_t noPanels) {
+    int n = noThreads < 1 ? 1 : noThreads;
+    if ((uint64_t)n > noPanels) {
+        n = noPanels < 1 ? 1 : noPanels;
+    }
+    return n;
+}
+
+/// @brief scatters the entries of an ELLPACK matrix straight into zeroed panels of width rows (left operand), on
+/// noThreads threads
+struct PACKED_MATRIX pack_rows(const struct ELLPACK matrix, uint64_t width) {
+    struct PACKED_MATRIX packed = helper_packed_alloc(matrix.noRows, matrix.noCols, width);
+    struct PACK_ARGS args = {.matrix = &matrix, .packed = &packed};
+    parallel_run(helper_pack_threads(packed.noPanels), helper_pack_rows, &args);
+    return packed;
+}
+
+/// @brief scatters the entries of an ELLPACK matrix straight into zeroed panels of width columns (right operand), on
+/// noThreads threads; the row-major entries land in the transposed (column panel) order without a transposed copy
+struct PACKED_MATRIX pack_cols(const struct ELLPACK matrix, uint64_t width) {
+    struct PACKED_MATRIX packed = helper_packed_alloc(matrix.noCols, matrix.noRows, width);
+    struct PACK_ARGS args = {.matrix = &matrix, .packed = &packed};
+    parallel_run(helper_pack_threads(packed.noPanels), helper_pack_cols, &args);
+    return packed;
+}
+
+/// @brief convenience/wrapper function to free PACKED_MATRIX struct
+void packed_free(struct PACKED_MATRIX matrix) { scratch_free(matrix.values); }
+
+/// @brief arguments shared by all threads of gemm_ellpack
+struct GEMM_ARGS {
+    const struct PACKED_MATRIX* left;
+    const struct PACKED_MATRIX* right;
+    const struct GEMM_KERNEL* kernel;
+    struct ELLPACK* result;
+};
+
+/// @brief computes the row blocks of one thread: for every block of GEMM_NC columns the tile is accumulated over
+/// all blocks of GEMM_KC and then its non-zero entries are appended to the result rows
+static void helper_gemm_blocks(int id, int n, void* p) {
+    const struct GEMM_ARGS* args = (struct GEMM_ARGS*)p;
+    const struct PACKED_MATRIX left = *args->left;
+    const struct PACKED_MATRIX right = *args->right;
+    const struct GEMM_KERNEL kernel = *args->kernel;
+    const struct ELLPACK result = *args->result;
+    const uint64_t depth = left.depth;
+    uint64_t noBlocks = (result.noRows + GEMM_MC - 1) / GEMM_MC;
+
+    float* tile = (float*)scratch_alloc(GEMM_MC * GEMM_NC * sizeof(float));
+    uint64_t rowPos[GEMM_MC];  // next position to insert a value into every row of the block
+
+    for (uint64_t block = noBlocks * id / n; block < noBlocks * (id + 1) / n; block++) {
+        uint64_t ic = block * GEMM_MC;
+        uint64_t mc = result.noRows - ic < GEMM_MC ? result.noRows - ic : GEMM_MC;
+        for (uint64_t i = 0; i < mc; i++) {
+            rowPos[i] = (ic + i) * result.maxNoNonZero;
+        }
+        for (uint64_t jc = 0; jc < result.noCols; jc += GEMM_NC) {
+            uint64_t nc = result.noCols - jc < GEMM_NC ? result.noCols - jc : GEMM_NC;
+            memset(tile, 0, GEMM_MC * GEMM_NC * sizeof(float));
+            for (uint64_t pc = 0; pc < depth; pc += GEMM_KC) {
+                uint64_t kc = depth - pc < GEMM_KC ? depth - pc : GEMM_KC;
+                for (uint64_t jr = 0; jr < nc; jr += kernel.nr) {
+                    const float* b = &right.values[((jc + jr) / kernel.nr * depth + pc) * kernel.nr];
+                    for (uint64_t ir = 0; ir < mc; ir += kernel.mr) {
+                        const float* a = &left.values[((ic + ir) / kernel.mr * depth + pc) * kernel.mr];
+                        kernel.func(kc, a, b, &tile[ir * GEMM_NC + jr], GEMM_NC);
+                    }
+                }
+            }
+            // append the non-zero entries of the tile, the column blocks are processed in ascending order
+            for (uint64_t i = 0; i < mc; i++) {
+                for (uint64_t j = 0; j < nc; j++) {
+                    float value = tile[i * GEMM_NC + j];
+                    if (value != 0.f) {
+                        result.indices[rowPos[i]] = jc + j;
+                        result.values[rowPos[i]++] = value;
+                    }
+                }
+            }
+        }
+        // add padding
+        for (uint64_t i = 0; i < mc; i++) {
+            for (; rowPos[i] < (ic + i + 1) * result.maxNoNonZero; rowPos[i]++) {
+                result.values[rowPos[i]] = 0.f;
+                result.indices[rowPos[i]] = 0;
+            }
+        }
+    }
+    scratch_free(tile);
+}
+
+/// @brief multiplies two packed operands on noThreads threads (every thread owns blocks of GEMM_MC rows) and writes
+/// the non-zero entries of the product into result, the rows are padded to result.maxNoNonZero
+/// @param left left operand packed with pack_rows(..., kernel.mr)
+/// @param right right operand packed with pack_cols(..., kernel.nr)
+/// @param kernel microkernel
+/// @param result result matrix, allocated with maxNoNonZero of at least the number of non-zero entries of every row
+void gemm_ellpack(const struct PACKED_MATRIX left, const struct PACKED_MATRIX right, const struct GEMM_KERNEL kernel,
+                  struct ELLPACK result) {
+    int n = noThreads < 1 ? 1 : noThreads;
+    uint64_t noBlocks = (result.noRows + GEMM_MC - 1) / GEMM_MC;
+    if ((uint64_t)n > noBlocks) {
+        n = noBlocks < 1 ? 1 : noBlocks;
+    }
+    struct GEMM_ARGS args = {.left = &left, .right = &right, .kernel = &kernel, .result = &result};
+    parallel_run(n, helper_gemm_blocks, &args);
+}
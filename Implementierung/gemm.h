@@ -0,0 +1,54 @@
+#ifndef GUARD_GEMM
+#define GUARD_GEMM
+
+#include <stdint.h>
+
+#include "ellpack.h"
+
+// cache blocking: a KC x NR sliver of right stays in L1, an MC x KC block of left in L2 and a KC x NC block of right
+// in L3; MC and NC are multiples of every MR and NR below
+#define GEMM_KC 256
+#define GEMM_MC 120
+#define GEMM_NC 2048
+
+/// @brief operand packed into panels for the microkernels: panel p holds the rows (left operand) or the columns
+/// (right operand) [p * width, (p + 1) * width) k-major, element r of the panel at depth k is at
+/// values[(p * depth + k) * width + r]; rows or columns beyond the matrix are 0
+struct PACKED_MATRIX {
+    uint64_t noPanels;
+    uint64_t width;  // MR or NR
+    uint64_t depth;  // number of columns of the left / rows of the right operand
+    float* values;   // 64 byte aligned
+};
+
+/// @brief register-blocked microkernel for one instruction set level: c[MR x NR] += a[kc x MR]^T * b[kc x NR]
+struct GEMM_KERNEL {
+    uint64_t mr;
+    uint64_t nr;
+    void (*func)(uint64_t kc, const float* a, const float* b, float* c, uint64_t ldc);
+};
+
+/// @brief returns the microkernel for simdLevel
+struct GEMM_KERNEL gemm_kernel(void);
+
+/// @brief scatters the entries of an ELLPACK matrix straight into zeroed panels of width rows (left operand), on
+/// noThreads threads
+struct PACKED_MATRIX pack_rows(const struct ELLPACK matrix, uint64_t width);
+
+/// @brief scatters the entries of an ELLPACK matrix straight into zeroed panels of width columns (right operand), on
+/// noThreads threads; the row-major entries land in the transposed (column panel) order without a transposed copy
+struct PACKED_MATRIX pack_cols(const struct ELLPACK matrix, uint64_t width);
+
+/// @brief convenience/wrapper function to free PACKED_MATRIX struct
+void packed_free(struct PACKED_MATRIX matrix);
+
+/// @brief multiplies two packed operands on noThreads threads (every thread owns blocks of GEMM_MC rows) and writes
+/// the non-zero entries of the product into result, the rows are padded to result.maxNoNonZero
+/// @param left left operand packed with pack_rows(..., kernel.mr)
+/// @param right right operand packed with pack_cols(..., kernel.nr)
+/// @param kernel microkernel
+/// @param result result matrix, allocated with maxNoNonZero of at least the number of non-zero entries of every row
+void gemm_ellpack(const struct PACKED_MATRIX left, const struct PACKED_MATRIX right, const struct GEMM_KERNEL kernel,
+                  struct ELLPACK result);
+
+#endif
@@ -0,0 +1,147 @@
+#include "half.h"
+
+#include <immintrin.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "simd.h"
+
+static const char* valueTypeNames[] = {[VALUE_FP32] = "fp32", [VALUE_BF16] = "bf16", [VALUE_FP16] = "fp16"};
+
+/// @brief parses a type name ("fp32", "bf16", "fp16"), returns -1 for unknown names
+int parse_value_type(const char* name) {
+    for (int type = VALUE_FP32; type <= VALUE_FP16; type++) {
+        if (strcmp(name, valueTypeNames[type]) == 0) {
+            return type;
+        }
+    }
+    return -1;
+}
+
+/// @brief returns the name of a type
+const char* value_type_name(enum VALUE_TYPE type) { return valueTypeNames[type]; }
+
+/// @brief narrows one float to a 16 bit value of type VALUE_BF16 or VALUE_FP16 (round to nearest even, too large
+/// values become infinity)
+uint16_t float_to_half(enum VALUE_TYPE type, float f) {
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    const uint32_t abs = bits & 0x7fffffffu;
+    if (type == VALUE_BF16) {
+        if (abs > 0x7f800000u) {
+            return (uint16_t)(bits >> 16 | 0x40u);  // keep NaN a (quiet) NaN
+        }
+        return (uint16_t)((bits + 0x7fffu + (bits >> 16 & 1u)) >> 16);
+    }
+
+    const uint16_t sign = (uint16_t)(bits >> 16 & 0x8000u);
+    if (abs >= 0x7f800000u) {
+        return sign | 0x7c00u | (abs > 0x7f800000u ? 0x200u : 0u);  // infinity or NaN
+    }
+    if (abs >= 0x477ff000u) {
+        return sign | 0x7c00u;  // at least 65520 rounds to infinity
+    }
+    if (abs < 0x38800000u) {
+        // below 2^-14: subnormal, the mantissa is the value in units of 2^-24 (rounding may give the smallest normal)
+        float a;
+        memcpy(&a, &abs, sizeof(a));
+        return sign | (uint16_t)nearbyintf(a * 0x1p24f);
+    }
+    uint32_t h = ((abs >> 23) - (127u - 15u)) << 10 | (abs & 0x7fffffu) >> 13;
+    const uint32_t rest = abs & 0x1fffu;
+    if (rest > 0x1000u || (rest == 0x1000u && (h & 1u))) {
+        h++;  // a carry into the exponent is still the correctly rounded value
+    }
+    return sign | (uint16_t)h;
+}
+
+/// @brief 4 lanes, fp16 has no conversion instruction before F16C and is widened one value at a time
+static void helper_widen_sse41(enum VALUE_TYPE type, const uint16_t* in, float* out, uint64_t n) {
+    uint64_t k = 0;
+    if (type == VALUE_BF16) {
+        for (; k + 4 <= n; k += 4) {
+            __m128i h = _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*)&in[k]));
+            _mm_storeu_ps(&out[k], _mm_castsi128_ps(_mm_slli_epi32(h, 16)));
+        }
+    }
+    for (; k < n; k++) {
+        out[k] = half_to_float(type, in[k]);
+    }
+}
+
+/// @brief 8 lanes (F16C for fp16)
+__attribute__((target("avx2,f16c"))) static void helper_widen_avx2(enum VALUE_TYPE type, const uint16_t* in,
+                                                                   float* out, uint64_t n) {
+    uint64_t k = 0;
+    if (type == VALUE_BF16) {
+        for (; k + 8 <= n; k += 8) {
+            __m256i h = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)&in[k]));
+            _mm256_storeu_ps(&out[k], _mm256_castsi256_ps(_mm256_slli_epi32(h, 16)));
+        }
+    } else {
+        for (; k + 8 <= n; k += 8) {
+            _mm256_storeu_ps(&out[k], _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)&in[k])));
+        }
+    }
+    for (; k < n; k++) {
+        out[k] = half_to_float(type, in[k]);
+    }
+}
+
+/// @brief 16 lanes
+__attribute__((target("avx512f"))) static void helper_widen_avx512(enum VALUE_TYPE type, const uint16_t* in,
+                                                                    float* out, uint64_t n) {
+    uint64_t k = 0;
+    if (type == VALUE_BF16) {
+        for (; k + 16 <= n; k += 16) {
+            __m512i h = _mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i*)&in[k]));
+            _mm512_storeu_ps(&out[k], _mm512_castsi512_ps(_mm512_slli_epi32(h, 16)));
+        }
+    } else {
+        for (; k + 16 <= n; k += 16) {
+            _mm512_storeu_ps(&out[k], _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i*)&in[k])));
+        }
+    }
+    for (; k < n; k++) {
+        out[k] = half_to_float(type, in[k]);
+    }
+}
+
+/// @brief out[0..n) = in[0..n) widened to float, with the SIMD conversion instructions of simdLevel
+void half_widen(enum VALUE_TYPE type, const uint16_t* in, float* out, uint64_t n) {
+    switch (simdLevel) {
+        case SIMD_AVX512:
+            helper_widen_avx512(type, in, out, n);
+            break;
+        case SIMD_AVX2:
+            helper_widen_avx2(type, in, out, n);
+            break;
+        default:
+            helper_widen_sse41(type, in, out, n);
+    }
+}
+
+/// @brief 8 lanes of fp16 with F16C, bf16 (integer rounding) is left to the compiler
+__attribute__((target("avx2,f16c"))) static void helper_narrow_fp16_avx2(const float* in, uint16_t* out,
+                                                                         uint64_t n) {
+    uint64_t k = 0;
+    for (; k + 8 <= n; k += 8) {
+        __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(&in[k]), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        _mm_storeu_si128((__m128i*)&out[k], h);
+    }
+    for (; k < n; k++) {
+        out[k] = float_to_half(VALUE_FP16, in[k]);
+    }
+}
+
+/// @brief out[0..n) = in[0..n) narrowed like float_to_half, with the SIMD conversion instructions of simdLevel
+void half_narrow(enum VALUE_TYPE type, const float* in, uint16_t* out, uint64_t n) {
+    if (type == VALUE_FP16 && simdLevel >= SIMD_AVX2) {
+        helper_narrow_fp16_avx2(in, out, n);
+        return;
+    }
+    for (uint64_t k = 0; k < n; k++) {
+        out[k] = float_to_half(type, in[k]);
+    }
+}
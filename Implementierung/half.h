@@ -0,0 +1,54 @@
+#ifndef GUARD_HALF
+#define GUARD_HALF
+
+#include <stdint.h>
+#include <string.h>
+
+/// @brief storage type of the values of a matrix: floats or one of two 16 bit formats, which the kernels widen to
+/// float (all arithmetic is done in float)
+enum VALUE_TYPE {
+    VALUE_FP32,  // IEEE single precision (the default of a zeroed struct)
+    VALUE_BF16,  // bfloat16: upper half of a float (8 exponent bits, 7 mantissa bits)
+    VALUE_FP16,  // IEEE half precision (5 exponent bits, 10 mantissa bits, largest value 65504)
+};
+
+/// @brief parses a type name ("fp32", "bf16", "fp16"), returns -1 for unknown names
+int parse_value_type(const char* name);
+
+/// @brief returns the name of a type
+const char* value_type_name(enum VALUE_TYPE type);
+
+/// @brief bytes per value of a type
+__attribute__((always_inline)) inline uint64_t value_bytes(enum VALUE_TYPE type) {
+    return type == VALUE_FP32 ? sizeof(float) : sizeof(uint16_t);
+}
+
+/// @brief widens one 16 bit value (type VALUE_BF16 or VALUE_FP16) to float, exact
+__attribute__((always_inline)) inline float half_to_float(enum VALUE_TYPE type, uint16_t h) {
+    uint32_t bits = (uint32_t)(h & 0x8000u) << 16;
+    if (type == VALUE_BF16) {
+        bits = (uint32_t)h << 16;
+    } else if ((h & 0x7c00u) == 0x7c00u) {  // infinity or NaN
+        bits |= 0x7f800000u | (uint32_t)(h & 0x3ffu) << 13;
+    } else if ((h & 0x7c00u) != 0) {  // normal: rebias the exponent from 15 to 127
+        bits |= ((uint32_t)(h & 0x7fffu) << 13) + ((127u - 15u) << 23);
+    } else {  // zero or subnormal: mantissa * 2^-24 is exact in a float
+        float f = (float)(h & 0x3ffu) * 0x1p-24f;
+        return h & 0x8000u ? -f : f;
+    }
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+/// @brief narrows one float to a 16 bit value of type VALUE_BF16 or VALUE_FP16 (round to nearest even, too large
+/// values become infinity)
+uint16_t float_to_half(enum VALUE_TYPE type, float f);
+
+/// @brief out[0..n) = in[0..n) widened to float, with the SIMD conversion instructions of simdLevel
+void half_widen(enum VALUE_TYPE type, const uint16_t* in, float* out, uint64_t n);
+
+/// @brief out[0..n) = in[0..n) narrowed like float_to_half, with the SIMD conversion instructions of simdLevel
+void half_narrow(enum VALUE_TYPE type, const float* in, uint16_t* out, uint64_t n);
+
+#endif
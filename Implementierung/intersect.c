@@ -0,0 +1,188 @@
+#include "intersect.h"
+
+#include <immintrin.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ellpack.h"
+#include "parallel.h"
+#include "simd.h"
+#include "workspace.h"
+
+/// @brief helper: scalar merge of two ascending index lists, also the tail of the SIMD kernels
+__attribute__((always_inline)) static inline float helper_merge(const float* leftValues,
+                                                                const elpk_index_t* leftIndices, uint64_t i,
+                                                                uint64_t leftLength, const float* rightValues,
+                                                                const elpk_index_t* rightIndices, uint64_t j,
+                                                                uint64_t rightLength, float sum) {
+    while (i < leftLength && j < rightLength) {
+        if (leftIndices[i] < rightIndices[j]) {
+            i++;
+        } else if (leftIndices[i] > rightIndices[j]) {
+            j++;
+        } else {
+            sum += leftValues[i++] * rightValues[j++];
+        }
+    }
+    return sum;
+}
+
+/// @brief scalar merge (64 bit indices that do not fit into 32 bit lanes)
+static float helper_intersect_scalar(const float* leftValues, const elpk_index_t* leftIndices, uint64_t leftLength,
+                                     const float* rightValues, const elpk_index_t* rightIndices, uint64_t rightLength) {
+    return helper_merge(leftValues, leftIndices, 0, leftLength, rightValues, rightIndices, 0, rightLength, 0.f);
+}
+
+/*
+ * The SIMD kernels hold a block of `lanes` indices of the longer list in a register and compare every index of the
+ * shorter list that is not larger than the last index of the block with all of them at once (indices are unique
+ * within a row, so there is at most one hit). Blocks whose last index is smaller than the next index of the shorter
+ * list are skipped with a single scalar compare. The matches are found in ascending column order, so the sum is
+ * accumulated in the same order as by the scalar merge. Blocks never reach past the length of the row: the padding
+ * has index 0 and could match column 0.
+ */
+
+/// @brief 4 lanes
+static float helper_intersect_sse41(const float* leftValues, const elpk_index_t* leftIndices, uint64_t leftLength,
+                                    const float* rightValues, const elpk_index_t* rightIndices, uint64_t rightLength) {
+    if (leftLength < rightLength) {
+        return helper_intersect_sse41(rightValues, rightIndices, rightLength, leftValues, leftIndices, leftLength);
+    }
+    float sum = 0.f;
+    uint64_t i = 0, j = 0;
+    for (; i + 4 <= leftLength && j < rightLength; i += 4) {
+        const elpk_index_t last = leftIndices[i + 3];
+        if (rightIndices[j] > last) {
+            continue;
+        }
+        const __m128i block = simd_load_indices4(&leftIndices[i]);
+        for (; j < rightLength && rightIndices[j] <= last; j++) {
+            __m128i eq = _mm_cmpeq_epi32(block, _mm_set1_epi32((int)rightIndices[j]));
+            int hit = _mm_movemask_ps(_mm_castsi128_ps(eq));
+            if (hit) {
+                sum += leftValues[i + __builtin_ctz(hit)] * rightValues[j];
+            }
+        }
+    }
+    return helper_merge(leftValues, leftIndices, i, leftLength, rightValues, rightIndices, j, rightLength, sum);
+}
+
+/// @brief 8 lanes
+__attribute__((target("avx2"))) static float helper_intersect_avx2(const float* leftValues,
+                                                                   const elpk_index_t* leftIndices, uint64_t leftLength,
+                                                                   const float* rightValues,
+                                                                   const elpk_index_t* rightIndices,
+                                                                   uint64_t rightLength) {
+    if (leftLength < rightLength) {
+        return helper_intersect_avx2(rightValues, rightIndices, rightLength, leftValues, leftIndices, leftLength);
+    }
+    float sum = 0.f;
+    uint64_t i = 0, j = 0;
+    for (; i + 8 <= leftLength && j < rightLength; i += 8) {
+        const elpk_index_t last = leftIndices[i + 7];
+        if (rightIndices[j] > last) {
+            continue;
+        }
+        const __m256i block = simd_load_indices8(&leftIndices[i]);
+        for (; j < rightLength && rightIndices[j] <= last; j++) {
+            __m256i eq = _mm256_cmpeq_epi32(block, _mm256_set1_epi32((int)rightIndices[j]));
+            int hit = _mm256_movemask_ps(_mm256_castsi256_ps(eq));
+            if (hit) {
+                sum += leftValues[i + __builtin_ctz(hit)] * rightValues[j];
+            }
+        }
+    }
+    return helper_merge(leftValues, leftIndices, i, leftLength, rightValues, rightIndices, j, rightLength, sum);
+}
+
+/// @brief 16 lanes
+__attribute__((target("avx512f"))) static float helper_intersect_avx512(const float* leftValues,
+                                                                        const elpk_index_t* leftIndices,
+                                                                        uint64_t leftLength, const float* rightValues,
+                                                                        const elpk_index_t* rightIndices,
+                                                                        uint64_t rightLength) {
+    if (leftLength < rightLength) {
+        return helper_intersect_avx512(rightValues, rightIndices, rightLength, leftValues, leftIndices, leftLength);
+    }
+    float sum = 0.f;
+    uint64_t i = 0, j = 0;
+    for (; i + 16 <= leftLength && j < rightLength; i += 16) {
+        const elpk_index_t last = leftIndices[i + 15];
+        if (rightIndices[j] > last) {
+            continue;
+        }
+        const __m512i block = simd_load_indices16(&leftIndices[i]);
+        for (; j < rightLength && rightIndices[j] <= last; j++) {
+            __mmask16 hit = _mm512_cmpeq_epi32_mask(block, _mm512_set1_epi32((int)rightIndices[j]));
+            if (hit) {
+                sum += leftValues[i + __builtin_ctz(hit)] * rightValues[j];
+            }
+        }
+    }
+    return helper_merge(leftValues, leftIndices, i, leftLength, rightValues, rightIndices, j, rightLength, sum);
+}
+
+/// @brief returns the kernel for simdLevel (the scalar merge if the indices do not fit into 32 bit lanes)
+/// @param noCols number of columns the indices address
+struct INTERSECT_KERNEL intersect_kernel(uint64_t noCols) {
+    if (noCols - 1 > UINT32_MAX) {
+        return (struct INTERSECT_KERNEL){.lanes = 1, .func = helper_intersect_scalar};
+    }
+    switch (simdLevel) {
+        case SIMD_AVX512:
+            return (struct INTERSECT_KERNEL){.lanes = 16, .func = helper_intersect_avx512};
+        case SIMD_AVX2:
+            return (struct INTERSECT_KERNEL){.lanes = 8, .func = helper_intersect_avx2};
+        default:
+            return (struct INTERSECT_KERNEL){.lanes = 4, .func = helper_intersect_sse41};
+    }
+}
+
+/// @brief arguments shared by all threads of row_summaries
+struct SUMMARY_ARGS {
+    const struct ELLPACK* matrix;
+    struct ROW_SUMMARY* summaries;
+};
+
+/// @brief helper: summarizes an even share of the rows
+static void helper_summarize_rows(int id, int n, void* p) {
+    const struct SUMMARY_ARGS* args = (struct SUMMARY_ARGS*)p;
+    const struct ELLPACK matrix = *args->matrix;
+    const uint64_t blockWidth = matrix.noCols / 64 + (matrix.noCols % 64 != 0);
+
+    for (uint64_t i = matrix.noRows * id / n; i < matrix.noRows * (id + 1) / n; i++) {
+        const float* values = &matrix.values[i * matrix.maxNoNonZero];
+        const elpk_index_t* indices = &matrix.indices[i * matrix.maxNoNonZero];
+        struct ROW_SUMMARY summary = {.length = 0, .min = matrix.noCols, .max = 0, .blocks = 0};
+        // the row ends where the indices stop ascending (padding is index 0 with value 0, see validate_matrix), so
+        // stored entries with value 0 (e.g. in a mask) are kept; only a leading index 0 needs the value
+        if (matrix.maxNoNonZero > 0 && (indices[0] != 0 || values[0] != 0.f)) {
+            summary.length = 1;
+            while (summary.length < matrix.maxNoNonZero && indices[summary.length] > indices[summary.length - 1]) {
+                summary.length++;
+            }
+        }
+        if (summary.length > 0) {
+            summary.min = indices[0];
+            summary.max = indices[summary.length - 1];
+        }
+        for (uint64_t k = 0; k < summary.length; k++) {
+            summary.blocks |= 1ull << (indices[k] / blockWidth);
+        }
+        args->summaries[i] = summary;
+    }
+}
+
+/// @brief summarizes every row of matrix on noThreads threads
+/// @param matrix matrix with ascending indices in every row
+/// @return matrix.noRows summaries, free with scratch_free
+struct ROW_SUMMARY* row_summaries(const struct ELLPACK matrix) {
+    struct ROW_SUMMARY* summaries = (struct ROW_SUMMARY*)scratch_alloc(matrix.noRows * sizeof(struct ROW_SUMMARY));
+    int n = noThreads < 1 ? 1 : noThreads;
+    if ((uint64_t)n > matrix.noRows) {
+        n = matrix.noRows < 1 ? 1 : matrix.noRows;
+    }
+    struct SUMMARY_ARGS args = {.matrix = &matrix, .summaries = summaries};
+    parallel_run(n, helper_summarize_rows, &args);
+    return summaries;
+}
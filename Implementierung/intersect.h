@@ -0,0 +1,41 @@
+#ifndef GUARD_INTERSECT
+#define GUARD_INTERSECT
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ellpack.h"
+
+/// @brief summary of the column indices of a row, used to skip pairs of rows that cannot share a column without
+/// merging them
+struct ROW_SUMMARY {
+    uint64_t length;  // entries without trailing padding (stored entries with value 0 count)
+    uint64_t min;     // first column (noCols if the row is empty)
+    uint64_t max;     // last column (0 if the row is empty)
+    uint64_t blocks;  // bit b is set if the row has a column in block b of 64 equally wide column blocks
+};
+
+/// @brief sparse dot product kernel for one instruction set level: sum of leftValues[i] * rightValues[j] over all i, j
+/// with leftIndices[i] == rightIndices[j]; both index lists ascending
+struct INTERSECT_KERNEL {
+    uint64_t lanes;  // indices compared at once per operand
+    float (*func)(const float* leftValues, const elpk_index_t* leftIndices, uint64_t leftLength,
+                  const float* rightValues, const elpk_index_t* rightIndices, uint64_t rightLength);
+};
+
+/// @brief returns the kernel for simdLevel (the scalar merge if the indices do not fit into 32 bit lanes)
+/// @param noCols number of columns the indices address
+struct INTERSECT_KERNEL intersect_kernel(uint64_t noCols);
+
+/// @brief summarizes every row of matrix on noThreads threads
+/// @param matrix matrix with ascending indices in every row
+/// @return matrix.noRows summaries, free with scratch_free
+struct ROW_SUMMARY* row_summaries(const struct ELLPACK matrix);
+
+/// @brief true if two rows summarized by row_summaries (of matrices with the same number of columns) can share a column
+__attribute__((always_inline)) inline bool rows_may_intersect(const struct ROW_SUMMARY* a,
+                                                             const struct ROW_SUMMARY* b) {
+    return a->min <= b->max && b->min <= a->max && (a->blocks & b->blocks) != 0;
+}
+
+#endif
@@ -1,17 +1,43 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
-#include <unistd.h>
 
+#include "autoselect.h"
+#include "benchmark.h"
+#include "chain.h"
 #include "ellpack.h"
 #include "file_io.h"
+#include "half.h"
+#include "masked.h"
 #include "mult.h"
+#include "parallel.h"
 #include "parseargs.h"
+#include "perfcount.h"
+#include "sell.h"
+#include "simd.h"
+#include "spmm.h"
+#include "spmv.h"
+#include "stream.h"
 #include "util.h"
+#include "workspace.h"
 
-/// @brief reads ellpack from path (if path is NULL from stdin); called to read a and b
+/// @brief reads ellpack (text or binary format) from path (if path is NULL from stdin); called to read a and b
 struct ELLPACK helper_read_and_close(char* path);
 
+/// @brief writes ellpack in the format args.out_format to args.out (if NULL to stdout), the values are stored as
+/// args.value_type (dense: as floats)
+void helper_write_and_close(struct ARGS args, struct ELLPACK matrix);
+
+/// @brief replaces a bf16/fp16 matrix by a copy with float values (for the kernels that only read floats)
+void helper_widen(struct ELLPACK* matrix);
+
+/// @brief reads a dense matrix (vectors of -v or right operand of -d) from path ("-" -> stdin)
+struct DENSE_MATRIX helper_read_dense(char* path);
+
+/// @brief writes a dense matrix to args.out (if NULL to stdout)
+void helper_write_dense(struct ARGS args, struct DENSE_MATRIX matrix);
+
 int main(int argc, char** argv) {
     struct ARGS args = parse_args(argc, argv);
 
@@ -19,18 +45,59 @@ int main(int argc, char** argv) {
     pdebug("\ta: '%s'\n", args.a);
     pdebug("\tb: '%s'\n", args.b);
     pdebug("\tout: '%s'\n", args.out);
+    pdebug("\tout_format: '%s'\n", args.out_format == BIN       ? "bin"
+                                   : args.out_format == DENSE   ? "dense"
+                                   : args.out_format == BLOCKED ? "blocked"
+                                                                : "text");
     pdebug("\timpl_version: '%d'\n", args.impl_version);
-    pdebug("\taction: '%s'\n", args.action == MULT       ? "mult"
-                               : args.action == BENCH    ? "bench"
-                               : args.action == CHECK_EQ ? "check eq"
-                                                         : "!! undefined !!");
+    pdebug("\tthresholds: '%s'\n", args.thresholds);
+    pdebug("\tthreads: '%d'\n", args.threads);
+    pdebug("\taction: '%s'\n", args.action == MULT         ? "mult"
+                               : args.action == BENCH        ? "bench"
+                               : args.action == CHECK_EQ     ? "check eq"
+                               : args.action == CONVERT      ? "convert"
+                               : args.action == SIMD_INFO    ? "simd info"
+                               : args.action == ESTIMATE     ? "estimate"
+                               : args.action == CHAIN        ? "chain"
+                               : args.action == SPMV         ? "spmv"
+                               : args.action == SPMV_BENCH   ? "spmv bench"
+                               : args.action == SPMM         ? "spmm"
+                               : args.action == SPMM_BENCH   ? "spmm bench"
+                               : args.action == STREAM       ? "stream"
+                               : args.action == MASKED       ? "masked"
+                               : args.action == MASKED_BENCH ? "masked bench"
+                                                             : "!! undefined !!");
     pdebug("\titerations: '%d'\n", args.iterations);
     pdebug("\tmax_diff: '%f'\n", args.eq_max_diff);
 
+    noThreads = args.threads > 0 ? args.threads : default_thread_count();
+
+    simdLevel = detect_simd_level();
+    if (args.simd_level >= 0) {
+        if (args.simd_level > (int)simdLevel) {
+            fprintf(stderr, "ERROR: %s is not supported by this cpu (best: %s)\n", simd_level_name(args.simd_level),
+                    simd_level_name(simdLevel));
+            exit(EXIT_FAILURE);
+        }
+        simdLevel = args.simd_level;
+    }
+    pdebug("simd level: '%s'\n", simd_level_name(simdLevel));
+    if (args.action == SIMD_INFO) {
+        printf("%s\n", simd_level_name(simdLevel));
+        exit(EXIT_SUCCESS);
+    }
+
+    if (args.thresholds != NULL) {
+        read_auto_thresholds(args.thresholds);
+    }
+
     void (*matr_mult_ellpack_ptr)(const void*, const void*, void*);
 
     // map impl_version to correct function
     switch (args.impl_version) {
+        case AUTO_IMPL_VERSION:
+            matr_mult_ellpack_ptr = matr_mult_ellpack_auto;
+            break;
         case 0:
             matr_mult_ellpack_ptr = matr_mult_ellpack;
             break;
@@ -49,34 +116,85 @@ int main(int argc, char** argv) {
         case 5:
             matr_mult_ellpack_ptr = matr_mult_ellpack_V5;
             break;
+        case 6:
+            matr_mult_ellpack_ptr = matr_mult_ellpack_V6;
+            break;
+        case 7:
+            matr_mult_ellpack_ptr = matr_mult_ellpack_V7;
+            break;
         default:
             abortIfNULL_msg(0, "fixme: missing function for impl version");
     }
 
+    if (args.perf) {
+        perf_open();
+    }
+    if (args.workspace) {
+        boundWorkspace = workspace_create();
+    }
+
     // read a and b
-    pdebug("reading a");
-    const struct ELLPACK a_lpk = helper_read_and_close(args.a);
-    pdebug("reading b");
-    const struct ELLPACK b_lpk = helper_read_and_close(args.b);
+    struct timespec parseStart;
+    clock_gettime(CLOCK_MONOTONIC, &parseStart);
+    struct ELLPACK a_lpk = {0};
+    if (args.action != CHAIN && args.action != STREAM) {
+        pdebug("reading a");
+        perf_begin(PHASE_READ_A);
+        a_lpk = helper_read_and_close(args.a);
+        perf_end(PHASE_READ_A);
+    }
+    double parseA = seconds_since(parseStart);
+    clock_gettime(CLOCK_MONOTONIC, &parseStart);
+    struct ELLPACK b_lpk = {0};
+    struct DENSE_MATRIX x = {0};  // vectors of SPMV or right operand of SPMM
+    if (args.action == SPMV || args.action == SPMV_BENCH || args.action == SPMM || args.action == SPMM_BENCH) {
+        pdebug("reading dense matrix");
+        perf_begin(PHASE_READ_B);
+        x = helper_read_dense(args.action == SPMV || args.action == SPMV_BENCH ? args.vectors : args.panel);
+        perf_end(PHASE_READ_B);
+    } else if (args.action != CONVERT && args.action != CHAIN) {
+        pdebug("reading b");
+        perf_begin(PHASE_READ_B);
+        b_lpk = helper_read_and_close(args.b);
+        perf_end(PHASE_READ_B);
+    }
+    struct ELLPACK mask_lpk = {0};
+    if (args.action == MASKED || args.action == MASKED_BENCH) {  // counted as "parse b"
+        pdebug("reading mask");
+        perf_begin(PHASE_READ_B);
+        mask_lpk = helper_read_and_close(strcmp(args.mask, "-") == 0 ? NULL : args.mask);
+        perf_end(PHASE_READ_B);
+    }
+    // only the main version (a and b) and spmv (a) read bf16/fp16 values directly, everything else gets float copies
+    bool halfKernel = args.impl_version == 0 && (args.action == MULT || args.action == BENCH || args.action == STREAM);
+    if (!halfKernel && args.action != SPMV && args.action != SPMV_BENCH && args.action != CONVERT) {
+        helper_widen(&a_lpk);
+    }
+    if (!halfKernel) {
+        helper_widen(&b_lpk);
+    }
+    helper_widen(&mask_lpk);
+    double parseB = seconds_since(parseStart);
 
     struct ELLPACK res_lpk;
+    // version printed by -B and -P: for -V auto the one the cost model chose (stays auto if it chooses per block)
+    int version = args.impl_version;
 
     switch (args.action) {
         case MULT:
             pdebug("starting multiplication...\n");
+            perf_begin(PHASE_MULTIPLY);
             matr_mult_ellpack_ptr(&a_lpk, &b_lpk, &res_lpk);
+            perf_end(PHASE_MULTIPLY);
             pdebug("finished multiplication\n");
-
-            FILE* file_out;
-            if (args.out != NULL) {
-                file_out = (FILE*)abortIfNULL(fopen(args.out, "w"));
-            } else {
-                file_out = stdout;
+            if (version == AUTO_IMPL_VERSION) {
+                version = estimate_cost(a_lpk, b_lpk).version;
             }
 
             pdebug("writing result\n");
-            elpk_write(res_lpk, file_out);
-            if (args.out != NULL) fclose(file_out);
+            perf_begin(PHASE_WRITE);
+            helper_write_and_close(args, res_lpk);
+            perf_end(PHASE_WRITE);
             elpk_free(res_lpk);
             break;
 
@@ -84,21 +202,30 @@ int main(int argc, char** argv) {
 #ifdef DEBUG
             fputs("WARNING:  compiled with debug output\n", stderr);
 #endif
-            struct timespec start, end;
-            double elapsed_time;
-
-            clock_gettime(CLOCK_MONOTONIC, &start);
+            struct BENCH_RESULT bench = {.warmup = args.warmup, .parseA = parseA, .parseB = parseB};
+            bench.multiply =
+                bench_multiply(matr_mult_ellpack_ptr, &a_lpk, &b_lpk, args.warmup, args.iterations, &res_lpk);
+            bench.multiplications = count_multiplications(a_lpk, b_lpk);
+            if (version == AUTO_IMPL_VERSION) {  // after bench_multiply, which validated a and b
+                version = estimate_cost(a_lpk, b_lpk).version;
+            }
+            bench.gflops = args.iterations > 0 ? 2.0 * bench.multiplications / bench.multiply.median / 1.0e9 : 0;
 
-            for (int i = 0; i < args.iterations; i++) {
-                matr_mult_ellpack_ptr(&a_lpk, &b_lpk, &res_lpk);
+            if (args.warmup + args.iterations > 0) {
+                // the result is written to -o (if given) or discarded, only to time the writer
+                struct timespec writeStart;
+                clock_gettime(CLOCK_MONOTONIC, &writeStart);
+                struct ARGS writeArgs = args;
+                writeArgs.out = args.out != NULL ? args.out : "/dev/null";
+                perf_begin(PHASE_WRITE);
+                helper_write_and_close(writeArgs, res_lpk);
+                perf_end(PHASE_WRITE);
+                bench.write = seconds_since(writeStart);
                 elpk_free(res_lpk);
-                sleep(1);
             }
 
-            clock_gettime(CLOCK_MONOTONIC, &end);
-
-            elapsed_time = (end.tv_sec - start.tv_sec - args.iterations) * 1.0e9 + (end.tv_nsec - start.tv_nsec);
-            printf("Average elapsed time per iteration: %.6f seconds\n", elapsed_time / args.iterations / 1.0e9);
+            print_bench(bench, version, args.json);
+            bench_free(bench.multiply);
             break;
 
         case CHECK_EQ:
@@ -106,12 +233,225 @@ int main(int argc, char** argv) {
             elpk_check_equal(a_lpk, b_lpk, args.eq_max_diff);
             break;
 
+        case CONVERT:
+            pdebug("writing a\n");
+            helper_write_and_close(args, a_lpk);
+            break;
+
+        case CHAIN:;
+            struct ELLPACK* factors = (struct ELLPACK*)abortIfNULL(malloc(args.noChain * sizeof(struct ELLPACK)));
+            for (int i = 0; i < args.noChain; i++) {  // every factor is counted as "read a" by -P
+                pdebug("reading factor %d", i);
+                perf_begin(PHASE_READ_A);
+                factors[i] = helper_read_and_close(strcmp(args.chain[i], "-") == 0 ? NULL : args.chain[i]);
+                helper_widen(&factors[i]);
+                perf_end(PHASE_READ_A);
+            }
+            pdebug("starting chain multiplication...\n");
+            perf_begin(PHASE_MULTIPLY);
+            res_lpk = chain_multiply(matr_mult_ellpack_ptr, factors, args.noChain);
+            perf_end(PHASE_MULTIPLY);
+            free(factors);
+
+            pdebug("writing result\n");
+            perf_begin(PHASE_WRITE);
+            helper_write_and_close(args, res_lpk);
+            perf_end(PHASE_WRITE);
+            elpk_free(res_lpk);
+            break;
+
+        case SPMV:
+        case SPMV_BENCH:;
+            // a is converted to the SELL-C-sigma layout of the kernel once, every vector is multiplied with it
+            if (x.noCols != a_lpk.noCols) {
+                fprintf(stderr, "ERROR: vectors have %lu entries, but a has %lu columns\n", x.noCols, a_lpk.noCols);
+                exit(EXIT_FAILURE);
+            }
+            struct timespec convertStart;
+            clock_gettime(CLOCK_MONOTONIC, &convertStart);
+            const struct SPMV_KERNEL kernel = spmv_kernel(a_lpk.noCols);
+            struct SELL a_sell = spmv_prepare(a_lpk, kernel);
+            double convert = seconds_since(convertStart);
+            struct DENSE_MATRIX y = {.noRows = x.noRows, .noCols = a_lpk.noRows};
+            y.values = (float*)abortIfNULL(malloc((y.noRows * y.noCols + 1) * sizeof(float)));
+
+            if (args.action == SPMV) {
+                pdebug("starting spmv...\n");
+                perf_begin(PHASE_MULTIPLY);
+                spmv(&a_sell, kernel, x, y);
+                perf_end(PHASE_MULTIPLY);
+
+                pdebug("writing result\n");
+                perf_begin(PHASE_WRITE);
+                helper_write_dense(args, y);
+                perf_end(PHASE_WRITE);
+            } else {
+#ifdef DEBUG
+                fputs("WARNING:  compiled with debug output\n", stderr);
+#endif
+                struct BENCH_RESULT bench = {.warmup = args.warmup, .parseA = parseA, .parseB = parseB};
+                bench.convert = convert;
+                bench.multiply = bench_spmv(&a_sell, kernel, x, y, args.warmup, args.iterations);
+                bench.multiplications = spmv_multiplications(&a_sell) * x.noRows;
+                bench.bytes = spmv_bytes(&a_sell) * x.noRows;
+                bench.gflops = args.iterations > 0 ? 2.0 * bench.multiplications / bench.multiply.median / 1.0e9 : 0;
+                bench.gbps = args.iterations > 0 ? bench.bytes / bench.multiply.median / 1.0e9 : 0;
+
+                struct timespec writeStart;
+                clock_gettime(CLOCK_MONOTONIC, &writeStart);
+                struct ARGS writeArgs = args;
+                writeArgs.out = args.out != NULL ? args.out : "/dev/null";
+                perf_begin(PHASE_WRITE);
+                helper_write_dense(writeArgs, y);
+                perf_end(PHASE_WRITE);
+                bench.write = seconds_since(writeStart);
+
+                print_bench(bench, version, args.json);
+                bench_free(bench.multiply);
+            }
+            sell_free(a_sell);
+            free(y.values);
+            free(x.values);
+            break;
+
+        case SPMM:
+        case SPMM_BENCH:;
+            // the dense right operand is copied once into a panel with rows padded to whole registers
+            struct timespec packStart;
+            clock_gettime(CLOCK_MONOTONIC, &packStart);
+            const struct SPMM_KERNEL spmmKernel = spmm_kernel();
+            struct SPMM_PANEL panel = spmm_pack(x, spmmKernel);
+            double pack = seconds_since(packStart);
+            free(x.values);
+            struct DENSE_MATRIX product = {.noRows = a_lpk.noRows, .noCols = panel.noCols, .values = NULL};
+            if (args.out_format == DENSE) {
+                product.values = (float*)abortIfNULL(malloc((product.noRows * product.noCols + 1) * sizeof(float)));
+            }
+            struct ARGS writeArgs = args;
+            struct BENCH_RESULT spmmBench = {.warmup = args.warmup, .parseA = parseA, .parseB = parseB};
+
+            if (args.action == SPMM) {
+                pdebug("starting spmm...\n");
+                perf_begin(PHASE_MULTIPLY);
+                if (args.out_format == DENSE) {
+                    spmm_dense(a_lpk, panel, spmmKernel, product);
+                } else {
+                    res_lpk = spmm_ellpack(a_lpk, panel, spmmKernel);
+                }
+                perf_end(PHASE_MULTIPLY);
+            } else {
+#ifdef DEBUG
+                fputs("WARNING:  compiled with debug output\n", stderr);
+#endif
+                spmmBench.convert = pack;
+                struct DENSE_MATRIX* dense = args.out_format == DENSE ? &product : NULL;
+                spmmBench.multiply =
+                    bench_spmm(&a_lpk, &panel, spmmKernel, dense, &res_lpk, args.warmup, args.iterations);
+                spmmBench.multiplications = spmm_multiplications(a_lpk, panel);
+                spmmBench.bytes = spmm_bytes(a_lpk, panel);
+                double median = spmmBench.multiply.median;
+                spmmBench.gflops = args.iterations > 0 ? 2.0 * spmmBench.multiplications / median / 1.0e9 : 0;
+                spmmBench.gbps = args.iterations > 0 ? spmmBench.bytes / median / 1.0e9 : 0;
+                // the result is written to -o (if given) or discarded, only to time the writer
+                writeArgs.out = args.out != NULL ? args.out : "/dev/null";
+            }
+
+            if (args.action == SPMM || args.warmup + args.iterations > 0) {
+                pdebug("writing result\n");
+                struct timespec writeStart;
+                clock_gettime(CLOCK_MONOTONIC, &writeStart);
+                perf_begin(PHASE_WRITE);
+                if (args.out_format == DENSE) {
+                    helper_write_dense(writeArgs, product);
+                } else {
+                    helper_write_and_close(writeArgs, res_lpk);
+                    elpk_free(res_lpk);
+                }
+                perf_end(PHASE_WRITE);
+                spmmBench.write = seconds_since(writeStart);
+            }
+            if (args.action == SPMM_BENCH) {
+                print_bench(spmmBench, version, args.json);
+                bench_free(spmmBench.multiply);
+            }
+            spmm_panel_free(panel);
+            free(product.values);
+            break;
+
+        case MASKED:
+            pdebug("starting masked multiplication...\n");
+            perf_begin(PHASE_MULTIPLY);
+            res_lpk = masked_multiply(a_lpk, b_lpk, mask_lpk);
+            perf_end(PHASE_MULTIPLY);
+
+            pdebug("writing result\n");
+            perf_begin(PHASE_WRITE);
+            helper_write_and_close(args, res_lpk);
+            perf_end(PHASE_WRITE);
+            elpk_free(res_lpk);
+            break;
+
+        case MASKED_BENCH:;
+#ifdef DEBUG
+            fputs("WARNING:  compiled with debug output\n", stderr);
+#endif
+            struct BENCH_RESULT maskedBench = {.warmup = args.warmup, .parseA = parseA, .parseB = parseB};
+            maskedBench.multiply = bench_masked(&a_lpk, &b_lpk, &mask_lpk, args.warmup, args.iterations, &res_lpk);
+            maskedBench.multiplications = masked_multiplications(a_lpk, b_lpk, mask_lpk);
+            maskedBench.gflops =
+                args.iterations > 0 ? 2.0 * maskedBench.multiplications / maskedBench.multiply.median / 1.0e9 : 0;
+
+            if (args.warmup + args.iterations > 0) {
+                // the result is written to -o (if given) or discarded, only to time the writer
+                struct timespec writeStart;
+                clock_gettime(CLOCK_MONOTONIC, &writeStart);
+                struct ARGS maskedWriteArgs = args;
+                maskedWriteArgs.out = args.out != NULL ? args.out : "/dev/null";
+                perf_begin(PHASE_WRITE);
+                helper_write_and_close(maskedWriteArgs, res_lpk);
+                perf_end(PHASE_WRITE);
+                maskedBench.write = seconds_since(writeStart);
+                elpk_free(res_lpk);
+            }
+
+            print_bench(maskedBench, version, args.json);
+            bench_free(maskedBench.multiply);
+            break;
+
+        case STREAM:;
+            // a is read block by block, b stays in memory
+            FILE* streamIn = args.a != NULL ? (FILE*)abortIfNULL(fopen(args.a, "r")) : stdin;
+            if (!elpk_is_bin(streamIn)) {
+                fputs("ERROR: -M needs a binary a (convert it with -c -f blocked or -c -f bin)\n", stderr);
+                exit(EXIT_FAILURE);
+            }
+            FILE* streamOut = args.out != NULL ? (FILE*)abortIfNULL(fopen(args.out, "w")) : stdout;
+            pdebug("starting streamed multiplication...\n");
+            stream_multiply(matr_mult_ellpack_ptr, streamIn, b_lpk, args.value_type, args.budget, streamOut);
+            if (args.a != NULL) fclose(streamIn);
+            if (args.out != NULL) fclose(streamOut);
+            break;
+
+        case ESTIMATE:
+            validate_inputs(a_lpk, b_lpk);
+            print_estimate(stdout, estimate_cost(a_lpk, b_lpk));
+            break;
+
         default:
             abortIfNULL_msg(0, "fixme: undefined action");
     }
 
+    if (args.perf) {
+        perf_print(stderr, version);
+        perf_close();
+    }
+    if (boundWorkspace != NULL) {
+        workspace_free(boundWorkspace);
+    }
+
     elpk_free(a_lpk);
     elpk_free(b_lpk);
+    elpk_free(mask_lpk);
     exit(EXIT_SUCCESS);
 }
 
@@ -126,7 +466,7 @@ struct ELLPACK helper_read_and_close(char* path) {
         pdebug_(" from stdin\n");
     }
 
-    const struct ELLPACK lpk = elpk_read_validate(file);
+    const struct ELLPACK lpk = elpk_is_bin(file) ? elpk_read_bin(file) : elpk_read_validate(file);
 
     pdebug("done:\n");
 #ifdef DEBUG
@@ -141,3 +481,74 @@ struct ELLPACK helper_read_and_close(char* path) {
 
     return lpk;
 }
+
+void helper_write_and_close(struct ARGS args, struct ELLPACK matrix) {
+    FILE* file_out;
+    if (args.out != NULL) {
+        file_out = (FILE*)abortIfNULL(fopen(args.out, "w"));
+    } else {
+        file_out = stdout;
+    }
+
+    enum VALUE_TYPE type = args.out_format == DENSE ? VALUE_FP32 : (enum VALUE_TYPE)args.value_type;
+    bool converted = matrix.valueType != type;
+    if (converted) {
+        matrix = elpk_with_value_type(matrix, type);
+    }
+
+    if (args.out_format == BIN) {
+        elpk_write_bin(matrix, file_out);
+    } else if (args.out_format == BLOCKED) {
+        elpk_write_blocked(matrix, file_out);
+    } else if (args.out_format == DENSE) {
+        struct DENSE_MATRIX dense = to_dense(matrix);
+        dense_write(dense, file_out);
+        scratch_free(dense.values);
+    } else {
+        elpk_write(matrix, file_out);
+    }
+    if (converted) {
+        elpk_free(matrix);
+    }
+
+    if (args.out != NULL) fclose(file_out);
+}
+
+void helper_widen(struct ELLPACK* matrix) {
+    if (matrix->valueType != VALUE_FP32) {
+        struct ELLPACK widened = elpk_with_value_type(*matrix, VALUE_FP32);
+        elpk_free(*matrix);
+        *matrix = widened;
+    }
+}
+
+struct DENSE_MATRIX helper_read_dense(char* path) {
+    FILE* file;
+
+    if (strcmp(path, "-") != 0) {
+        file = (FILE*)abortIfNULL(fopen(path, "r"));
+        pdebug_(" from file: '%s'\n", path);
+    } else {
+        file = stdin;
+        pdebug_(" from stdin\n");
+    }
+
+    const struct DENSE_MATRIX matrix = dense_read(file);
+
+    if (file != stdin) fclose(file);
+
+    return matrix;
+}
+
+void helper_write_dense(struct ARGS args, struct DENSE_MATRIX matrix) {
+    FILE* file_out;
+    if (args.out != NULL) {
+        file_out = (FILE*)abortIfNULL(fopen(args.out, "w"));
+    } else {
+        file_out = stdout;
+    }
+
+    dense_write(matrix, file_out);
+
+    if (args.out != NULL) fclose(file_out);
+}
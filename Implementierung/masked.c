@@ -0,0 +1,284 @@
+#include "masked.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ellpack.h"
+#include "intersect.h"
+#include "mult.h"
+#include "parallel.h"
+#include "workspace.h"
+
+// estimated cost of writing one entry of the transposed right matrix relative to one product (see masked_multiply)
+#define MASKED_TRANSPOSE_COST 4
+
+/// @brief arguments shared by all threads of masked_multiply
+struct MASKED_ARGS {
+    const struct ELLPACK* left;
+    const struct ELLPACK* right;
+    const struct ELLPACK* rightT;  // transposed right, only if a row uses dot products
+    const struct ELLPACK* mask;
+    struct ELLPACK* result;
+    const struct ROW_SUMMARY* leftSummaries;
+    const struct ROW_SUMMARY* rightSummaries;
+    const struct ROW_SUMMARY* rightTSummaries;
+    const struct ROW_SUMMARY* maskSummaries;
+    const struct INTERSECT_KERNEL* kernel;
+    const bool* useDot;         // per row of left: dot products instead of scattering
+    const uint64_t* rowBounds;  // rows of thread t are [rowBounds[t], rowBounds[t + 1])
+    uint64_t* threadMaxNnz;     // largest number of non-zero entries in a row, per thread
+};
+
+/// @brief helper: position of col in the ascending indices[0..length), -1 if it is not there
+__attribute__((always_inline)) static inline int64_t helper_find(const elpk_index_t* indices, uint64_t length,
+                                                                 uint64_t col) {
+    uint64_t lo = 0, hi = length;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (indices[mid] < col) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < length && indices[lo] == col ? (int64_t)lo : -1;
+}
+
+/// @brief helper: adds the products of row i of left with the rows of right it references to the slots of the mask
+/// row (result row i holds the columns of the mask row and zeros on entry)
+static void helper_scatter_row(const struct MASKED_ARGS* args, uint64_t i, float* values) {
+    const struct ELLPACK left = *args->left;
+    const struct ELLPACK right = *args->right;
+    const struct ROW_SUMMARY* maskRow = &args->maskSummaries[i];
+    const elpk_index_t* maskIndices = &args->mask->indices[i * args->mask->maxNoNonZero];
+
+    for (uint64_t j = i * left.maxNoNonZero; j < i * left.maxNoNonZero + args->leftSummaries[i].length; j++) {
+        if (left.values[j] == 0.f) {
+            continue;
+        }
+        uint64_t rightRowStart = left.indices[j] * right.maxNoNonZero;
+        const struct ROW_SUMMARY* rightRow = &args->rightSummaries[left.indices[j]];
+        if (!rows_may_intersect(maskRow, rightRow)) {
+            continue;  // no product of this row of right lands on the mask
+        }
+        for (uint64_t k = rightRowStart; k < rightRowStart + rightRow->length; k++) {
+            if (right.indices[k] < maskRow->min || right.indices[k] > maskRow->max) {
+                continue;
+            }
+            int64_t slot = helper_find(maskIndices, maskRow->length, right.indices[k]);
+            if (slot >= 0) {
+                values[slot] += left.values[j] * right.values[k];
+            }
+        }
+    }
+}
+
+/// @brief helper: computes every entry of the mask row i as the dot product of row i of left and a row of the
+/// transposed right matrix
+static void helper_dot_row(const struct MASKED_ARGS* args, uint64_t i, float* values) {
+    const struct ELLPACK left = *args->left;
+    const struct ELLPACK rightT = *args->rightT;
+    const struct ROW_SUMMARY* leftRow = &args->leftSummaries[i];
+    const elpk_index_t* maskIndices = &args->mask->indices[i * args->mask->maxNoNonZero];
+
+    for (uint64_t slot = 0; slot < args->maskSummaries[i].length; slot++) {
+        uint64_t j = maskIndices[slot];
+        if (!rows_may_intersect(leftRow, &args->rightTSummaries[j])) {
+            continue;
+        }
+        values[slot] = args->kernel->func(&left.values[i * left.maxNoNonZero], &left.indices[i * left.maxNoNonZero],
+                                          leftRow->length, &rightT.values[j * rightT.maxNoNonZero],
+                                          &rightT.indices[j * rightT.maxNoNonZero], args->rightTSummaries[j].length);
+    }
+}
+
+/// @brief helper: computes the rows of one thread, every row is computed in place and then compacted
+static void helper_masked_rows(int id, int n, void* p) {
+    (void)n;
+    const struct MASKED_ARGS* args = (struct MASKED_ARGS*)p;
+    const struct ELLPACK mask = *args->mask;
+    struct ELLPACK result = *args->result;
+    uint64_t maxNnz = 0;
+
+    for (uint64_t i = args->rowBounds[id]; i < args->rowBounds[id + 1]; i++) {
+        const uint64_t maskLength = args->maskSummaries[i].length;
+        float* values = &result.values[i * result.maxNoNonZero];
+        elpk_index_t* indices = &result.indices[i * result.maxNoNonZero];
+        for (uint64_t slot = 0; slot < maskLength; slot++) {
+            values[slot] = 0.f;
+        }
+        if (args->useDot[i]) {
+            helper_dot_row(args, i, values);
+        } else {
+            helper_scatter_row(args, i, values);
+        }
+
+        // keep the non-zero entries (the mask row is sorted, so the result row is as well)
+        uint64_t rowNnz = 0;
+        for (uint64_t slot = 0; slot < maskLength; slot++) {
+            if (values[slot] != 0.f) {
+                indices[rowNnz] = mask.indices[i * mask.maxNoNonZero + slot];
+                values[rowNnz++] = values[slot];
+            }
+        }
+        maxNnz = rowNnz > maxNnz ? rowNnz : maxNnz;
+        // add padding
+        for (; rowNnz < result.maxNoNonZero; rowNnz++) {
+            values[rowNnz] = 0.f;
+            indices[rowNnz] = 0;
+        }
+    }
+    args->threadMaxNnz[id] = maxNnz;
+}
+
+/// @brief helper: aborts if the dimensions of left, right and mask do not match
+static void helper_validate(const struct ELLPACK left, const struct ELLPACK right, const struct ELLPACK mask) {
+    validate_inputs(left, right);
+    if (mask.noRows != left.noRows || mask.noCols != right.noCols) {
+        fprintf(stderr, "ERROR: the mask is %lux%lu, but the product is %lux%lu\n", mask.noRows, mask.noCols,
+                left.noRows, right.noCols);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/// @brief result = (left * right) restricted to the pattern of mask (its entries without trailing padding, the values
+/// are ignored, see row_summaries) on noThreads threads; every row is computed either by scattering the products of
+/// the row into the slots of the mask row (binary search) or by one sparse dot product per mask entry with the
+/// transposed right matrix (see intersect.h), whichever is estimated to be cheaper, so the result and the
+/// accumulation are bounded by the entries of mask instead of the entries of left * right
+/// @param left left matrix
+/// @param right right matrix
+/// @param mask left.noRows x right.noCols matrix with ascending indices in every row
+/// @return product, free with elpk_free
+struct ELLPACK masked_multiply(const struct ELLPACK left, const struct ELLPACK right, const struct ELLPACK mask) {
+    helper_validate(left, right, mask);
+    struct ROW_SUMMARY* leftSummaries = row_summaries(left);
+    struct ROW_SUMMARY* rightSummaries = row_summaries(right);
+    struct ROW_SUMMARY* maskSummaries = row_summaries(mask);
+
+    struct ELLPACK result = {0};
+    result.noRows = left.noRows;
+    result.noCols = right.noCols;
+    for (uint64_t i = 0; i < mask.noRows; i++) {
+        if (maskSummaries[i].length > result.maxNoNonZero) {
+            result.maxNoNonZero = maskSummaries[i].length;
+        }
+    }
+    elpk_alloc(&result);
+
+    // estimated cost of every row: scattering visits every product (plus a binary search in the mask row), a dot
+    // product merges the row of left with a column of right (of average length)
+    uint64_t rightEntries = 0;
+    for (uint64_t k = 0; k < right.noRows; k++) {
+        rightEntries += rightSummaries[k].length;
+    }
+    const double columnLength = right.noCols > 0 ? (double)rightEntries / right.noCols : 0;
+    bool* useDot = (bool*)scratch_alloc(left.noRows * sizeof(bool) + 1);
+    double* scatterCost = (double*)scratch_alloc((left.noRows + 1) * sizeof(double));
+    double* dotCost = (double*)scratch_alloc((left.noRows + 1) * sizeof(double));
+    double saving = 0;
+    for (uint64_t i = 0; i < left.noRows; i++) {
+        const uint64_t maskLength = maskSummaries[i].length;
+        double flops = 0;
+        for (uint64_t j = i * left.maxNoNonZero; j < i * left.maxNoNonZero + leftSummaries[i].length; j++) {
+            flops += left.values[j] != 0.f ? rightSummaries[left.indices[j]].length : 0;
+        }
+        scatterCost[i] = flops * (1 + log2(maskLength + 1));
+        dotCost[i] = maskLength * (leftSummaries[i].length + columnLength);
+        useDot[i] = maskLength > 0 && dotCost[i] < scatterCost[i];
+        saving += useDot[i] ? scatterCost[i] - dotCost[i] : 0;
+    }
+    // the dot products need the transposed right matrix: noCols rows padded to the longest column, written and
+    // summarized once
+    uint64_t* columnLengths = (uint64_t*)scratch_calloc((right.noCols + 1) * sizeof(uint64_t));
+    uint64_t maxColumnLength = 0;
+    for (uint64_t k = 0; k < right.noRows; k++) {
+        for (uint64_t j = k * right.maxNoNonZero; j < k * right.maxNoNonZero + rightSummaries[k].length; j++) {
+            uint64_t length = ++columnLengths[right.indices[j]];
+            maxColumnLength = length > maxColumnLength ? length : maxColumnLength;
+        }
+    }
+    scratch_free(columnLengths);
+    const bool anyDot = saving > MASKED_TRANSPOSE_COST * (rightEntries + right.noCols * maxColumnLength);
+    uint64_t* costPrefix = (uint64_t*)scratch_alloc((left.noRows + 1) * sizeof(uint64_t));
+    costPrefix[0] = 0;
+    for (uint64_t i = 0; i < left.noRows; i++) {
+        useDot[i] &= anyDot;
+        costPrefix[i + 1] = costPrefix[i] + 1 + (uint64_t)(useDot[i] ? dotCost[i] : scatterCost[i]);
+    }
+    scratch_free(dotCost);
+    scratch_free(scatterCost);
+
+    struct ELLPACK rightT = {0};
+    struct ROW_SUMMARY* rightTSummaries = NULL;
+    if (anyDot) {
+        rightT = transpose_parallel(right);
+        rightTSummaries = row_summaries(rightT);
+    }
+    const struct INTERSECT_KERNEL kernel = intersect_kernel(left.noCols);
+
+    int n = noThreads < 1 ? 1 : noThreads;
+    if ((uint64_t)n > left.noRows) {
+        n = left.noRows < 1 ? 1 : left.noRows;
+    }
+    uint64_t rowBounds[n + 1];
+    uint64_t threadMaxNnz[n];
+    partition_rows(costPrefix, left.noRows, n, rowBounds);
+    struct MASKED_ARGS args = {.left = &left,
+                               .right = &right,
+                               .rightT = &rightT,
+                               .mask = &mask,
+                               .result = &result,
+                               .leftSummaries = leftSummaries,
+                               .rightSummaries = rightSummaries,
+                               .rightTSummaries = rightTSummaries,
+                               .maskSummaries = maskSummaries,
+                               .kernel = &kernel,
+                               .useDot = useDot,
+                               .rowBounds = rowBounds,
+                               .threadMaxNnz = threadMaxNnz};
+    parallel_run(n, helper_masked_rows, &args);
+
+    if (anyDot) {
+        scratch_free(rightTSummaries);
+        elpk_free(rightT);
+    }
+    scratch_free(costPrefix);
+    scratch_free(useDot);
+    scratch_free(maskSummaries);
+    scratch_free(rightSummaries);
+    scratch_free(leftSummaries);
+
+    uint64_t maxNnz = 0;
+    for (int t = 0; t < n; t++) {
+        maxNnz = threadMaxNnz[t] > maxNnz ? threadMaxNnz[t] : maxNnz;
+    }
+    // only compact if some entries of the mask were 0 in every row that long
+    return maxNnz == result.maxNoNonZero ? result : remove_unnecessary_padding(result);
+}
+
+/// @brief number of products of masked_multiply that land on the pattern of mask
+uint64_t masked_multiplications(const struct ELLPACK left, const struct ELLPACK right, const struct ELLPACK mask) {
+    helper_validate(left, right, mask);
+    struct ROW_SUMMARY* rightSummaries = row_summaries(right);
+    struct ROW_SUMMARY* maskSummaries = row_summaries(mask);
+    uint64_t count = 0;
+    for (uint64_t i = 0; i < left.noRows; i++) {
+        const elpk_index_t* maskIndices = &mask.indices[i * mask.maxNoNonZero];
+        for (uint64_t j = i * left.maxNoNonZero; j < (i + 1) * left.maxNoNonZero; j++) {
+            if (left.values[j] == 0.f) {
+                continue;
+            }
+            uint64_t rightRowStart = left.indices[j] * right.maxNoNonZero;
+            for (uint64_t k = rightRowStart; k < rightRowStart + rightSummaries[left.indices[j]].length; k++) {
+                count += helper_find(maskIndices, maskSummaries[i].length, right.indices[k]) >= 0;
+            }
+        }
+    }
+    scratch_free(maskSummaries);
+    scratch_free(rightSummaries);
+    return count;
+}
@@ -0,0 +1,22 @@
+#ifndef GUARD_MASKED
+#define GUARD_MASKED
+
+#include <stdint.h>
+
+#include "ellpack.h"
+
+/// @brief result = (left * right) restricted to the pattern of mask (its entries without trailing padding, the values
+/// are ignored, see row_summaries) on noThreads threads; every row is computed either by scattering the products of
+/// the row into the slots of the mask row (binary search) or by one sparse dot product per mask entry with the
+/// transposed right matrix (see intersect.h), whichever is estimated to be cheaper, so the result and the
+/// accumulation are bounded by the entries of mask instead of the entries of left * right
+/// @param left left matrix
+/// @param right right matrix
+/// @param mask left.noRows x right.noCols matrix with ascending indices in every row
+/// @return product, free with elpk_free
+struct ELLPACK masked_multiply(const struct ELLPACK left, const struct ELLPACK right, const struct ELLPACK mask);
+
+/// @brief number of products of masked_multiply that land on the pattern of mask
+uint64_t masked_multiplications(const struct ELLPACK left, const struct ELLPACK right, const struct ELLPACK mask);
+
+#endif
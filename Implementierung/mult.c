@@ -1,13 +1,21 @@
 #include "mult.h"
 
-#include <pmmintrin.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <xmmintrin.h>
 
+#include "accumulator.h"
 #include "ellpack.h"
+#include "gemm.h"
+#include "half.h"
+#include "intersect.h"
+#include "parallel.h"
+#include "perfcount.h"
+#include "radix.h"
+#include "sell.h"
 #include "util.h"
+#include "workspace.h"
 
 /// @brief second version, searching corresponding values in right matrix for every entry in left matrix
 /// @param a Pointer to left matrix
@@ -58,46 +66,175 @@ void matr_mult_ellpack_V1(const void* a, const void* b, void* res) {
     *(struct ELLPACK*)res = remove_unnecessary_padding(result);
 }
 
-/// @brief first and main version, optimized seach for corresponding value in right matrix compared to second version
-void matr_mult_ellpack(const void* a, const void* b, void* res) {
-    const struct ELLPACK left = *(struct ELLPACK*)a;
-    const struct ELLPACK right = *(struct ELLPACK*)b;
-    validate_inputs(left, right);
-    struct ELLPACK result;
-    result = initialize_result(left, right, result);
-    if ((*(struct ELLPACK*)a).maxNoNonZero == 0 || (*(struct ELLPACK*)b).maxNoNonZero == 0) {
-        *(struct ELLPACK*)res = result;
-        return;
+/// @brief number of entries in every row of matrix without trailing padding
+static uint64_t* helper_row_lengths(const struct ELLPACK matrix) {
+    uint64_t* rowLength = (uint64_t*)scratch_alloc(matrix.noRows * sizeof(uint64_t));
+    for (uint64_t i = 0; i < matrix.noRows; i++) {
+        uint64_t length = matrix.maxNoNonZero;
+        while (length > 0 && elpk_is_zero(&matrix, i * matrix.maxNoNonZero + length - 1)) {
+            length--;
+        }
+        rowLength[i] = length;
     }
-    // stores the products of a row of left with all columns of right
-    float* sum = (float*)abortIfNULL(malloc(right.noCols * sizeof(float)));
+    return rowLength;
+}
 
-    uint64_t resultPos = 0;                        // pointer to next position to insert a value into result matrix
-    for (uint64_t j = 0; j < right.noCols; j++) {  // initialize all values with 0
-        sum[j] = 0.0;
+/// @brief splits the rows of left between at most noThreads threads by a prefix sum of their flop counts
+/// @param left left matrix
+/// @param rightRowLength row lengths of the right matrix (see helper_row_lengths)
+/// @param rowBounds output: at least noThreads + 1 entries
+/// @return number of threads to use
+static int helper_flop_partition(const struct ELLPACK left, const uint64_t* rightRowLength, uint64_t* rowBounds) {
+    int n = noThreads < 1 ? 1 : noThreads;
+    if ((uint64_t)n > left.noRows) {
+        n = left.noRows < 1 ? 1 : left.noRows;
     }
+    uint64_t* flopPrefix = (uint64_t*)scratch_alloc((left.noRows + 1) * sizeof(uint64_t));
 
-    /* -------------------- calculation of actual values -------------------- */
+    // prefix sum of the flops of every row of left (+1 per row for writing the result row)
+    flopPrefix[0] = 0;
+    for (uint64_t i = 0; i < left.noRows; i++) {
+        uint64_t flops = 1;
+        for (uint64_t j = i * left.maxNoNonZero; j < (i + 1) * left.maxNoNonZero; j++) {
+            if (!elpk_is_zero(&left, j)) {
+                flops += rightRowLength[left.indices[j]];
+            }
+        }
+        flopPrefix[i + 1] = flopPrefix[i] + flops;
+    }
+    partition_rows(flopPrefix, left.noRows, n, rowBounds);
+    scratch_free(flopPrefix);
+    return n;
+}
+
+/// @brief arguments shared by all threads of the symbolic phase and the main version
+struct GUSTAVSON_ARGS {
+    const struct ELLPACK* left;
+    const struct ELLPACK* right;
+    struct ELLPACK* result;
+    const uint64_t* rightRowLength;  // number of entries in every row of right without trailing padding
+    const uint64_t* rowBounds;       // rows of thread t are [rowBounds[t], rowBounds[t + 1])
+    uint64_t* rowNnz;                // symbolic phase: number of non-zero entries of every result row
+    uint64_t* threadMaxNnz;          // numeric phase: largest number of non-zero entries in a row, per thread
+};
+
+/// @brief counts the non-zero entries of the result rows of one thread without computing any values
+static void helper_symbolic_rows(int id, int n, void* p) {
+    (void)n;
+    const struct GUSTAVSON_ARGS* args = (struct GUSTAVSON_ARGS*)p;
+    const struct ELLPACK left = *args->left;
+    const struct ELLPACK right = *args->right;
+
+    // only the set of touched columns is used, the sums stay 0
+    uint64_t bound = left.maxNoNonZero * right.maxNoNonZero;
+    struct ACCUMULATOR columns = acc_init(right.noCols, bound < right.noCols ? bound : right.noCols);
+
+    for (uint64_t i = args->rowBounds[id]; i < args->rowBounds[id + 1]; i++) {
+        for (uint64_t j = i * left.maxNoNonZero; j < (i + 1) * left.maxNoNonZero; j++) {
+            if (elpk_is_zero(&left, j)) {
+                continue;
+            }
+            uint64_t rightRowStart = left.indices[j] * right.maxNoNonZero;
+            for (uint64_t k = rightRowStart; k < rightRowStart + args->rightRowLength[left.indices[j]]; k++) {
+                if (!elpk_is_zero(&right, k)) {
+                    acc_add(&columns, right.indices[k], 0.f);
+                }
+            }
+        }
+        args->rowNnz[i] = acc_clear(&columns);
+    }
+    acc_free(columns);
+}
+
+/// @brief symbolic phase: computes the exact number of non-zero entries of every row of left * right (assuming no
+/// products cancel each other out)
+/// @param left left matrix
+/// @param right right matrix
+/// @return array with left.noRows entries, has to be freed by the caller with scratch_free
+uint64_t* symbolic_row_nnz(const struct ELLPACK left, const struct ELLPACK right) {
+    uint64_t* rowNnz = (uint64_t*)scratch_calloc((left.noRows + 1) * sizeof(uint64_t));
+    if (left.maxNoNonZero == 0 || right.maxNoNonZero == 0) {
+        return rowNnz;
+    }
+    uint64_t* rightRowLength = helper_row_lengths(right);
+    uint64_t rowBounds[(noThreads < 1 ? 1 : noThreads) + 1];
+    int n = helper_flop_partition(left, rightRowLength, rowBounds);
+
+    struct GUSTAVSON_ARGS args = {
+        .left = &left, .right = &right, .rightRowLength = rightRowLength, .rowBounds = rowBounds, .rowNnz = rowNnz};
+    parallel_run(n, helper_symbolic_rows, &args);
+
+    scratch_free(rightRowLength);
+    return rowNnz;
+}
+
+/// @brief number of multiplications of left * right: products of non-zero entries of left with the entries of the
+/// referenced rows of right
+/// @param left left matrix
+/// @param right right matrix
+/// @return number of multiplications
+uint64_t count_multiplications(const struct ELLPACK left, const struct ELLPACK right) {
+    uint64_t* rightRowLength = helper_row_lengths(right);
+    uint64_t count = 0;
+    for (uint64_t j = 0; j < left.noRows * left.maxNoNonZero; j++) {
+        if (!elpk_is_zero(&left, j)) {
+            count += rightRowLength[left.indices[j]];
+        }
+    }
+    scratch_free(rightRowLength);
+    return count;
+}
+
+/// @brief values of row i of matrix as floats: a pointer into matrix->values, or for the 16 bit value types the first
+/// length entries of the row widened into buffer
+__attribute__((always_inline)) static inline const float* helper_row_values(const struct ELLPACK* matrix, uint64_t i,
+                                                                           uint64_t length, float* buffer) {
+    if (matrix->valueType == VALUE_FP32) {
+        return &matrix->values[i * matrix->maxNoNonZero];
+    }
+    half_widen(matrix->valueType, &matrix->halfValues[i * matrix->maxNoNonZero], buffer, length);
+    return buffer;
+}
 
-    for (uint64_t i = 0; i < left.noRows; i++) {            // Iterates over the rows of left
+/// @brief computes the rows of one thread of the main version with a private accumulator
+static void helper_gustavson_rows(int id, int n, void* p) {
+    (void)n;
+    const struct GUSTAVSON_ARGS* args = (struct GUSTAVSON_ARGS*)p;
+    const struct ELLPACK left = *args->left;
+    const struct ELLPACK right = *args->right;
+    struct ELLPACK result = *args->result;
+    uint64_t maxNnz = 0;
+
+    // stores the products of a row of left with all columns of right, only touched columns are emitted and reset
+    struct ACCUMULATOR sum = acc_init(right.noCols, result.maxNoNonZero);
+    // bf16/fp16 operands are widened one row at a time, the products are summed up in float
+    float* leftBuffer = left.valueType == VALUE_FP32 ? NULL : (float*)scratch_alloc(left.maxNoNonZero * sizeof(float));
+    float* rightBuffer =
+        right.valueType == VALUE_FP32 ? NULL : (float*)scratch_alloc(right.maxNoNonZero * sizeof(float));
+
+    for (uint64_t i = args->rowBounds[id]; i < args->rowBounds[id + 1]; i++) {  // Iterates over the rows of left
+        const float* leftValues = helper_row_values(&left, i, left.maxNoNonZero, leftBuffer);
         for (uint64_t j = 0; j < left.maxNoNonZero; j++) {  // Iterates over a row of left
-            uint64_t leftAccessIndex = i * left.maxNoNonZero + j;
+            if (leftValues[j] == 0.f) {  // padding does not contribute
+                continue;
+            }
             // leftColRightRow is the column index of the left and row index of the right matrix
-            uint64_t leftColRightRow = left.indices[leftAccessIndex];
+            uint64_t leftColRightRow = left.indices[i * left.maxNoNonZero + j];
 
             // Iterates over the row of right for which left has a non-zero entry and adds the product to the array
-            for (uint64_t k = leftColRightRow * right.maxNoNonZero; k < (leftColRightRow + 1) * right.maxNoNonZero;
-                 k++) {
-                sum[right.indices[k]] += left.values[leftAccessIndex] * right.values[k];
+            uint64_t rightRowStart = leftColRightRow * right.maxNoNonZero;
+            uint64_t rightRowLength = args->rightRowLength[leftColRightRow];
+            const float* rightValues = helper_row_values(&right, leftColRightRow, rightRowLength, rightBuffer);
+            for (uint64_t k = 0; k < rightRowLength; k++) {
+                acc_add(&sum, right.indices[rightRowStart + k], leftValues[j] * rightValues[k]);
             }
         }
-        // set the values of result to calculated products: iterates over and fills a complete row in result
-        for (uint64_t j = 0; j < right.noCols; j++) {
-            if (sum[j] != 0.0) {
-                result.indices[resultPos] = j;
-                result.values[resultPos++] = sum[j];
-                sum[j] = 0.0;
-            }
+        // set the values of result to calculated products (sorted by column)
+        uint64_t resultPos = i * result.maxNoNonZero;  // pointer to next position to insert a value into result
+        uint64_t rowNnz = acc_flush(&sum, &result.indices[resultPos], &result.values[resultPos]);
+        resultPos += rowNnz;
+        if (rowNnz > maxNnz) {
+            maxNnz = rowNnz;
         }
         // add padding
         for (; resultPos < (i + 1) * result.maxNoNonZero; resultPos++) {
@@ -105,42 +242,77 @@ void matr_mult_ellpack(const void* a, const void* b, void* res) {
             result.indices[resultPos] = 0;
         }
     }
-    free(sum);
-    *(struct ELLPACK*)res = remove_unnecessary_padding(result);
+    args->threadMaxNnz[id] = maxNnz;
+    acc_free(sum);
+    scratch_free(leftBuffer);
+    scratch_free(rightBuffer);
 }
 
-/// @brief third version, working on transposed right matrix for better cache compatibility,
-void matr_mult_ellpack_V2(const void* a, const void* b, void* res) {
+/// @brief first and main version, optimized seach for corresponding value in right matrix compared to second version;
+/// the rows of left are split between noThreads threads so that every thread gets about the same number of flops;
+/// left and right may have any value type (half.h), the result is float
+void matr_mult_ellpack(const void* a, const void* b, void* res) {
     const struct ELLPACK left = *(struct ELLPACK*)a;
-    struct ELLPACK right = *(struct ELLPACK*)b;
+    const struct ELLPACK right = *(struct ELLPACK*)b;
     validate_inputs(left, right);
     struct ELLPACK result;
     result = initialize_result(left, right, result);
-    if ((*(struct ELLPACK*)a).maxNoNonZero == 0 || (*(struct ELLPACK*)b).maxNoNonZero == 0) {
+    if (result.maxNoNonZero == 0) {
         *(struct ELLPACK*)res = result;
         return;
     }
-    right = transpose(right);
-    uint64_t resultPos = 0;  // pointer to next position to insert a value into result matrix
+    uint64_t* rightRowLength = helper_row_lengths(right);
+    uint64_t rowBounds[(noThreads < 1 ? 1 : noThreads) + 1];
+    int n = helper_flop_partition(left, rightRowLength, rowBounds);
+    uint64_t threadMaxNnz[n];
 
     /* -------------------- calculation of actual values -------------------- */
 
-    for (uint64_t i = 0; i < left.noRows; i++) {       // Iterates over the rows of left
-        for (uint64_t j = 0; j < right.noRows; j++) {  // Iterates over the columns in the right matrix
-            float sum = 0.f;                           // accumulator for an entry in result
-            uint64_t leftRowPointer = left.maxNoNonZero * i;
-            uint64_t rightRowPointer = right.maxNoNonZero * j;
-
-            // Iterates over the rows of the (transposed) matrices, incrementing the pointer with the lower Index
-            while (leftRowPointer < left.maxNoNonZero * (i + 1) && rightRowPointer < right.maxNoNonZero * (j + 1)) {
-                if (left.indices[leftRowPointer] < right.indices[rightRowPointer]) {
-                    leftRowPointer++;
-                } else if (left.indices[leftRowPointer] > right.indices[rightRowPointer]) {
-                    rightRowPointer++;
-                } else {
-                    sum += left.values[leftRowPointer++] * right.values[rightRowPointer++];
-                }
+    struct GUSTAVSON_ARGS args = {.left = &left,
+                                  .right = &right,
+                                  .result = &result,
+                                  .rightRowLength = rightRowLength,
+                                  .rowBounds = rowBounds,
+                                  .threadMaxNnz = threadMaxNnz};
+    parallel_run(n, helper_gustavson_rows, &args);
+    scratch_free(rightRowLength);
+
+    uint64_t maxNnz = 0;
+    for (int t = 0; t < n; t++) {
+        maxNnz = threadMaxNnz[t] > maxNnz ? threadMaxNnz[t] : maxNnz;
+    }
+    // the symbolic phase is exact unless products cancelled each other out, only then the result has to be compacted
+    *(struct ELLPACK*)res = maxNnz == result.maxNoNonZero ? result : remove_unnecessary_padding(result);
+}
+
+/// @brief arguments shared by all threads of matr_mult_ellpack_V2
+struct INNER_PRODUCT_ARGS {
+    const struct ELLPACK* left;
+    const struct ELLPACK* right;  // transposed
+    struct ELLPACK* result;
+    const struct ROW_SUMMARY* leftSummaries;
+    const struct ROW_SUMMARY* rightSummaries;
+    const struct INTERSECT_KERNEL* kernel;
+};
+
+/// @brief helper: computes an even share of the rows of the result of matr_mult_ellpack_V2
+static void helper_inner_product_rows(int id, int n, void* p) {
+    const struct INNER_PRODUCT_ARGS* args = (struct INNER_PRODUCT_ARGS*)p;
+    const struct ELLPACK left = *args->left;
+    const struct ELLPACK right = *args->right;
+    const struct ELLPACK result = *args->result;
+
+    for (uint64_t i = left.noRows * id / n; i < left.noRows * (id + 1) / n; i++) {  // Iterates over the rows of left
+        const struct ROW_SUMMARY* leftRow = &args->leftSummaries[i];
+        uint64_t resultPos = i * result.maxNoNonZero;  // pointer to next position to insert a value into result matrix
+        for (uint64_t j = 0; leftRow->length > 0 && j < right.noRows; j++) {  // Iterates over the columns of right
+            const struct ROW_SUMMARY* rightRow = &args->rightSummaries[j];
+            if (!rows_may_intersect(leftRow, rightRow)) {
+                continue;  // no common column, the entry is 0
             }
+            float sum = args->kernel->func(&left.values[i * left.maxNoNonZero], &left.indices[i * left.maxNoNonZero],
+                                           leftRow->length, &right.values[j * right.maxNoNonZero],
+                                           &right.indices[j * right.maxNoNonZero], rightRow->length);
 
             // set value of result to calculated product
             if (sum != 0.0) {
@@ -154,8 +326,44 @@ void matr_mult_ellpack_V2(const void* a, const void* b, void* res) {
             result.indices[resultPos] = 0;
         }
     }
-    free(right.values);
-    free(right.indices);
+}
+
+/// @brief third version, working on transposed right matrix for better cache compatibility: every entry is the sparse
+/// dot product of a row of left and a row of the transposed right matrix (SIMD intersection kernel), pairs of rows
+/// whose column ranges or 64 column blocks do not overlap are skipped; the rows of left are split evenly across
+/// noThreads threads
+void matr_mult_ellpack_V2(const void* a, const void* b, void* res) {
+    const struct ELLPACK left = *(struct ELLPACK*)a;
+    struct ELLPACK right = *(struct ELLPACK*)b;
+    validate_inputs(left, right);
+    struct ELLPACK result;
+    result = initialize_result(left, right, result);
+    if ((*(struct ELLPACK*)a).maxNoNonZero == 0 || (*(struct ELLPACK*)b).maxNoNonZero == 0) {
+        *(struct ELLPACK*)res = result;
+        return;
+    }
+    right = transpose_parallel(right);
+    struct ROW_SUMMARY* leftSummaries = row_summaries(left);
+    struct ROW_SUMMARY* rightSummaries = row_summaries(right);
+    const struct INTERSECT_KERNEL kernel = intersect_kernel(left.noCols);
+
+    /* -------------------- calculation of actual values -------------------- */
+
+    int n = noThreads < 1 ? 1 : noThreads;
+    if ((uint64_t)n > left.noRows) {
+        n = left.noRows < 1 ? 1 : left.noRows;
+    }
+    struct INNER_PRODUCT_ARGS args = {.left = &left,
+                                      .right = &right,
+                                      .result = &result,
+                                      .leftSummaries = leftSummaries,
+                                      .rightSummaries = rightSummaries,
+                                      .kernel = &kernel};
+    parallel_run(n, helper_inner_product_rows, &args);
+
+    scratch_free(rightSummaries);
+    scratch_free(leftSummaries);
+    elpk_free(right);
     *(struct ELLPACK*)res = remove_unnecessary_padding(result);
 }
 
@@ -194,49 +402,124 @@ void matr_mult_ellpack_V3(const void* a, const void* b, void* res) {
             result.indices[resultPos] = 0;
         }
     }
-    free(left.values);
-    free(right.values);
+    scratch_free(left.values);
+    scratch_free(right.values);
     *(struct ELLPACK*)res = remove_unnecessary_padding(result);
 }
 
-/// @brief fifth version, optimized for fast almost-dense matrices multiplication by using SIMD with Intrinsics
+/// @brief fifth version, optimized for fast almost-dense matrices multiplication by using SIMD with Intrinsics (SSE4.1,
+/// AVX2 or AVX-512, chosen at startup, see simd.h): both operands are packed into panels and multiplied by a
+/// register-blocked, cache-tiled microkernel on noThreads threads (see gemm.h)
 void matr_mult_ellpack_V4(const void* a, const void* b, void* res) {
-    validate_inputs(*(struct ELLPACK*)a, *(struct ELLPACK*)b);
+    const struct ELLPACK leftEllpack = *(struct ELLPACK*)a;
+    const struct ELLPACK rightEllpack = *(struct ELLPACK*)b;
+    validate_inputs(leftEllpack, rightEllpack);
     struct ELLPACK result;
-    result = initialize_result(*(struct ELLPACK*)a, *(struct ELLPACK*)b, result);
-    if ((*(struct ELLPACK*)a).maxNoNonZero == 0 || (*(struct ELLPACK*)b).maxNoNonZero == 0) {
-        *(struct ELLPACK*)res = result;
+    if (leftEllpack.maxNoNonZero == 0 || rightEllpack.maxNoNonZero == 0) {
+        *(struct ELLPACK*)res = initialize_result(leftEllpack, rightEllpack, result);
         return;
     }
-    const struct ELLPACK transposedRight = transpose(*(struct ELLPACK*)b);
-    const struct DENSE_MATRIX denseLeft = to_dense(*(struct ELLPACK*)a);
-    const struct DENSE_MATRIX denseRight = to_dense(transposedRight);
-    const struct DENSE_MATRIX_XMM left = to_XMM(denseLeft);
-    const struct DENSE_MATRIX_XMM right = to_XMM(denseRight);
-    free(transposedRight.values);
-    free(transposedRight.indices);
-    free(denseLeft.values);
-    free(denseRight.values);
-    uint64_t resultPos = 0;  // pointer to next position to insert a value into result matrix
+    // the symbolic phase would cost as much as the multiplication itself, the result is compacted afterwards instead
+    result.noRows = leftEllpack.noRows;
+    result.noCols = rightEllpack.noCols;
+    result.maxNoNonZero = leftEllpack.maxNoNonZero * rightEllpack.maxNoNonZero;
+    result.maxNoNonZero = result.maxNoNonZero < result.noCols ? result.maxNoNonZero : result.noCols;
+    elpk_alloc(&result);
+
+    // the entries are scattered straight into the panels, no dense or transposed copy is made
+    const struct GEMM_KERNEL kernel = gemm_kernel();
+    const struct PACKED_MATRIX left = pack_rows(leftEllpack, kernel.mr);
+    const struct PACKED_MATRIX right = pack_cols(rightEllpack, kernel.nr);
 
     /* -------------------- calculation of actual values -------------------- */
 
-    for (uint64_t i = 0; i < left.noRows; i++) {       // Iterates over the rows of left
-        for (uint64_t j = 0; j < right.noRows; j++) {  // Iterates over the columns in the right matrix
-            __m128 sum = _mm_setzero_ps();             // accumulator for an entry in result
+    gemm_ellpack(left, right, kernel, result);
+    packed_free(left);
+    packed_free(right);
+    *(struct ELLPACK*)res = remove_unnecessary_padding(result);
+}
 
-            for (uint64_t k = 0; k < left.noQuadCols; k++) {
-                sum += left.values[i * left.noQuadCols + k] * right.values[j * right.noQuadCols + k];
+/// @brief cursor of the k-way merge of V5: walks one row of right scaled by an entry of left
+struct MERGE_CURSOR {
+    uint64_t col;    // column of the current entry (heap key)
+    uint64_t pos;    // position of the current entry in right
+    uint64_t end;    // end of the row without trailing padding
+    float leftValue;
+};
+
+/// @brief helper: restores the min-heap property (by column) below position k
+__attribute__((always_inline)) static inline void helper_sift_down(struct MERGE_CURSOR* heap, uint64_t size,
+                                                                   uint64_t k) {
+    const struct MERGE_CURSOR cursor = heap[k];
+    for (uint64_t child = 2 * k + 1; child < size; child = 2 * k + 1) {
+        if (child + 1 < size && heap[child + 1].col < heap[child].col) {
+            child++;
+        }
+        if (heap[child].col >= cursor.col) {
+            break;
+        }
+        heap[k] = heap[child];
+        k = child;
+    }
+    heap[k] = cursor;
+}
+
+/// @brief computes the rows of one thread of V5: merges the referenced rows of right with a min-heap of cursors
+static void helper_merge_rows(int id, int n, void* p) {
+    (void)n;
+    const struct GUSTAVSON_ARGS* args = (struct GUSTAVSON_ARGS*)p;
+    const struct ELLPACK left = *args->left;
+    const struct ELLPACK right = *args->right;
+    struct ELLPACK result = *args->result;
+    uint64_t maxNnz = 0;
+    // one cursor per non-zero entry of a row of left
+    struct MERGE_CURSOR* heap = (struct MERGE_CURSOR*)scratch_alloc(left.maxNoNonZero * sizeof(struct MERGE_CURSOR));
+
+    for (uint64_t i = args->rowBounds[id]; i < args->rowBounds[id + 1]; i++) {  // Iterates over the rows of left
+        uint64_t size = 0;
+        for (uint64_t j = i * left.maxNoNonZero; j < (i + 1) * left.maxNoNonZero; j++) {
+            uint64_t leftColRightRow = left.indices[j];
+            if (left.values[j] == 0.f || args->rightRowLength[leftColRightRow] == 0) {
+                continue;  // padding or empty row of right, nothing to merge
             }
+            uint64_t rightRowStart = leftColRightRow * right.maxNoNonZero;
+            heap[size++] = (struct MERGE_CURSOR){.col = right.indices[rightRowStart],
+                                                 .pos = rightRowStart,
+                                                 .end = rightRowStart + args->rightRowLength[leftColRightRow],
+                                                 .leftValue = left.values[j]};
+        }
+        for (uint64_t k = size / 2; k-- > 0;) {
+            helper_sift_down(heap, size, k);
+        }
 
-            sum = _mm_hadd_ps(sum, sum);
-            sum = _mm_hadd_ps(sum, sum);
-            float fsum = _mm_cvtss_f32(sum);
-            // set value of result to calculated product
-            if (fsum != 0.0) {
-                result.indices[resultPos] = j;
-                result.values[resultPos++] = fsum;
+        // the cursors are popped in ascending column order, so every column is finished when the next one appears
+        uint64_t resultPos = i * result.maxNoNonZero;  // pointer to next position to insert a value into result
+        uint64_t col = size > 0 ? heap[0].col : 0;
+        float sum = 0.f;
+        while (size > 0) {
+            struct MERGE_CURSOR* top = &heap[0];
+            if (top->col != col) {
+                if (sum != 0.f) {
+                    result.indices[resultPos] = col;
+                    result.values[resultPos++] = sum;
+                }
+                col = top->col;
+                sum = 0.f;
+            }
+            sum += top->leftValue * right.values[top->pos];
+            if (++top->pos < top->end) {
+                top->col = right.indices[top->pos];
+            } else {
+                heap[0] = heap[--size];  // row of right exhausted
             }
+            helper_sift_down(heap, size, 0);
+        }
+        if (sum != 0.f) {
+            result.indices[resultPos] = col;
+            result.values[resultPos++] = sum;
+        }
+        if (resultPos - i * result.maxNoNonZero > maxNnz) {
+            maxNnz = resultPos - i * result.maxNoNonZero;
         }
         // add padding
         for (; resultPos < (i + 1) * result.maxNoNonZero; resultPos++) {
@@ -244,12 +527,13 @@ void matr_mult_ellpack_V4(const void* a, const void* b, void* res) {
             result.indices[resultPos] = 0;
         }
     }
-    free(left.values);
-    free(right.values);
-    *(struct ELLPACK*)res = remove_unnecessary_padding(result);
+    args->threadMaxNnz[id] = maxNnz;
+    scratch_free(heap);
 }
 
-/// @brief sixth version, reduced seach cost on normal Ellpack matrices
+/// @brief sixth version, column-merge: every row of the result is a k-way merge of the rows of right referenced by the
+/// row of left (min-heap of cursors keyed by column), so the entries come out sorted without a dense accumulator;
+/// the rows of left are split between noThreads threads by their flops like in the main version
 void matr_mult_ellpack_V5(const void* a, const void* b, void* res) {
     const struct ELLPACK left = *(struct ELLPACK*)a;
     const struct ELLPACK right = *(struct ELLPACK*)b;
@@ -260,58 +544,308 @@ void matr_mult_ellpack_V5(const void* a, const void* b, void* res) {
         *(struct ELLPACK*)res = result;
         return;
     }
-    // stores the index of the next entry to look at in the right matrix
-    uint64_t* nextRowEntry = (uint64_t*)abortIfNULL(malloc(right.noRows * sizeof(uint64_t)));
-    // stores the indices where to enter a value into result matrix for every row
-    uint64_t* resultRowPointers = (uint64_t*)abortIfNULL(malloc(result.noRows * sizeof(uint64_t)));
+    uint64_t* rightRowLength = helper_row_lengths(right);
+    uint64_t rowBounds[(noThreads < 1 ? 1 : noThreads) + 1];
+    int n = helper_flop_partition(left, rightRowLength, rowBounds);
+    uint64_t threadMaxNnz[n];
+
+    /* -------------------- calculation of actual values -------------------- */
+
+    struct GUSTAVSON_ARGS args = {.left = &left,
+                                  .right = &right,
+                                  .result = &result,
+                                  .rightRowLength = rightRowLength,
+                                  .rowBounds = rowBounds,
+                                  .threadMaxNnz = threadMaxNnz};
+    parallel_run(n, helper_merge_rows, &args);
+    scratch_free(rightRowLength);
+
+    uint64_t maxNnz = 0;
+    for (int t = 0; t < n; t++) {
+        maxNnz = threadMaxNnz[t] > maxNnz ? threadMaxNnz[t] : maxNnz;
+    }
+    // as in the main version: only compact if products cancelled each other out
+    *(struct ELLPACK*)res = maxNnz == result.maxNoNonZero ? result : remove_unnecessary_padding(result);
+}
+
+/// @brief arguments shared by all threads of the SELL-C-sigma version
+struct SELL_GUSTAVSON_ARGS {
+    const struct SELL* left;
+    const struct SELL* right;
+    struct ELLPACK* result;
+    const uint64_t* chunkBounds;  // chunks of left of thread t are [chunkBounds[t], chunkBounds[t + 1])
+    uint64_t* rowNnz;             // symbolic phase: number of non-zero entries of every result row (original order)
+    uint64_t* threadMaxNnz;       // numeric phase: largest number of non-zero entries in a row, per thread
+};
+
+/// @brief adds the products of the row of left in slot s with right to sum; only the touched columns are recorded
+/// if symbolic is set
+__attribute__((always_inline)) static inline void helper_sell_row(struct ACCUMULATOR* sum, const struct SELL* left,
+                                                                   uint64_t s, const struct SELL* right,
+                                                                   const bool symbolic) {
+    const uint64_t leftC = left->chunkSize;
+    const uint64_t rightC = right->chunkSize;
+    const uint64_t leftStart = left->chunkStart[s / leftC] + s % leftC;
+    for (uint64_t j = 0; j < left->rowLength[s]; j++) {  // Iterates over the row of left, padding is not stored
+        float leftValue = left->values[leftStart + j * leftC];
+        if (leftValue == 0.f) {
+            continue;
+        }
+        // slot of the row of right for which left has a non-zero entry
+        uint64_t rightSlot = right->slotOf[left->indices[leftStart + j * leftC]];
+        uint64_t rightStart = right->chunkStart[rightSlot / rightC] + rightSlot % rightC;
+        for (uint64_t k = 0; k < right->rowLength[rightSlot]; k++) {
+            uint64_t rightPos = rightStart + k * rightC;
+            if (symbolic) {
+                if (right->values[rightPos] != 0.f) {
+                    acc_add(sum, right->indices[rightPos], 0.f);
+                }
+            } else {
+                acc_add(sum, right->indices[rightPos], leftValue * right->values[rightPos]);
+            }
+        }
+    }
+}
+
+/// @brief counts the non-zero entries of the result rows of the chunks of one thread
+static void helper_sell_symbolic_chunks(int id, int n, void* p) {
+    (void)n;
+    const struct SELL_GUSTAVSON_ARGS* args = (struct SELL_GUSTAVSON_ARGS*)p;
+    const struct SELL* left = args->left;
+    struct ACCUMULATOR columns = acc_init(args->right->noCols, 64);
+
+    for (uint64_t s = args->chunkBounds[id] * left->chunkSize;
+         s < args->chunkBounds[id + 1] * left->chunkSize && s < left->noRows; s++) {
+        helper_sell_row(&columns, left, s, args->right, true);
+        args->rowNnz[left->rowOf[s]] = acc_clear(&columns);
+    }
+    acc_free(columns);
+}
+
+/// @brief computes the result rows of the chunks of one thread, rows are written to their original position
+static void helper_sell_gustavson_chunks(int id, int n, void* p) {
+    (void)n;
+    const struct SELL_GUSTAVSON_ARGS* args = (struct SELL_GUSTAVSON_ARGS*)p;
+    const struct SELL* left = args->left;
+    struct ELLPACK result = *args->result;
+    uint64_t maxNnz = 0;
+    struct ACCUMULATOR sum = acc_init(args->right->noCols, result.maxNoNonZero);
+
+    for (uint64_t s = args->chunkBounds[id] * left->chunkSize;
+         s < args->chunkBounds[id + 1] * left->chunkSize && s < left->noRows; s++) {
+        helper_sell_row(&sum, left, s, args->right, false);
+        // set the values of result to calculated products (sorted by column)
+        uint64_t resultPos = left->rowOf[s] * result.maxNoNonZero;
+        uint64_t rowNnz = acc_flush(&sum, &result.indices[resultPos], &result.values[resultPos]);
+        maxNnz = rowNnz > maxNnz ? rowNnz : maxNnz;
+        // add padding
+        for (uint64_t j = resultPos + rowNnz; j < resultPos + result.maxNoNonZero; j++) {
+            result.values[j] = 0.f;
+            result.indices[j] = 0;
+        }
+    }
+    args->threadMaxNnz[id] = maxNnz;
+    acc_free(sum);
+}
+
+/// @brief seventh version, main version on SELL-C-sigma copies of both matrices: no padding is stored or visited,
+/// the chunks of left are split between noThreads threads so that every thread gets about the same number of flops
+void matr_mult_ellpack_V6(const void* a, const void* b, void* res) {
+    const struct ELLPACK leftEllpack = *(struct ELLPACK*)a;
+    const struct ELLPACK rightEllpack = *(struct ELLPACK*)b;
+    validate_inputs(leftEllpack, rightEllpack);
+    struct ELLPACK result;
+    if (leftEllpack.maxNoNonZero == 0 || rightEllpack.maxNoNonZero == 0) {
+        *(struct ELLPACK*)res = initialize_result(leftEllpack, rightEllpack, result);
+        return;
+    }
+    const struct SELL left = sell_from_ellpack(leftEllpack, SELL_CHUNK_SIZE, SELL_SIGMA);
+    const struct SELL right = sell_from_ellpack(rightEllpack, SELL_CHUNK_SIZE, SELL_SIGMA);
+    result.noRows = left.noRows;
+    result.noCols = right.noCols;
 
-    for (uint64_t i = 0; i < right.noRows; i++) {  // initialize all values to point to the first entry in each row
-        nextRowEntry[i] = i * right.maxNoNonZero;
+    // prefix sum of the flops of every chunk of left (+1 per row for writing the result row)
+    int n = noThreads < 1 ? 1 : noThreads;
+    if ((uint64_t)n > left.noChunks) {
+        n = left.noChunks < 1 ? 1 : left.noChunks;
+    }
+    uint64_t* flopPrefix = (uint64_t*)scratch_alloc((left.noChunks + 1) * sizeof(uint64_t));
+    flopPrefix[0] = 0;
+    for (uint64_t c = 0; c < left.noChunks; c++) {
+        uint64_t flops = left.chunkSize;
+        for (uint64_t j = left.chunkStart[c]; j < left.chunkStart[c + 1]; j++) {
+            if (left.values[j] != 0.f) {
+                flops += right.rowLength[right.slotOf[left.indices[j]]];
+            }
+        }
+        flopPrefix[c + 1] = flopPrefix[c] + flops;
     }
-    for (uint64_t i = 0; i < result.noRows; i++) {  // initialize all values to point to the first entry in each row
-        resultRowPointers[i] = i * result.maxNoNonZero;
+    uint64_t chunkBounds[n + 1];
+    partition_rows(flopPrefix, left.noChunks, n, chunkBounds);
+    scratch_free(flopPrefix);
+
+    /* -------------------- symbolic phase -------------------- */
+
+    uint64_t* rowNnz = (uint64_t*)scratch_calloc((left.noRows + 1) * sizeof(uint64_t));
+    uint64_t threadMaxNnz[n];
+    struct SELL_GUSTAVSON_ARGS args = {.left = &left,
+                                       .right = &right,
+                                       .result = &result,
+                                       .chunkBounds = chunkBounds,
+                                       .rowNnz = rowNnz,
+                                       .threadMaxNnz = threadMaxNnz};
+    parallel_run(n, helper_sell_symbolic_chunks, &args);
+    result.maxNoNonZero = 0;
+    for (uint64_t i = 0; i < result.noRows; i++) {
+        result.maxNoNonZero = rowNnz[i] > result.maxNoNonZero ? rowNnz[i] : result.maxNoNonZero;
     }
+    scratch_free(rowNnz);
+    elpk_alloc(&result);
+
     /* -------------------- calculation of actual values -------------------- */
 
-    for (uint64_t i = 0; i < right.noCols; i++) {  // Iterates over the columns of the right matrix
-        // update pointers to the next index greater or equal to the current i (right column index)
-        for (uint64_t j = 0; j < right.noRows; j++) {
-            while (nextRowEntry[j] < (j + 1) * right.maxNoNonZero - 1 && right.indices[nextRowEntry[j]] < i) {
-                nextRowEntry[j] += 1;
+    parallel_run(n, helper_sell_gustavson_chunks, &args);
+    sell_free(left);
+    sell_free(right);
+
+    uint64_t maxNnz = 0;
+    for (int t = 0; t < n; t++) {
+        maxNnz = threadMaxNnz[t] > maxNnz ? threadMaxNnz[t] : maxNnz;
+    }
+    // the symbolic phase is exact unless products cancelled each other out, only then the result has to be compacted
+    *(struct ELLPACK*)res = maxNnz == result.maxNoNonZero ? result : remove_unnecessary_padding(result);
+}
+
+/// @brief computes the rows of one thread of V7 in blocks of at most ESC_BLOCK_TUPLES products (or one longer row)
+static void helper_esc_rows(int id, int n, void* p) {
+    (void)n;
+    const struct GUSTAVSON_ARGS* args = (struct GUSTAVSON_ARGS*)p;
+    const struct ELLPACK left = *args->left;
+    const struct ELLPACK right = *args->right;
+    struct ELLPACK result = *args->result;
+    const uint64_t firstRow = args->rowBounds[id];
+    const uint64_t lastRow = args->rowBounds[id + 1];
+    uint64_t maxNnz = 0;
+
+    // number of products of every row, the longest row decides the size of the buffers
+    uint64_t* rowFlops = (uint64_t*)scratch_alloc((lastRow - firstRow + 1) * sizeof(uint64_t));
+    uint64_t capacity = ESC_BLOCK_TUPLES;
+    for (uint64_t i = firstRow; i < lastRow; i++) {
+        uint64_t flops = 0;
+        for (uint64_t j = i * left.maxNoNonZero; j < (i + 1) * left.maxNoNonZero; j++) {
+            if (left.values[j] != 0.f) {
+                flops += args->rightRowLength[left.indices[j]];
             }
         }
+        rowFlops[i - firstRow] = flops;
+        capacity = flops > capacity ? flops : capacity;
+    }
+    uint64_t* keys = (uint64_t*)scratch_alloc(2 * capacity * sizeof(uint64_t));
+    float* values = (float*)scratch_alloc(2 * capacity * sizeof(float));
 
-        for (uint64_t j = 0; j < left.noRows; j++) {  // Iterates over the rows of left
+    // key of a product: row in the block above the column, so sorting the keys sorts by row, then by column
+    const unsigned colBits = right.noCols > 1 ? 64 - __builtin_clzll(right.noCols - 1) : 1;
+    const uint64_t colMask = colBits == 64 ? UINT64_MAX : (1ull << colBits) - 1;
+    const uint64_t maxBlockRows = 1ull << (colBits + ESC_BLOCK_ROW_BITS <= 64 ? ESC_BLOCK_ROW_BITS : 64 - colBits);
 
-            float sum = 0.f;                                    // accumulator for an entry in result
-            for (uint64_t k = 0; k < left.maxNoNonZero; k++) {  // Iterates over a row of left
+    for (uint64_t blockStart = firstRow; blockStart < lastRow;) {
+        /* ---------- expand: all products of the rows of the block ---------- */
+        uint64_t blockEnd = blockStart;
+        uint64_t noTuples = 0;
+        do {
+            noTuples += rowFlops[blockEnd++ - firstRow];
+        } while (blockEnd < lastRow && blockEnd - blockStart < maxBlockRows &&
+                 noTuples + rowFlops[blockEnd - firstRow] <= capacity);
 
-                // leftColRightRow is the column index of the left and row index of the right matrix
-                uint64_t leftColRightRow = left.indices[j * left.maxNoNonZero + k];
+        uint64_t t = 0;
+        for (uint64_t i = blockStart; i < blockEnd; i++) {
+            const uint64_t rowKey = colBits == 64 ? 0 : (i - blockStart) << colBits;
+            for (uint64_t j = i * left.maxNoNonZero; j < (i + 1) * left.maxNoNonZero; j++) {
+                if (left.values[j] == 0.f) {  // padding does not contribute
+                    continue;
+                }
+                uint64_t rightRowStart = left.indices[j] * right.maxNoNonZero;
+                for (uint64_t k = rightRowStart; k < rightRowStart + args->rightRowLength[left.indices[j]]; k++) {
+                    keys[t] = rowKey | right.indices[k];
+                    values[t++] = left.values[j] * right.values[k];
+                }
+            }
+        }
+
+        /* ---------- sort by row and column (stable: equal columns keep the order of the main version) ---------- */
+        const uint64_t blockRows = blockEnd - blockStart;
+        const unsigned rowBits = blockRows > 1 ? 64 - __builtin_clzll(blockRows - 1) : 0;
+        radix_sort_pairs(keys, values, keys + capacity, values + capacity, noTuples, colBits + rowBits);
 
-                // if the next index the row of right is at the current column position: add product to sum
-                if (right.indices[nextRowEntry[leftColRightRow]] == i) {
-                    sum += left.values[j * left.maxNoNonZero + k] * right.values[nextRowEntry[leftColRightRow]];
+        /* ---------- compress: sum up runs of equal keys ---------- */
+        t = 0;
+        for (uint64_t i = blockStart; i < blockEnd; i++) {
+            const uint64_t rowKey = colBits == 64 ? 0 : (i - blockStart) << colBits;
+            uint64_t resultPos = i * result.maxNoNonZero;  // pointer to next position to insert a value into result
+            while (t < noTuples && (keys[t] & ~colMask) == rowKey) {
+                const uint64_t key = keys[t];
+                float sum = 0.f;
+                do {
+                    sum += values[t++];
+                } while (t < noTuples && keys[t] == key);
+                if (sum != 0.f) {
+                    result.indices[resultPos] = key & colMask;
+                    result.values[resultPos++] = sum;
                 }
             }
-            // set the value of result to calculated product
-            if (sum != 0.0) {
-                result.indices[resultRowPointers[j]] = i;
-                result.values[resultRowPointers[j]] = sum;
-                resultRowPointers[j] += 1;
+            if (resultPos - i * result.maxNoNonZero > maxNnz) {
+                maxNnz = resultPos - i * result.maxNoNonZero;
+            }
+            // add padding
+            for (; resultPos < (i + 1) * result.maxNoNonZero; resultPos++) {
+                result.values[resultPos] = 0.f;
+                result.indices[resultPos] = 0;
             }
         }
+        blockStart = blockEnd;
     }
-    // add padding in all rows
-    for (uint64_t i = 0; i < result.noRows; i++) {
-        for (uint64_t j = resultRowPointers[i]; j < (i + 1) * result.maxNoNonZero; j++) {
-            result.indices[j] = 0;
-            result.values[j] = 0.f;
-        }
+    args->threadMaxNnz[id] = maxNnz;
+    scratch_free(values);
+    scratch_free(keys);
+    scratch_free(rowFlops);
+}
+
+/// @brief eighth version, expand-sort-compress (ESC): the products of a block of rows of left are expanded into
+/// (row and column, product) tuples, sorted with an LSD radix sort and runs of equal columns are summed up; no
+/// accumulator is scattered into, which pays off for very wide and very sparse products; the rows of left are split
+/// between noThreads threads by their flops like in the main version
+void matr_mult_ellpack_V7(const void* a, const void* b, void* res) {
+    const struct ELLPACK left = *(struct ELLPACK*)a;
+    const struct ELLPACK right = *(struct ELLPACK*)b;
+    validate_inputs(left, right);
+    struct ELLPACK result;
+    result = initialize_result(left, right, result);
+    if ((*(struct ELLPACK*)a).maxNoNonZero == 0 || (*(struct ELLPACK*)b).maxNoNonZero == 0) {
+        *(struct ELLPACK*)res = result;
+        return;
     }
-    free(resultRowPointers);
-    free(nextRowEntry);
-    *(struct ELLPACK*)res = remove_unnecessary_padding(result);
+    uint64_t* rightRowLength = helper_row_lengths(right);
+    uint64_t rowBounds[(noThreads < 1 ? 1 : noThreads) + 1];
+    int n = helper_flop_partition(left, rightRowLength, rowBounds);
+    uint64_t threadMaxNnz[n];
+
+    /* -------------------- calculation of actual values -------------------- */
+
+    struct GUSTAVSON_ARGS args = {.left = &left,
+                                  .right = &right,
+                                  .result = &result,
+                                  .rightRowLength = rightRowLength,
+                                  .rowBounds = rowBounds,
+                                  .threadMaxNnz = threadMaxNnz};
+    parallel_run(n, helper_esc_rows, &args);
+    scratch_free(rightRowLength);
+
+    uint64_t maxNnz = 0;
+    for (int t = 0; t < n; t++) {
+        maxNnz = threadMaxNnz[t] > maxNnz ? threadMaxNnz[t] : maxNnz;
+    }
+    // as in the main version: only compact if products cancelled each other out
+    *(struct ELLPACK*)res = maxNnz == result.maxNoNonZero ? result : remove_unnecessary_padding(result);
 }
 
 /// @brief check for valid inputs: multiplicable dimensions
@@ -325,7 +859,7 @@ void validate_inputs(struct ELLPACK left, struct ELLPACK right) {
     }
 }
 
-/// @brief initialize the result matrix
+/// @brief initialize the result matrix, its maxNoNonZero is computed exactly by the symbolic phase
 /// @param left left matrix
 /// @param right right matrix
 /// @param result result matrix
@@ -333,18 +867,23 @@ void validate_inputs(struct ELLPACK left, struct ELLPACK right) {
 struct ELLPACK initialize_result(const struct ELLPACK left, const struct ELLPACK right, struct ELLPACK result) {
     result.noRows = left.noRows;
     result.noCols = right.noCols;
-    result.maxNoNonZero = (right.noCols > left.maxNoNonZero * right.maxNoNonZero)
-                              ? left.maxNoNonZero * right.maxNoNonZero
-                              : right.noCols;  // Proven by Pierre that this limit is correct
-    result.values = (float*)abortIfNULL(malloc(result.noRows * result.maxNoNonZero * sizeof(float)));
-    result.indices = (uint64_t*)abortIfNULL(malloc(result.noRows * result.maxNoNonZero * sizeof(uint64_t)));
+    uint64_t* rowNnz = symbolic_row_nnz(left, right);
+    result.maxNoNonZero = 0;
+    for (uint64_t i = 0; i < result.noRows; i++) {
+        if (rowNnz[i] > result.maxNoNonZero) {
+            result.maxNoNonZero = rowNnz[i];
+        }
+    }
+    scratch_free(rowNnz);
+    elpk_alloc(&result);
     return result;
 }
 
-/// @brief remove unnecessary padding in the result matrix and free the unused memory
+/// @brief remove unnecessary padding in the result matrix and free the unused memory (heap results only)
 /// @param result result matrix
 /// @result smaller matrix
 struct ELLPACK remove_unnecessary_padding(struct ELLPACK result) {
+    perf_begin(PHASE_COMPACT);
     uint64_t realResultMaxNoNonZero = 0;
     uint64_t rowCounter;
 
@@ -359,6 +898,10 @@ struct ELLPACK remove_unnecessary_padding(struct ELLPACK result) {
             realResultMaxNoNonZero = rowCounter;
         }
     }
+    if (realResultMaxNoNonZero == result.maxNoNonZero) {  // already exact (see initialize_result), nothing to move
+        perf_end(PHASE_COMPACT);
+        return result;
+    }
 
     uint64_t realResultPointer = 0;
     for (uint64_t i = 0; i < result.noRows; i++) {
@@ -375,63 +918,138 @@ struct ELLPACK remove_unnecessary_padding(struct ELLPACK result) {
         }
     }
     result.maxNoNonZero = realResultMaxNoNonZero;
-    if (result.noRows * result.maxNoNonZero != 0) {
+    if (result.storage == ELPK_HEAP && result.noRows * result.maxNoNonZero != 0) {
         result.values =
             (float*)abortIfNULL(realloc(result.values, result.noRows * result.maxNoNonZero * sizeof(float)));
-        result.indices =
-            (uint64_t*)abortIfNULL(realloc(result.indices, result.noRows * result.maxNoNonZero * sizeof(uint64_t)));
+        result.indices = (elpk_index_t*)abortIfNULL(
+            realloc(result.indices, result.noRows * result.maxNoNonZero * sizeof(elpk_index_t)));
     }
+    perf_end(PHASE_COMPACT);
     return result;
 }
 
-/// @brief transposes the given matrix and returns the result
-struct ELLPACK transpose(const struct ELLPACK matrix) {
-    struct ELLPACK trans;
-    trans.noRows = matrix.noCols;
-    trans.noCols = matrix.noRows;
-    uint64_t max = 0;
-    uint64_t counter;
+/// @brief arguments shared by all threads of a transposition
+struct TRANSPOSE_ARGS {
+    const struct ELLPACK* matrix;
+    struct ELLPACK* trans;
+    uint64_t* offsets;    // n x matrix.noCols: histogram of thread t, then its first free slot in every row of trans
+    uint64_t* rowLength;  // number of entries in every row of trans
+};
+
+/// @brief phase 1: histogram of the column indices in the rows of thread id
+static void helper_transpose_count(int id, int n, void* p) {
+    const struct TRANSPOSE_ARGS* args = (struct TRANSPOSE_ARGS*)p;
+    const struct ELLPACK matrix = *args->matrix;
+    uint64_t* count = &args->offsets[id * matrix.noCols];
     for (uint64_t i = 0; i < matrix.noCols; i++) {
-        counter = 0;
-        for (uint64_t j = 0; j < matrix.noRows * matrix.maxNoNonZero; j++) {
-            if (matrix.indices[j] == i && matrix.values[j] != 0.f) {
-                counter++;
-            }
+        count[i] = 0;
+    }
+    uint64_t first = matrix.noRows * id / n * matrix.maxNoNonZero;
+    uint64_t last = matrix.noRows * (id + 1) / n * matrix.maxNoNonZero;
+    for (uint64_t j = first; j < last; j++) {
+        if (matrix.values[j] != 0.f) {
+            count[matrix.indices[j]]++;
         }
-        if (counter > max) {
-            max = counter;
+    }
+}
+
+/// @brief phase 2: exclusive prefix sum over the threads for the columns of thread id
+static void helper_transpose_prefix(int id, int n, void* p) {
+    const struct TRANSPOSE_ARGS* args = (struct TRANSPOSE_ARGS*)p;
+    uint64_t noCols = args->matrix->noCols;
+    for (uint64_t i = noCols * id / n; i < noCols * (id + 1) / n; i++) {
+        uint64_t sum = 0;
+        for (int t = 0; t < n; t++) {
+            uint64_t count = args->offsets[t * noCols + i];
+            args->offsets[t * noCols + i] = sum;
+            sum += count;
         }
+        args->rowLength[i] = sum;
     }
-    trans.maxNoNonZero = max;
-    trans.values = (float*)abortIfNULL(malloc(trans.noRows * trans.maxNoNonZero * sizeof(float)));
-    trans.indices = (uint64_t*)abortIfNULL(malloc(trans.noRows * trans.maxNoNonZero * sizeof(uint64_t)));
+}
 
-    uint64_t tpointer = 0;
-    uint64_t index;
-    for (uint64_t i = 0; i < matrix.noCols; i++) {
-        for (uint64_t j = 0; j < matrix.noRows; j++) {
-            for (uint64_t k = 0; k < matrix.maxNoNonZero; k++) {
-                index = j * matrix.maxNoNonZero + k;
-                if (matrix.indices[index] == i && matrix.values[index] != 0.f) {
-                    trans.values[tpointer] = matrix.values[index];
-                    trans.indices[tpointer++] = j;
-                }
+/// @brief phase 3: scatters the entries of the rows of thread id into trans, pads the rows (columns) of thread id
+static void helper_transpose_scatter(int id, int n, void* p) {
+    const struct TRANSPOSE_ARGS* args = (struct TRANSPOSE_ARGS*)p;
+    const struct ELLPACK matrix = *args->matrix;
+    const struct ELLPACK trans = *args->trans;
+    uint64_t* offset = &args->offsets[id * matrix.noCols];
+    for (uint64_t j = matrix.noRows * id / n; j < matrix.noRows * (id + 1) / n; j++) {
+        for (uint64_t k = j * matrix.maxNoNonZero; k < (j + 1) * matrix.maxNoNonZero; k++) {
+            if (matrix.values[k] != 0.f) {
+                uint64_t tpointer = matrix.indices[k] * trans.maxNoNonZero + offset[matrix.indices[k]]++;
+                trans.values[tpointer] = matrix.values[k];
+                trans.indices[tpointer] = j;
             }
         }
-        for (; tpointer < (i + 1) * trans.maxNoNonZero; tpointer++) {
+    }
+}
+
+/// @brief phase 4: pads the rows of trans of thread id, offsets of the last thread point behind the last entry
+static void helper_transpose_pad(int id, int n, void* p) {
+    const struct TRANSPOSE_ARGS* args = (struct TRANSPOSE_ARGS*)p;
+    const struct ELLPACK trans = *args->trans;
+    const uint64_t* end = &args->offsets[(n - 1) * trans.noRows];
+    for (uint64_t i = trans.noRows * id / n; i < trans.noRows * (id + 1) / n; i++) {
+        for (uint64_t tpointer = i * trans.maxNoNonZero + end[i]; tpointer < (i + 1) * trans.maxNoNonZero; tpointer++) {
             trans.values[tpointer] = 0.f;
             trans.indices[tpointer] = 0;
         }
     }
+}
+
+/// @brief transposes matrix with a counting sort on n threads: every thread counts the column indices of its rows,
+/// a prefix sum over the threads gives every thread its slots in the rows of trans, then all threads scatter their
+/// entries; O(nnz + n * noCols), n is capped so that the histograms are not larger than the matrix
+static struct ELLPACK helper_transpose(const struct ELLPACK matrix, int n) {
+    struct ELLPACK trans;
+    trans.noRows = matrix.noCols;
+    trans.noCols = matrix.noRows;
+    if (matrix.noRows != 0 && matrix.noRows - 1 > ELPK_INDEX_MAX) {
+        fprintf(stderr, "ERROR: %lu rows do not fit into %d bit indices of the transposed matrix\n", matrix.noRows,
+                INDEX_BITS);
+        exit(EXIT_FAILURE);
+    }
+    if ((uint64_t)n > matrix.noRows) {
+        n = matrix.noRows < 1 ? 1 : matrix.noRows;
+    }
+    // one histogram of noCols counters per thread: wide matrices with few entries per column get fewer threads
+    const uint64_t entriesPerCol = matrix.noCols > 0 ? matrix.noRows * matrix.maxNoNonZero / matrix.noCols : 0;
+    if ((uint64_t)n > entriesPerCol) {
+        n = entriesPerCol < 1 ? 1 : entriesPerCol;
+    }
+    uint64_t* offsets = (uint64_t*)scratch_alloc(n * matrix.noCols * sizeof(uint64_t));
+    uint64_t* rowLength = (uint64_t*)scratch_alloc(trans.noRows * sizeof(uint64_t));
+    struct TRANSPOSE_ARGS args = {.matrix = &matrix, .trans = &trans, .offsets = offsets, .rowLength = rowLength};
+
+    parallel_run(n, helper_transpose_count, &args);
+    parallel_run(n, helper_transpose_prefix, &args);
+
+    trans.maxNoNonZero = 0;
+    for (uint64_t i = 0; i < trans.noRows; i++) {
+        if (rowLength[i] > trans.maxNoNonZero) {
+            trans.maxNoNonZero = rowLength[i];
+        }
+    }
+    elpk_alloc(&trans);
+
+    parallel_run(n, helper_transpose_scatter, &args);
+    parallel_run(n, helper_transpose_pad, &args);
+
+    scratch_free(rowLength);
+    scratch_free(offsets);
     return trans;
 }
 
-/// @brief transforms a sparse matrix of ELLPACK format to a dense matrix and returns it
+/// @brief transposes the given matrix on noThreads threads and returns the result (counting sort, O(nnz + noCols))
+struct ELLPACK transpose_parallel(const struct ELLPACK matrix) { return helper_transpose(matrix, noThreads); }
+
+/// @brief transforms a sparse matrix of ELLPACK format to a dense matrix and returns it (free values with scratch_free)
 struct DENSE_MATRIX to_dense(const struct ELLPACK matrix) {
     struct DENSE_MATRIX result;
     result.noRows = matrix.noRows;
     result.noCols = matrix.noCols;
-    result.values = (float*)abortIfNULL(malloc(result.noRows * result.noCols * sizeof(float)));
+    result.values = (float*)scratch_alloc(result.noRows * result.noCols * sizeof(float));
     for (uint64_t i = 0; i < result.noRows; i++) {
         uint64_t matrixPointer = i * matrix.maxNoNonZero;
         uint64_t matrixPLimit = matrixPointer + matrix.maxNoNonZero;
@@ -446,29 +1064,6 @@ struct DENSE_MATRIX to_dense(const struct ELLPACK matrix) {
     return result;
 }
 
-/// @brief transforms the values of the given dense matrix into XMM float values
-struct DENSE_MATRIX_XMM to_XMM(const struct DENSE_MATRIX matrix) {
-    struct DENSE_MATRIX_XMM result;
-    result.noRows = matrix.noRows;
-    result.noCols = matrix.noCols;
-    uint64_t noQuadCol = (matrix.noCols + 3) / 4;  // (x + 3) / 4 = ceil(x/4)
-    result.noQuadCols = noQuadCol;
-    result.values = (__m128*)abortIfNULL(malloc(result.noRows * noQuadCol * sizeof(__m128)));
-    for (uint64_t i = 0; i < result.noRows; i++) {
-        for (uint64_t j = 0; j < noQuadCol - 1; j++) {
-            result.values[i * noQuadCol + j] =
-                _mm_set_ps(matrix.values[i * matrix.noCols + 4 * j], matrix.values[i * matrix.noCols + 4 * j + 1],
-                           matrix.values[i * matrix.noCols + 4 * j + 2], matrix.values[i * matrix.noCols + 4 * j + 3]);
-        }
-        float f1 = matrix.values[i * matrix.noCols + 4 * noQuadCol - 4];
-        float f2 = (4 * noQuadCol - 3 >= matrix.noCols) ? 0.f : matrix.values[i * matrix.noCols + 4 * noQuadCol - 3];
-        float f3 = (4 * noQuadCol - 2 >= matrix.noCols) ? 0.f : matrix.values[i * matrix.noCols + 4 * noQuadCol - 2];
-        float f4 = (4 * noQuadCol - 1 >= matrix.noCols) ? 0.f : matrix.values[i * matrix.noCols + 4 * noQuadCol - 1];
-        result.values[i * noQuadCol + noQuadCol - 1] = _mm_set_ps(f1, f2, f3, f4);
-    }
-    return result;
-}
-
 #ifdef DEBUG
 /// @brief output debug information
 /// @param left left matrix
@@ -504,30 +1099,10 @@ void debug_info_single(char c, struct ELLPACK matrix) {
     }
     pdebug_("\n");
     for (uint64_t i = 0; i < matrix.noRows * matrix.maxNoNonZero; i++) {
-        pdebug_("%lu, ", matrix.indices[i]);
+        pdebug_("%lu, ", (uint64_t)matrix.indices[i]);
     }
     pdebug_("\n");
 }
-
-/// @brief output debug information of a XMM matrix
-/// @param matrix the matrix to debug
-void debug_XMM(struct DENSE_MATRIX_XMM matrix) {
-    pdebug("%lu, %lu, %lu\n", matrix.noRows, matrix.noCols, matrix.noQuadCols);
-    for (uint64_t i = 0; i < matrix.noRows; i++) {
-        for (uint64_t j = 0; j < matrix.noQuadCols; j++) {
-            __m128 value = matrix.values[i * matrix.noQuadCols + j];
-            float f1 = _mm_cvtss_f32(value);
-            value = _mm_castsi128_ps(_mm_srli_si128(_mm_castps_si128(value), 4));
-            float f2 = _mm_cvtss_f32(value);
-            value = _mm_castsi128_ps(_mm_srli_si128(_mm_castps_si128(value), 4));
-            float f3 = _mm_cvtss_f32(value);
-            value = _mm_castsi128_ps(_mm_srli_si128(_mm_castps_si128(value), 4));
-            float f4 = _mm_cvtss_f32(value);
-            pdebug("%f, %f, %f, %f, ", f4, f3, f2, f1);
-        }
-        pdebug_("\n");
-    }
-}
 #endif
 
 /*
@@ -1,7 +1,13 @@
 #ifndef GUARD_MULT
 #define GUARD_MULT
 
-#define MAX_IMPL_VERSION 5
+#define MAX_IMPL_VERSION 7
+
+// products V7 expands, sorts and compresses at once (the buffers stay in the L2 cache), rows longer than this are a
+// block of their own
+#define ESC_BLOCK_TUPLES (1ul << 16)
+// bits of the row in a block in the sort keys of V7, a block has at most 2^ESC_BLOCK_ROW_BITS rows
+#define ESC_BLOCK_ROW_BITS 16
 
 #include "ellpack.h"
 
@@ -11,47 +17,76 @@
 /// @param res Pointer to result of multiplication
 void matr_mult_ellpack_V1(const void* a, const void* b, void* res);
 
-/// @brief first and main version, optimized seach for corresponding value in right matrix compared to second version
+/// @brief first and main version, optimized seach for corresponding value in right matrix compared to second version;
+/// the rows of left are split between noThreads threads so that every thread gets about the same number of flops;
+/// left and right may have any value type (half.h), the result is float
 void matr_mult_ellpack(const void* a, const void* b, void* res);
 
-/// @brief third version, working on transposed right matrix for better cache compatibility,
+/// @brief third version, working on transposed right matrix for better cache compatibility: every entry is the sparse
+/// dot product of a row of left and a row of the transposed right matrix (SIMD intersection kernel), pairs of rows
+/// whose column ranges or 64 column blocks do not overlap are skipped; the rows of left are split evenly across
+/// noThreads threads
 void matr_mult_ellpack_V2(const void* a, const void* b, void* res);
 
 /// @brief fourth version, working on a dense matrix, for almost dense matrices more memory efficient and simpler
 void matr_mult_ellpack_V3(const void* a, const void* b, void* res);
 
-/// @brief fifth version, optimized for fast almost-dense matrices multiplication by using SIMD with Intrinsics
+/// @brief fifth version, optimized for fast almost-dense matrices multiplication by using SIMD with Intrinsics (SSE4.1,
+/// AVX2 or AVX-512, chosen at startup, see simd.h): register-blocked, cache-tiled microkernel on packed panels
 void matr_mult_ellpack_V4(const void* a, const void* b, void* res);
 
-/// @brief sixth version, reduced seach cost on normal Ellpack matrices
+/// @brief sixth version, column-merge: every row of the result is a k-way merge of the rows of right referenced by the
+/// row of left (min-heap of cursors keyed by column), so the entries come out sorted without a dense accumulator;
+/// the rows of left are split between noThreads threads by their flops like in the main version
 void matr_mult_ellpack_V5(const void* a, const void* b, void* res);
 
+/// @brief seventh version, main version on SELL-C-sigma copies of both matrices (sliced ELLPACK, see sell.h): no
+/// padding is stored or visited, which helps inputs with a few very long rows
+void matr_mult_ellpack_V6(const void* a, const void* b, void* res);
+
+/// @brief eighth version, expand-sort-compress (ESC): the products of a block of rows of left are expanded into
+/// (row and column, product) tuples, sorted with an LSD radix sort and runs of equal columns are summed up; no
+/// accumulator is scattered into, which pays off for very wide and very sparse products; the rows of left are split
+/// between noThreads threads by their flops like in the main version
+void matr_mult_ellpack_V7(const void* a, const void* b, void* res);
+
 /// @brief check for valid inputs: multiplicable dimensions
 /// @param left left matrix
 /// @param right right matrix
 void validate_inputs(struct ELLPACK left, struct ELLPACK right);
 
-/// @brief initialize the result matrix
+/// @brief symbolic phase: computes the exact number of non-zero entries of every row of left * right (assuming no
+/// products cancel each other out)
+/// @param left left matrix
+/// @param right right matrix
+/// @return array with left.noRows entries, has to be freed by the caller with scratch_free
+uint64_t* symbolic_row_nnz(const struct ELLPACK left, const struct ELLPACK right);
+
+/// @brief number of multiplications of left * right: products of non-zero entries of left with the entries of the
+/// referenced rows of right
+/// @param left left matrix
+/// @param right right matrix
+/// @return number of multiplications
+uint64_t count_multiplications(const struct ELLPACK left, const struct ELLPACK right);
+
+/// @brief initialize the result matrix, its maxNoNonZero is computed exactly by the symbolic phase
 /// @param left left matrix
 /// @param right right matrix
 /// @param result result matrix
 /// @result initialized result matrix
 struct ELLPACK initialize_result(const struct ELLPACK left, const struct ELLPACK right, struct ELLPACK result);
 
-/// @brief remove unnecessary padding in the result matrix and free the unused memory
+/// @brief remove unnecessary padding in the result matrix and free the unused memory (heap results only)
 /// @param result result matrix
 /// @result smaller matrix
 struct ELLPACK remove_unnecessary_padding(struct ELLPACK result);
 
-/// @brief transposes the given matrix and returns the result
-struct ELLPACK transpose(const struct ELLPACK matrix);
+/// @brief transposes the given matrix on noThreads threads and returns the result (counting sort, O(nnz + noCols))
+struct ELLPACK transpose_parallel(const struct ELLPACK matrix);
 
-/// @brief transforms a sparse matrix of ELLPACK format to a dense matrix and returns it
+/// @brief transforms a sparse matrix of ELLPACK format to a dense matrix and returns it (free values with scratch_free)
 struct DENSE_MATRIX to_dense(const struct ELLPACK matrix);
 
-/// @brief transforms the values of the given dense matrix into XMM float values
-struct DENSE_MATRIX_XMM to_XMM(const struct DENSE_MATRIX matrix);
-
 #ifdef DEBUG
 /// @brief output debug information
 /// @param left left matrix
@@ -63,10 +98,6 @@ void debug_info(struct ELLPACK left, struct ELLPACK right, struct ELLPACK result
 /// @param c name of matrix: 'l' -> "left"; 'r' -> "right"; 'o' -> "result"; everything else -> "matrix"
 /// @param matrix matrix to output
 void debug_info_single(char c, struct ELLPACK matrix);
-
-/// @brief output debug information of a XMM matrix
-/// @param matrix the matrix to debug
-void debug_XMM(struct DENSE_MATRIX_XMM matrix);
 #endif
 
 #endif
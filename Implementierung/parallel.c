@@ -0,0 +1,81 @@
+#include "parallel.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "util.h"
+
+int noThreads = 1;
+
+struct THREAD_ARGS {
+    int id;
+    int n;
+    void (*func)(int id, int n, void* args);
+    void* args;
+};
+
+/// @brief pthread entry point, unpacks THREAD_ARGS
+static void* helper_thread_start(void* p) {
+    struct THREAD_ARGS* t = (struct THREAD_ARGS*)p;
+    t->func(t->id, t->n, t->args);
+    return NULL;
+}
+
+/// @brief returns the number of online cpus (at least 1)
+int default_thread_count(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n < 1 ? 1 : (int)n;
+}
+
+/// @brief runs func(id, n, args) on n threads, id 0 is executed by the calling thread; returns after all finished
+/// @param n number of threads
+/// @param func function executed by every thread
+/// @param args pointer passed to every thread
+void parallel_run(int n, void (*func)(int id, int n, void* args), void* args) {
+    if (n <= 1) {
+        func(0, 1, args);
+        return;
+    }
+    pthread_t threads[n];
+    struct THREAD_ARGS targs[n];
+
+    for (int i = 0; i < n; i++) {
+        targs[i] = (struct THREAD_ARGS){.id = i, .n = n, .func = func, .args = args};
+    }
+    for (int i = 1; i < n; i++) {
+        if (pthread_create(&threads[i], NULL, helper_thread_start, &targs[i]) != 0) {
+            abortIfNULL_msg(0, "could not create thread");
+        }
+    }
+    func(0, n, args);
+    for (int i = 1; i < n; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+/// @brief splits rows into n consecutive ranges with roughly equal cost
+/// @param prefix inclusive prefix sum of the row costs, prefix[0] = 0, prefix[i + 1] = cost of rows 0..i
+/// @param noRows number of rows
+/// @param n number of ranges
+/// @param bounds output: n + 1 row bounds, range t is [bounds[t], bounds[t + 1])
+void partition_rows(const uint64_t* prefix, uint64_t noRows, int n, uint64_t* bounds) {
+    uint64_t total = prefix[noRows];
+    bounds[0] = 0;
+    for (int t = 1; t < n; t++) {
+        // first row whose prefix reaches the t-th share of the total cost (binary search)
+        uint64_t target = (uint64_t)((double)total * t / n);
+        uint64_t lo = bounds[t - 1], hi = noRows;
+        while (lo < hi) {
+            uint64_t mid = lo + (hi - lo) / 2;
+            if (prefix[mid] < target) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        bounds[t] = lo;
+    }
+    bounds[n] = noRows;
+}
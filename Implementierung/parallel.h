@@ -0,0 +1,25 @@
+#ifndef GUARD_PARALLEL
+#define GUARD_PARALLEL
+
+#include <stdint.h>
+
+/// @brief number of threads used by the parallel kernels (set with -j, defaults to the number of online cpus)
+extern int noThreads;
+
+/// @brief returns the number of online cpus (at least 1)
+int default_thread_count(void);
+
+/// @brief runs func(id, n, args) on n threads, id 0 is executed by the calling thread; returns after all finished
+/// @param n number of threads
+/// @param func function executed by every thread
+/// @param args pointer passed to every thread
+void parallel_run(int n, void (*func)(int id, int n, void* args), void* args);
+
+/// @brief splits rows into n consecutive ranges with roughly equal cost
+/// @param prefix inclusive prefix sum of the row costs, prefix[0] = 0, prefix[i + 1] = cost of rows 0..i
+/// @param noRows number of rows
+/// @param n number of ranges
+/// @param bounds output: n + 1 row bounds, range t is [bounds[t], bounds[t + 1])
+void partition_rows(const uint64_t* prefix, uint64_t noRows, int n, uint64_t* bounds);
+
+#endif
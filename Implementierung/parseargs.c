@@ -3,15 +3,19 @@
 #include <errno.h>
 #include <getopt.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "autoselect.h"
+#include "half.h"
 #include "mult.h"
+#include "simd.h"
 #include "time.h"
 
 void print_usage(const char* pname) {
-    const char* usage_msg = "Usage: %s [options] [-]\n";
+    const char* usage_msg = "Usage: %s [options] [-]\n       %s -k [options] PATH...\n";
 
     fprintf(stderr, usage_msg, pname, pname, pname);
 }
@@ -24,24 +28,59 @@ void print_help(const char* pname) {
         "    -a PATH\n"
         "    -b PATH     paths to ellpack matrix factors (if omitted: stdin, '\\n' separated)\n"
         "    -o PATH     path to result (if omitted: stdout)\n"
-        "    -V N        impl number (integer between 0 and %d, default: %d)\n"
+        "    -f FORMAT   format of the result: text (default), bin (mmap-able binary; inputs are detected), blocked\n"
+        "                (binary in blocks of rows, can be streamed with -M) or dense (the dense text format of -v)\n"
+        "    -c          convert a to the format given by -f and write it to the result (b is not read)\n"
+        "    -H TYPE     values of the result (and of -c) as fp32 (default), bf16 or fp16; sums are always in float\n"
+        "    -k PATH...  multiply all given files (at least two, '-': stdin) in the cheapest order estimated from their\n"
+        "                sampled non-zero entries (matrix chain ordering), all in memory; -a and -b are not read\n"
+        "    -v PATH     multiply a with every dense vector in PATH ('-': stdin; first line \"noVectors,noCols\", then one\n"
+        "                comma separated vector per line) and write the products in the same format (-f is ignored);\n"
+        "                b is not read, -B reports the effective GB/s of the SIMD SpMV kernel\n"
+        "    -d PATH     multiply a with the dense matrix in PATH ('-': stdin; format of -v, one row per line) instead\n"
+        "                of b, with the SpMM kernel for few (e.g. 8 to 256) dense columns; the result format is -f\n"
+        "    -p PATH     multiply a and b only on the pattern of the ELLPACK matrix in PATH ('-': stdin; noRows of a x\n"
+        "                noCols of b, values are ignored), work and result are bounded by its entries; -V is ignored\n"
+        "    -M MIB      out-of-core: read a (binary, see -f) in blocks of rows that fit into MIB MiB together with their\n"
+        "                products, write every product block before the next block is read (b stays in memory or mmap-ed);\n"
+        "                the result is written in the blocked binary format\n"
+        "    -V N        impl number (integer between 0 and %d or auto, default: %d)\n"
+        "    -C PATH     thresholds of the cost model used by -V auto (written by tests/bench.py calibrate)\n"
+        "    -m          print the cost model estimate for a and b (see -V auto) to stdout and exit\n"
+        "    -j N        number of threads used by the parallel versions (positive integer, default: number of cpus)\n"
+        "    -S LEVEL    SIMD instructions used by the kernels: sse4.1, avx2 or avx512 (default: best supported by the cpu)\n"
         "    -B\n"
-        "    -BN         time execution, N (positive) iterations (default: don't time; if set, no result will be printed to file; if N omitted: %d iterations)\n"
+        "    -BN         time execution, N (positive) iterations (default: don't time; if set, the result is only written if -o is given; if N omitted: %d iterations)\n"
+        "                prints parse and write times, min/median/p95/max of the multiplication and GFLOP/s\n"
+        "    -w N        untimed warmup runs before the timed iterations (default: %d)\n"
+        "    -J          print the benchmark results as one JSON object\n"
+        "    -P          count cycles, instructions, LLC, branch and dTLB misses of every phase (read, multiply, compact,\n"
+        "                write) with perf_event_open and print them per call to stderr (n/a if a counter is not available)\n"
+        "    -W          take scratch memory and results of the kernels from a workspace that is reset between the\n"
+        "                iterations of -B (aligned, huge page backed arenas: no allocations after the first iteration)\n"
         "    -e\n"
         "    -eF         parse files and print true if they are roughly equal (diff of entries < %d or F (float))\n"
         "    -x          print max impl version to stdout and exit\n"
+        "    -s          print the SIMD instructions used by the kernels (see -S) to stdout and exit\n"
         "    -h, --help  Show help and exit\n"
         "\n"
         "Examples:\n"
         "    %s -o result -a sample-inputs/2.txt <sample-inputs/2.txt\n"
         "    %s - <sample-inputs/1.txt <sample-inputs/2.txt\n"
         "    %s -V 0 -B <sample-inputs/1.txt <sample-inputs/2.txt\n"
-        "    %s -B9 -a sample-inputs/1.txt -b sample-inputs/2.txt\n";
+        "    %s -B9 -a sample-inputs/1.txt -b sample-inputs/2.txt\n"
+        "    %s -k sample-inputs/1.txt sample-inputs/2.txt sample-inputs/2.txt\n"
+        "    %s -B -a sample-inputs/1.txt -v vectors.txt\n"
+        "    %s -f dense -a sample-inputs/1.txt -d block.txt\n"
+        "    %s -M 512 -a a.bin -b b.bin -o product.bin\n"
+        "    %s -p sample-inputs/2.txt -a sample-inputs/1.txt -b sample-inputs/2.txt\n"
+        "    %s -c -f bin -H bf16 -a sample-inputs/1.txt -o a.bf16.bin\n";
     // clang-format on
 
     print_usage(pname);
-    fprintf(stderr, help_msg, MAX_IMPL_VERSION, DEFAULT_IMPL_VERSION, DEFAULT_ITERATIONS, DEFAULT_EQ_MAX_DIFF, pname,
-            pname, pname, pname);
+    fprintf(stderr, help_msg, MAX_IMPL_VERSION, DEFAULT_IMPL_VERSION, DEFAULT_ITERATIONS, DEFAULT_WARMUP,
+            DEFAULT_EQ_MAX_DIFF, pname, pname, pname, pname, pname, pname, pname, pname,
+            pname, pname);
 }
 
 float parse_float(char opt, const char* pname) {
@@ -92,18 +131,37 @@ struct ARGS parse_args(int argc, char** argv) {
     struct ARGS parsed_args = {.a = NULL,
                                .b = NULL,
                                .out = NULL,
+                               .chain = NULL,
+                               .noChain = 0,
+                               .vectors = NULL,
+                               .panel = NULL,
+                               .mask = NULL,
+                               .out_format = TEXT,
+                               .value_type = VALUE_FP32,
                                .impl_version = 0,
+                               .thresholds = NULL,
+                               .threads = 0,
+                               .simd_level = -1,
                                .action = MULT,
-                               .iterations = 3,
+                               .iterations = DEFAULT_ITERATIONS,
+                               .warmup = DEFAULT_WARMUP,
+                               .json = false,
+                               .perf = false,
+                               .workspace = false,
+                               .budget = 0,
                                .eq_max_diff = DEFAULT_EQ_MAX_DIFF};
 
     static struct option long_opts[] = {
         {"help", no_argument, NULL, 'h'}, {0, 0, 0, 0}  // required (man 3 getopt_long)
     };
 
-    while ((opt = getopt_long(argc, argv, "V:B::a:b:o:he::x", long_opts, NULL)) != -1) {
+    while ((opt = getopt_long(argc, argv, "V:C:j:S:B::w:JPWM:a:b:o:f:H:v:d:p:chke::xsm", long_opts, NULL)) != -1) {
         switch (opt) {
             case 'V':
+                if (strcmp(optarg, "auto") == 0) {
+                    parsed_args.impl_version = AUTO_IMPL_VERSION;
+                    break;
+                }
                 parsed_args.impl_version = parse_int('V', pname);
                 if (parsed_args.impl_version < 0 || parsed_args.impl_version > MAX_IMPL_VERSION) {
                     fprintf(stderr, "invalid impl version: %d\n", parsed_args.impl_version);
@@ -111,6 +169,25 @@ struct ARGS parse_args(int argc, char** argv) {
                     exit(EXIT_FAILURE);
                 }
                 break;
+            case 'C':
+                parsed_args.thresholds = optarg;
+                break;
+            case 'j':
+                parsed_args.threads = parse_int('j', pname);
+                if (parsed_args.threads < 1) {
+                    fprintf(stderr, "invalid number of threads: %d\n", parsed_args.threads);
+                    print_usage(pname);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'S':
+                parsed_args.simd_level = parse_simd_level(optarg);
+                if (parsed_args.simd_level < 0) {
+                    fprintf(stderr, "invalid SIMD level: '%s'\n", optarg);
+                    print_usage(pname);
+                    exit(EXIT_FAILURE);
+                }
+                break;
             case 'B':
                 parsed_args.action = BENCH;
                 // parsed_args.timeit = true;
@@ -123,6 +200,33 @@ struct ARGS parse_args(int argc, char** argv) {
                     }
                 }
                 break;
+            case 'w':
+                parsed_args.warmup = parse_int('w', pname);
+                if (parsed_args.warmup < 0) {
+                    fprintf(stderr, "invalid number of warmup runs: %d\n", parsed_args.warmup);
+                    print_usage(pname);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'J':
+                parsed_args.json = true;
+                break;
+            case 'P':
+                parsed_args.perf = true;
+                break;
+            case 'W':
+                parsed_args.workspace = true;
+                break;
+            case 'M':;
+                int mib = parse_int('M', pname);
+                if (mib < 1) {
+                    fprintf(stderr, "invalid memory budget: %d MiB\n", mib);
+                    print_usage(pname);
+                    exit(EXIT_FAILURE);
+                }
+                parsed_args.action = STREAM;
+                parsed_args.budget = (uint64_t)mib << 20;
+                break;
             case 'a':
                 parsed_args.a = optarg;
                 break;
@@ -132,6 +236,44 @@ struct ARGS parse_args(int argc, char** argv) {
             case 'o':
                 parsed_args.out = optarg;
                 break;
+            case 'f':
+                if (strcmp(optarg, "text") == 0) {
+                    parsed_args.out_format = TEXT;
+                } else if (strcmp(optarg, "bin") == 0) {
+                    parsed_args.out_format = BIN;
+                } else if (strcmp(optarg, "dense") == 0) {
+                    parsed_args.out_format = DENSE;
+                } else if (strcmp(optarg, "blocked") == 0) {
+                    parsed_args.out_format = BLOCKED;
+                } else {
+                    fprintf(stderr, "invalid format: '%s'\n", optarg);
+                    print_usage(pname);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'H':
+                parsed_args.value_type = parse_value_type(optarg);
+                if (parsed_args.value_type < 0) {
+                    fprintf(stderr, "invalid value type: '%s'\n", optarg);
+                    print_usage(pname);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'v':
+                parsed_args.vectors = optarg;
+                break;
+            case 'd':
+                parsed_args.panel = optarg;
+                break;
+            case 'p':
+                parsed_args.mask = optarg;
+                break;
+            case 'c':
+                parsed_args.action = CONVERT;
+                break;
+            case 'k':
+                parsed_args.action = CHAIN;
+                break;
             case 'e':
                 parsed_args.action = CHECK_EQ;
                 if (optarg) {
@@ -146,6 +288,12 @@ struct ARGS parse_args(int argc, char** argv) {
             case 'x':
                 printf("%d\n", MAX_IMPL_VERSION);
                 exit(EXIT_SUCCESS);
+            case 's':
+                parsed_args.action = SIMD_INFO;
+                break;
+            case 'm':
+                parsed_args.action = ESTIMATE;
+                break;
             case 'h':
                 print_help(pname);
                 exit(EXIT_SUCCESS);
@@ -155,5 +303,29 @@ struct ARGS parse_args(int argc, char** argv) {
         }
     }
 
+    parsed_args.chain = &argv[optind];
+    parsed_args.noChain = argc - optind;
+    if (parsed_args.action == CHAIN && parsed_args.noChain < 2) {
+        fprintf(stderr, "a chain product needs at least two files\n");
+        print_usage(pname);
+        exit(EXIT_FAILURE);
+    }
+
+    if (parsed_args.vectors != NULL || parsed_args.panel != NULL || parsed_args.mask != NULL) {
+        if ((parsed_args.action != MULT && parsed_args.action != BENCH) ||
+            (parsed_args.vectors != NULL) + (parsed_args.panel != NULL) + (parsed_args.mask != NULL) > 1) {
+            fprintf(stderr, "-v, -d and -p can only be combined with -B\n");
+            print_usage(pname);
+            exit(EXIT_FAILURE);
+        }
+        if (parsed_args.vectors != NULL) {
+            parsed_args.action = parsed_args.action == BENCH ? SPMV_BENCH : SPMV;
+        } else if (parsed_args.panel != NULL) {
+            parsed_args.action = parsed_args.action == BENCH ? SPMM_BENCH : SPMM;
+        } else {
+            parsed_args.action = parsed_args.action == BENCH ? MASKED_BENCH : MASKED;
+        }
+    }
+
     return parsed_args;
 }
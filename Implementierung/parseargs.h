@@ -2,8 +2,12 @@
 #define GUARD_PARSEARGS
 
 #include <stdbool.h>
+#include <stdint.h>
 
-enum ACTION { MULT, BENCH, CHECK_EQ };
+enum ACTION { MULT, BENCH, CHECK_EQ, CONVERT, SIMD_INFO, ESTIMATE, CHAIN, SPMV, SPMV_BENCH, SPMM, SPMM_BENCH, STREAM,
+              MASKED, MASKED_BENCH };
+
+enum FORMAT { TEXT, BIN, DENSE, BLOCKED };
 
 // struct that stores validated and parsed argument info
 struct ARGS {
@@ -12,12 +16,52 @@ struct ARGS {
     char* b;
     char* out;
 
+    // CHAIN: paths of the factors (positional arguments, "-" -> stdin)
+    char** chain;
+    int noChain;
+
+    // SPMV/SPMV_BENCH: path to the dense vectors a is multiplied with ("-" -> stdin)
+    char* vectors;
+
+    // SPMM/SPMM_BENCH: path to the dense right operand ("-" -> stdin)
+    char* panel;
+
+    // MASKED/MASKED_BENCH: path to the mask, only the entries of a * b on its pattern are computed ("-" -> stdin)
+    char* mask;
+
+    // format of the result (inputs are detected by their first byte)
+    enum FORMAT out_format;
+
+    // value type (enum VALUE_TYPE) of the result and of matrices converted with -c
+    int value_type;
+
+    // impl version, AUTO_IMPL_VERSION -> chosen by the cost model
     int impl_version;
 
+    // file with the thresholds of the cost model (see autoselect.h), if NULL -> built-in defaults
+    char* thresholds;
+
+    // number of threads used by the parallel kernels, 0 -> number of online cpus
+    int threads;
+
+    // SIMD level forced with -S (enum SIMD_LEVEL), -1 -> best level of the cpu
+    int simd_level;
+
     enum ACTION action;
 
-    // benchmarking option
+    // benchmarking options: timed iterations, untimed runs before them, JSON output
     int iterations;
+    int warmup;
+    bool json;
+
+    // measure the phases with hardware performance counters (perfcount.h)
+    bool perf;
+
+    // allocate scratch memory and results of the kernels from a reused workspace (workspace.h)
+    bool workspace;
+
+    // STREAM: bytes available for the blocks of a and their products
+    uint64_t budget;
 
     // check if max pointwise difference of a, b < eq_max_diff
     float eq_max_diff;
@@ -25,6 +69,7 @@ struct ARGS {
 
 #define DEFAULT_IMPL_VERSION 0
 #define DEFAULT_ITERATIONS 3
+#define DEFAULT_WARMUP 1
 #define DEFAULT_EQ_MAX_DIFF 1
 
 void print_usage(const char* pname);
@@ -0,0 +1,151 @@
+#include "perfcount.h"
+
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "autoselect.h"
+#include "benchmark.h"
+
+// config of a PERF_TYPE_HW_CACHE event: cache, operation, result
+#define HW_CACHE_CONFIG(cache, op, result) ((cache) | ((op) << 8) | ((result) << 16))
+
+bool perfEnabled = false;
+
+static const char* phaseNames[NO_PHASES] = {"read a", "read b", "multiply", "compact", "write"};
+
+static const char* eventNames[NO_EVENTS] = {"cycles", "instructions", "LLC-misses", "branch-misses", "dTLB-misses"};
+
+static const struct {
+    uint32_t type;
+    uint64_t config;
+} events[NO_EVENTS] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE,
+     HW_CACHE_CONFIG(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {PERF_TYPE_HW_CACHE,
+     HW_CACHE_CONFIG(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+};
+
+// file descriptor of every event, -1 -> not available
+static int fds[NO_EVENTS] = {-1, -1, -1, -1, -1};
+
+// errno of the first counter that could not be opened
+static int openError = 0;
+
+static struct {
+    uint64_t calls;
+    double seconds;
+    uint64_t counts[NO_EVENTS];
+    struct timespec start;
+    uint64_t startCounts[NO_EVENTS];
+} phases[NO_PHASES];
+
+/// @brief opens one counter per event for this process and the threads it creates afterwards (user space only);
+/// events the kernel or the cpu does not support are skipped and reported as n/a, the phases are timed either way
+void perf_open(void) {
+    for (int e = 0; e < NO_EVENTS; e++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = events[e].type;
+        attr.config = events[e].config;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        attr.inherit = 1;  // threads of parallel_run are added to the counter of the process when they exit
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        fds[e] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if (fds[e] < 0 && openError == 0) {
+            openError = errno;
+        }
+    }
+    perfEnabled = true;
+}
+
+/// @brief helper: current value of counter e scaled by enabled / running time (the cpu multiplexes the counters if
+/// it has fewer than NO_EVENTS), 0 if it is not available
+static uint64_t helper_read_counter(int e) {
+    uint64_t buffer[3];  // value, time enabled, time running
+    if (fds[e] < 0 || read(fds[e], buffer, sizeof(buffer)) != sizeof(buffer) || buffer[2] == 0) {
+        return 0;
+    }
+    return buffer[2] == buffer[1] ? buffer[0] : (uint64_t)((double)buffer[0] * buffer[1] / buffer[2]);
+}
+
+/// @brief starts measuring phase (no-op if !perfEnabled)
+void perf_begin(enum PERF_PHASE phase) {
+    if (!perfEnabled) {
+        return;
+    }
+    for (int e = 0; e < NO_EVENTS; e++) {
+        phases[phase].startCounts[e] = helper_read_counter(e);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &phases[phase].start);
+}
+
+/// @brief stops measuring phase and adds the counts since perf_begin to it (no-op if !perfEnabled); threads started
+/// by parallel_run are counted because they are joined before
+void perf_end(enum PERF_PHASE phase) {
+    if (!perfEnabled) {
+        return;
+    }
+    phases[phase].seconds += seconds_since(phases[phase].start);
+    for (int e = 0; e < NO_EVENTS; e++) {
+        phases[phase].counts[e] += helper_read_counter(e) - phases[phase].startCounts[e];
+    }
+    phases[phase].calls++;
+}
+
+/// @brief prints calls, seconds and counter values per call of every measured phase
+/// @param file destination
+/// @param version impl version (printed in the header, AUTO_IMPL_VERSION as auto)
+void perf_print(FILE* file, int version) {
+    if (version == AUTO_IMPL_VERSION) {
+        fprintf(file, "perf counters, version auto, per call");
+    } else {
+        fprintf(file, "perf counters, version %d, per call", version);
+    }
+    if (openError != 0) {
+        fprintf(file, " (some counters are not available: %s)", strerror(openError));
+    }
+    fprintf(file, "\n%-9s %6s %12s", "phase", "calls", "seconds");
+    for (int e = 0; e < NO_EVENTS; e++) {
+        fprintf(file, " %14s", eventNames[e]);
+    }
+    fputc('\n', file);
+
+    for (int p = 0; p < NO_PHASES; p++) {
+        if (phases[p].calls == 0) {
+            continue;
+        }
+        fprintf(file, "%-9s %6lu %12.6f", phaseNames[p], phases[p].calls, phases[p].seconds / phases[p].calls);
+        for (int e = 0; e < NO_EVENTS; e++) {
+            if (fds[e] < 0) {
+                fprintf(file, " %14s", "n/a");
+            } else {
+                fprintf(file, " %14lu", phases[p].counts[e] / phases[p].calls);
+            }
+        }
+        fputc('\n', file);
+    }
+}
+
+/// @brief closes the counters
+void perf_close(void) {
+    for (int e = 0; e < NO_EVENTS; e++) {
+        if (fds[e] >= 0) {
+            close(fds[e]);
+            fds[e] = -1;
+        }
+    }
+    perfEnabled = false;
+}
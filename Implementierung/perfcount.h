@@ -0,0 +1,37 @@
+#ifndef GUARD_PERFCOUNT
+#define GUARD_PERFCOUNT
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/// @brief instrumented phases, PHASE_COMPACT (remove_unnecessary_padding) is also part of PHASE_MULTIPLY
+enum PERF_PHASE { PHASE_READ_A, PHASE_READ_B, PHASE_MULTIPLY, PHASE_COMPACT, PHASE_WRITE, NO_PHASES };
+
+/// @brief hardware events counted in every phase
+enum PERF_EVENT { EVENT_CYCLES, EVENT_INSTRUCTIONS, EVENT_LLC_MISSES, EVENT_BRANCH_MISSES, EVENT_DTLB_MISSES,
+                  NO_EVENTS };
+
+/// @brief phases are only measured if true (set by perf_open, cleared during untimed runs)
+extern bool perfEnabled;
+
+/// @brief opens one counter per event for this process and the threads it creates afterwards (user space only);
+/// events the kernel or the cpu does not support are skipped and reported as n/a, the phases are timed either way
+void perf_open(void);
+
+/// @brief starts measuring phase (no-op if !perfEnabled)
+void perf_begin(enum PERF_PHASE phase);
+
+/// @brief stops measuring phase and adds the counts since perf_begin to it (no-op if !perfEnabled); threads started
+/// by parallel_run are counted because they are joined before
+void perf_end(enum PERF_PHASE phase);
+
+/// @brief prints calls, seconds and counter values per call of every measured phase
+/// @param file destination
+/// @param version impl version (printed in the header, AUTO_IMPL_VERSION as auto)
+void perf_print(FILE* file, int version);
+
+/// @brief closes the counters
+void perf_close(void);
+
+#endif
@@ -0,0 +1,60 @@
+#include "radix.h"
+
+#include <stdint.h>
+#include <string.h>
+
+/// @brief stable LSD radix sort of (key, value) pairs by the lowest keyBits bits of the keys; the histograms of all
+/// digits are counted in one pass over the keys and passes over digits that are equal in all keys are skipped
+/// @param keys keys, sorted on return
+/// @param values values moved with their keys
+/// @param tmpKeys buffer of n keys
+/// @param tmpValues buffer of n values
+/// @param n number of pairs
+/// @param keyBits number of significant bits of the keys (higher bits have to be 0)
+void radix_sort_pairs(uint64_t* keys, float* values, uint64_t* tmpKeys, float* tmpValues, uint64_t n,
+                      unsigned keyBits) {
+    const unsigned noPasses = (keyBits + RADIX_BITS - 1) / RADIX_BITS;
+    if (n < 2 || noPasses == 0) {
+        return;
+    }
+    uint64_t count[64 / RADIX_BITS][RADIX_BUCKETS];
+    memset(count, 0, noPasses * sizeof(count[0]));
+    for (uint64_t k = 0; k < n; k++) {
+        for (unsigned p = 0; p < noPasses; p++) {
+            count[p][(keys[k] >> (p * RADIX_BITS)) & (RADIX_BUCKETS - 1)]++;
+        }
+    }
+
+    uint64_t* srcKeys = keys;
+    float* srcValues = values;
+    uint64_t* dstKeys = tmpKeys;
+    float* dstValues = tmpValues;
+    for (unsigned p = 0; p < noPasses; p++) {
+        const unsigned shift = p * RADIX_BITS;
+        if (count[p][(srcKeys[0] >> shift) & (RADIX_BUCKETS - 1)] == n) {
+            continue;  // all keys have the same digit, the order does not change
+        }
+        // exclusive prefix sum: first position of every bucket
+        uint64_t offset[RADIX_BUCKETS];
+        uint64_t sum = 0;
+        for (unsigned b = 0; b < RADIX_BUCKETS; b++) {
+            offset[b] = sum;
+            sum += count[p][b];
+        }
+        for (uint64_t k = 0; k < n; k++) {
+            uint64_t pos = offset[(srcKeys[k] >> shift) & (RADIX_BUCKETS - 1)]++;
+            dstKeys[pos] = srcKeys[k];
+            dstValues[pos] = srcValues[k];
+        }
+        uint64_t* swapKeys = srcKeys;
+        srcKeys = dstKeys;
+        dstKeys = swapKeys;
+        float* swapValues = srcValues;
+        srcValues = dstValues;
+        dstValues = swapValues;
+    }
+    if (srcKeys != keys) {  // odd number of executed passes
+        memcpy(keys, srcKeys, n * sizeof(uint64_t));
+        memcpy(values, srcValues, n * sizeof(float));
+    }
+}
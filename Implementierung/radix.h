@@ -0,0 +1,21 @@
+#ifndef GUARD_RADIX
+#define GUARD_RADIX
+
+#include <stdint.h>
+
+// bits sorted per pass of radix_sort_pairs
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+
+/// @brief stable LSD radix sort of (key, value) pairs by the lowest keyBits bits of the keys; the histograms of all
+/// digits are counted in one pass over the keys and passes over digits that are equal in all keys are skipped
+/// @param keys keys, sorted on return
+/// @param values values moved with their keys
+/// @param tmpKeys buffer of n keys
+/// @param tmpValues buffer of n values
+/// @param n number of pairs
+/// @param keyBits number of significant bits of the keys (higher bits have to be 0)
+void radix_sort_pairs(uint64_t* keys, float* values, uint64_t* tmpKeys, float* tmpValues, uint64_t n,
+                      unsigned keyBits);
+
+#endif
@@ -0,0 +1,170 @@
+#include "sell.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ellpack.h"
+#include "half.h"
+#include "parallel.h"
+#include "util.h"
+#include "workspace.h"
+
+/// @brief row of the original matrix together with its length, sorted within a window
+struct SELL_ROW {
+    uint64_t length;
+    uint64_t row;
+};
+
+/// @brief arguments shared by all threads of a conversion
+struct SELL_ARGS {
+    const struct ELLPACK* matrix;
+    struct SELL* sell;
+    struct SELL_ROW* rows;  // noRows entries, afterwards sorted within every window
+};
+
+/// @brief helper: stable bottom-up merge sort of n rows by descending length (equally long rows keep their order)
+/// @param rows rows to sort
+/// @param n number of rows
+/// @param buffer n entries of scratch memory
+static void helper_sort_rows(struct SELL_ROW* rows, uint64_t n, struct SELL_ROW* buffer) {
+    struct SELL_ROW* from = rows;
+    struct SELL_ROW* to = buffer;
+    for (uint64_t width = 1; width < n; width *= 2) {
+        for (uint64_t start = 0; start < n; start += 2 * width) {
+            uint64_t mid = start + width < n ? start + width : n;
+            uint64_t end = start + 2 * width < n ? start + 2 * width : n;
+            uint64_t i = start, j = mid, k = start;
+            while (i < mid && j < end) {
+                to[k++] = from[j].length > from[i].length ? from[j++] : from[i++];
+            }
+            while (i < mid) {
+                to[k++] = from[i++];
+            }
+            while (j < end) {
+                to[k++] = from[j++];
+            }
+        }
+        struct SELL_ROW* t = from;
+        from = to;
+        to = t;
+    }
+    if (from != rows) {
+        memcpy(rows, from, n * sizeof(struct SELL_ROW));
+    }
+}
+
+/// @brief phase 1: computes the row lengths (without trailing padding) and sorts the windows of thread id
+static void helper_sell_sort(int id, int n, void* p) {
+    const struct SELL_ARGS* args = (struct SELL_ARGS*)p;
+    const struct ELLPACK matrix = *args->matrix;
+    const uint64_t sigma = args->sell->sigma;
+    uint64_t noWindows = (matrix.noRows + sigma - 1) / sigma;
+    struct SELL_ROW* buffer = (struct SELL_ROW*)scratch_alloc(sigma * sizeof(struct SELL_ROW));
+
+    for (uint64_t w = noWindows * id / n; w < noWindows * (id + 1) / n; w++) {
+        uint64_t end = (w + 1) * sigma < matrix.noRows ? (w + 1) * sigma : matrix.noRows;
+        for (uint64_t i = w * sigma; i < end; i++) {
+            uint64_t length = matrix.maxNoNonZero;
+            while (length > 0 && elpk_is_zero(&matrix, i * matrix.maxNoNonZero + length - 1)) {
+                length--;
+            }
+            args->rows[i] = (struct SELL_ROW){.length = length, .row = i};
+        }
+        if (sigma > 1) {
+            helper_sort_rows(&args->rows[w * sigma], end - w * sigma, buffer);
+        }
+    }
+    scratch_free(buffer);
+}
+
+/// @brief phase 2: copies the rows of the chunks of thread id into their column-major slots and pads the chunks
+static void helper_sell_fill(int id, int n, void* p) {
+    const struct SELL_ARGS* args = (struct SELL_ARGS*)p;
+    const struct ELLPACK matrix = *args->matrix;
+    const struct SELL sell = *args->sell;
+    const uint64_t C = sell.chunkSize;
+
+    for (uint64_t c = sell.noChunks * id / n; c < sell.noChunks * (id + 1) / n; c++) {
+        uint64_t width = (sell.chunkStart[c + 1] - sell.chunkStart[c]) / C;
+        for (uint64_t s = c * C; s < (c + 1) * C; s++) {
+            const uint64_t start = sell.chunkStart[c] + s % C;
+            elpk_index_t* indices = &sell.indices[start];
+            uint64_t j = 0;
+            if (s < sell.noRows) {
+                const uint64_t row = sell.rowOf[s];
+                for (; j < sell.rowLength[s]; j++) {
+                    if (sell.valueType == VALUE_FP32) {
+                        sell.values[start + j * C] = matrix.values[row * matrix.maxNoNonZero + j];
+                    } else {
+                        sell.halfValues[start + j * C] = matrix.halfValues[row * matrix.maxNoNonZero + j];
+                    }
+                    indices[j * C] = matrix.indices[row * matrix.maxNoNonZero + j];
+                }
+            }
+            for (; j < width; j++) {
+                if (sell.valueType == VALUE_FP32) {
+                    sell.values[start + j * C] = 0.f;
+                } else {
+                    sell.halfValues[start + j * C] = 0;
+                }
+                indices[j * C] = 0;
+            }
+        }
+    }
+}
+
+/// @brief converts an ELLPACK matrix to SELL-C-sigma, trailing padding of the rows is dropped; the values keep their
+/// type
+/// @param matrix matrix in ELLPACK format
+/// @param chunkSize number of rows per chunk (C)
+/// @param sigma size of the windows sorted by row length, rounded up to a multiple of chunkSize (1: no sorting)
+/// @return matrix in SELL-C-sigma format, free with sell_free
+struct SELL sell_from_ellpack(const struct ELLPACK matrix, uint64_t chunkSize, uint64_t sigma) {
+    struct SELL sell = {0};
+    sell.noRows = matrix.noRows;
+    sell.noCols = matrix.noCols;
+    sell.chunkSize = chunkSize < 1 ? 1 : chunkSize;
+    sell.sigma = sigma <= 1 ? 1 : (sigma + sell.chunkSize - 1) / sell.chunkSize * sell.chunkSize;
+    sell.noChunks = (matrix.noRows + sell.chunkSize - 1) / sell.chunkSize;
+    uint64_t noSlots = sell.noChunks * sell.chunkSize;
+
+    sell.chunkStart = (uint64_t*)scratch_alloc((sell.noChunks + 1) * sizeof(uint64_t));
+    sell.rowLength = (uint64_t*)scratch_calloc((noSlots + 1) * sizeof(uint64_t));
+    sell.rowOf = (uint64_t*)scratch_alloc((matrix.noRows + 1) * sizeof(uint64_t));
+    sell.slotOf = (uint64_t*)scratch_alloc((matrix.noRows + 1) * sizeof(uint64_t));
+    struct SELL_ROW* rows = (struct SELL_ROW*)scratch_alloc((matrix.noRows + 1) * sizeof(struct SELL_ROW));
+
+    int n = noThreads < 1 ? 1 : noThreads;
+    if ((uint64_t)n > sell.noChunks) {
+        n = sell.noChunks < 1 ? 1 : sell.noChunks;
+    }
+    struct SELL_ARGS args = {.matrix = &matrix, .sell = &sell, .rows = rows};
+    parallel_run(n, helper_sell_sort, &args);
+
+    // every chunk is as wide as its longest row
+    sell.chunkStart[0] = 0;
+    for (uint64_t c = 0; c < sell.noChunks; c++) {
+        uint64_t width = 0;
+        for (uint64_t s = c * sell.chunkSize; s < (c + 1) * sell.chunkSize && s < matrix.noRows; s++) {
+            sell.rowOf[s] = rows[s].row;
+            sell.slotOf[rows[s].row] = s;
+            sell.rowLength[s] = rows[s].length;
+            width = rows[s].length > width ? rows[s].length : width;
+        }
+        sell.chunkStart[c + 1] = sell.chunkStart[c] + width * sell.chunkSize;
+    }
+    scratch_free(rows);
+
+    uint64_t itemsCount = sell.chunkStart[sell.noChunks];
+    sell.valueType = matrix.valueType;
+    if (matrix.valueType == VALUE_FP32) {
+        sell.values = (float*)scratch_alloc((itemsCount + 1) * sizeof(float));
+    } else {
+        sell.halfValues = (uint16_t*)scratch_alloc((itemsCount + 1) * sizeof(uint16_t));
+    }
+    sell.indices = (elpk_index_t*)scratch_alloc((itemsCount + 1) * sizeof(elpk_index_t));
+    parallel_run(n, helper_sell_fill, &args);
+
+    return sell;
+}
@@ -0,0 +1,53 @@
+#ifndef GUARD_SELL
+#define GUARD_SELL
+
+#include <stdint.h>
+
+#include "ellpack.h"
+#include "half.h"
+#include "workspace.h"
+
+// default number of rows per chunk (one AVX register of floats) and size of the windows sorted by row length
+#define SELL_CHUNK_SIZE 8
+#define SELL_SIGMA 256
+
+/// @brief sliced ELLPACK (SELL-C-sigma): the rows are sorted by descending length within windows of sigma rows and
+/// grouped into chunks of chunkSize rows, every chunk is only padded to its own longest row; inside a chunk the
+/// entries are stored column-major, so entry j of the row in slot s is at
+/// chunkStart[s / chunkSize] + j * chunkSize + s % chunkSize (consecutive rows of a chunk are adjacent in memory)
+struct SELL {
+    uint64_t noRows;
+    uint64_t noCols;
+    uint64_t chunkSize;    // C
+    uint64_t sigma;        // sorting window, multiple of chunkSize
+    uint64_t noChunks;     // ceil(noRows / chunkSize)
+    uint64_t* chunkStart;  // noChunks + 1 offsets into values and indices
+    uint64_t* rowLength;   // noChunks * chunkSize entries: number of entries of the row in every slot (0 past noRows)
+    uint64_t* rowOf;       // noRows entries: row of the original matrix stored in every slot
+    uint64_t* slotOf;      // noRows entries: slot of every row of the original matrix
+    float* values;         // padding is stored as 0.0 with index 0 like in ELLPACK; NULL unless valueType is VALUE_FP32
+    elpk_index_t* indices;
+    enum VALUE_TYPE valueType;  // value type of the ELLPACK matrix it was converted from
+    uint16_t* halfValues;       // values of the 16 bit types, NULL for VALUE_FP32
+};
+
+/// @brief converts an ELLPACK matrix to SELL-C-sigma, trailing padding of the rows is dropped; the values keep their
+/// type
+/// @param matrix matrix in ELLPACK format
+/// @param chunkSize number of rows per chunk (C)
+/// @param sigma size of the windows sorted by row length, rounded up to a multiple of chunkSize (1: no sorting)
+/// @return matrix in SELL-C-sigma format, free with sell_free
+struct SELL sell_from_ellpack(const struct ELLPACK matrix, uint64_t chunkSize, uint64_t sigma);
+
+/// @brief convenience/wrapper function to free SELL struct
+__attribute__((always_inline)) inline void sell_free(struct SELL s) {
+    scratch_free(s.chunkStart);
+    scratch_free(s.rowLength);
+    scratch_free(s.rowOf);
+    scratch_free(s.slotOf);
+    scratch_free(s.values);
+    scratch_free(s.halfValues);
+    scratch_free(s.indices);
+}
+
+#endif
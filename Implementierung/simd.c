@@ -0,0 +1,33 @@
+#include "simd.h"
+
+#include <string.h>
+
+enum SIMD_LEVEL simdLevel = SIMD_SSE41;
+
+/// @brief returns the best level supported by the cpu (cpuid)
+enum SIMD_LEVEL detect_simd_level(void) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return SIMD_AVX512;
+    }
+    // the AVX2 kernels widen fp16 values with F16C, which every cpu with AVX2 and FMA has
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("f16c")) {
+        return SIMD_AVX2;
+    }
+    return SIMD_SSE41;
+}
+
+static const char* simdLevelNames[] = {[SIMD_SSE41] = "sse4.1", [SIMD_AVX2] = "avx2", [SIMD_AVX512] = "avx512"};
+
+/// @brief parses a level name ("sse4.1", "avx2", "avx512"), returns -1 for unknown names
+int parse_simd_level(const char* name) {
+    for (int level = SIMD_SSE41; level <= SIMD_AVX512; level++) {
+        if (strcmp(name, simdLevelNames[level]) == 0) {
+            return level;
+        }
+    }
+    return -1;
+}
+
+/// @brief returns the name of a level
+const char* simd_level_name(enum SIMD_LEVEL level) { return simdLevelNames[level]; }
@@ -0,0 +1,65 @@
+#ifndef GUARD_SIMD
+#define GUARD_SIMD
+
+#include <immintrin.h>
+
+#include "ellpack.h"
+
+/// @brief instruction set levels the SIMD kernels are built for, the whole program is compiled for SSE4.1 and the
+/// wider kernels with target attributes
+enum SIMD_LEVEL { SIMD_SSE41, SIMD_AVX2, SIMD_AVX512 };
+
+/// @brief level used by the SIMD kernels (set at startup with detect_simd_level, can be lowered with -S)
+extern enum SIMD_LEVEL simdLevel;
+
+/// @brief returns the best level supported by the cpu (cpuid)
+enum SIMD_LEVEL detect_simd_level(void);
+
+/// @brief parses a level name ("sse4.1", "avx2", "avx512"), returns -1 for unknown names
+int parse_simd_level(const char* name);
+
+/// @brief returns the name of a level
+const char* simd_level_name(enum SIMD_LEVEL level);
+
+/// @brief loads 4 column indices as 32 bit integers (64 bit indices are truncated, the caller makes sure they fit)
+__attribute__((always_inline)) static inline __m128i simd_load_indices4(const elpk_index_t* p) {
+#if INDEX_BITS == 16
+    return _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*)p));
+#elif INDEX_BITS == 32
+    return _mm_loadu_si128((const __m128i*)p);
+#else
+    __m128 lo = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)p));
+    __m128 hi = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)(p + 2)));
+    return _mm_castps_si128(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)));
+#endif
+}
+
+/// @brief loads 8 column indices as 32 bit integers
+__attribute__((target("avx2"), always_inline)) static inline __m256i simd_load_indices8(const elpk_index_t* p) {
+#if INDEX_BITS == 16
+    return _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)p));
+#elif INDEX_BITS == 32
+    return _mm256_loadu_si256((const __m256i*)p);
+#else
+    // low halves of 2 x 4 64 bit indices
+    const __m256i even = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+    __m256i lo = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i*)p), even);
+    __m256i hi = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i*)(p + 4)), even);
+    return _mm256_permute2x128_si256(lo, hi, 0x20);
+#endif
+}
+
+/// @brief loads 16 column indices as 32 bit integers
+__attribute__((target("avx512f"), always_inline)) static inline __m512i simd_load_indices16(const elpk_index_t* p) {
+#if INDEX_BITS == 16
+    return _mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i*)p));
+#elif INDEX_BITS == 32
+    return _mm512_loadu_si512(p);
+#else
+    __m256i lo = _mm512_cvtepi64_epi32(_mm512_loadu_si512(p));
+    __m256i hi = _mm512_cvtepi64_epi32(_mm512_loadu_si512(p + 8));
+    return _mm512_inserti64x4(_mm512_castsi256_si512(lo), hi, 1);
+#endif
+}
+
+#endif
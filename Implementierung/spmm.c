@@ -0,0 +1,265 @@
+#include "spmm.h"
+
+#include <immintrin.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ellpack.h"
+#include "mult.h"
+#include "parallel.h"
+#include "simd.h"
+#include "util.h"
+#include "workspace.h"
+
+/// @brief 4 lanes, blocks of 4 registers (16 columns) and single registers for the rest of the row
+static void helper_spmm_sse41(const float* values, const elpk_index_t* indices, uint64_t length,
+                              const struct SPMM_PANEL* right, float* out) {
+    const uint64_t stride = right->stride;
+    uint64_t c = 0;
+    for (; c + 16 <= stride; c += 16) {
+        __m128 acc[4] = {_mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps()};
+        for (uint64_t k = 0; k < length; k++) {
+            if (values[k] == 0.f) {
+                continue;  // padding
+            }
+            const __m128 v = _mm_set1_ps(values[k]);
+            const float* b = &right->values[indices[k] * stride + c];
+#pragma GCC unroll 4
+            for (int r = 0; r < 4; r++) {
+                acc[r] = _mm_add_ps(acc[r], _mm_mul_ps(v, _mm_load_ps(b + r * 4)));
+            }
+        }
+#pragma GCC unroll 4
+        for (int r = 0; r < 4; r++) {
+            _mm_store_ps(out + c + r * 4, acc[r]);
+        }
+    }
+    for (; c < stride; c += 4) {
+        __m128 acc = _mm_setzero_ps();
+        for (uint64_t k = 0; k < length; k++) {
+            if (values[k] != 0.f) {
+                const __m128 b = _mm_load_ps(&right->values[indices[k] * stride + c]);
+                acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(values[k]), b));
+            }
+        }
+        _mm_store_ps(out + c, acc);
+    }
+}
+
+/// @brief 8 lanes with fused multiply-add, blocks of 4 registers (32 columns)
+__attribute__((target("avx2,fma"))) static void helper_spmm_avx2(const float* values, const elpk_index_t* indices,
+                                                                 uint64_t length, const struct SPMM_PANEL* right,
+                                                                 float* out) {
+    const uint64_t stride = right->stride;
+    uint64_t c = 0;
+    for (; c + 32 <= stride; c += 32) {
+        __m256 acc[4] = {_mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps()};
+        for (uint64_t k = 0; k < length; k++) {
+            if (values[k] == 0.f) {
+                continue;
+            }
+            const __m256 v = _mm256_broadcast_ss(&values[k]);
+            const float* b = &right->values[indices[k] * stride + c];
+#pragma GCC unroll 4
+            for (int r = 0; r < 4; r++) {
+                acc[r] = _mm256_fmadd_ps(v, _mm256_load_ps(b + r * 8), acc[r]);
+            }
+        }
+#pragma GCC unroll 4
+        for (int r = 0; r < 4; r++) {
+            _mm256_store_ps(out + c + r * 8, acc[r]);
+        }
+    }
+    for (; c < stride; c += 8) {
+        __m256 acc = _mm256_setzero_ps();
+        for (uint64_t k = 0; k < length; k++) {
+            if (values[k] != 0.f) {
+                acc = _mm256_fmadd_ps(_mm256_broadcast_ss(&values[k]),
+                                      _mm256_load_ps(&right->values[indices[k] * stride + c]), acc);
+            }
+        }
+        _mm256_store_ps(out + c, acc);
+    }
+}
+
+/// @brief 16 lanes, blocks of 4 registers (64 columns)
+__attribute__((target("avx512f"))) static void helper_spmm_avx512(const float* values, const elpk_index_t* indices,
+                                                                  uint64_t length, const struct SPMM_PANEL* right,
+                                                                  float* out) {
+    const uint64_t stride = right->stride;
+    uint64_t c = 0;
+    for (; c + 64 <= stride; c += 64) {
+        __m512 acc[4] = {_mm512_setzero_ps(), _mm512_setzero_ps(), _mm512_setzero_ps(), _mm512_setzero_ps()};
+        for (uint64_t k = 0; k < length; k++) {
+            if (values[k] == 0.f) {
+                continue;
+            }
+            const __m512 v = _mm512_set1_ps(values[k]);
+            const float* b = &right->values[indices[k] * stride + c];
+#pragma GCC unroll 4
+            for (int r = 0; r < 4; r++) {
+                acc[r] = _mm512_fmadd_ps(v, _mm512_load_ps(b + r * 16), acc[r]);
+            }
+        }
+#pragma GCC unroll 4
+        for (int r = 0; r < 4; r++) {
+            _mm512_store_ps(out + c + r * 16, acc[r]);
+        }
+    }
+    for (; c < stride; c += 16) {
+        __m512 acc = _mm512_setzero_ps();
+        for (uint64_t k = 0; k < length; k++) {
+            if (values[k] != 0.f) {
+                acc = _mm512_fmadd_ps(_mm512_set1_ps(values[k]),
+                                      _mm512_load_ps(&right->values[indices[k] * stride + c]), acc);
+            }
+        }
+        _mm512_store_ps(out + c, acc);
+    }
+}
+
+/// @brief returns the kernel for simdLevel
+struct SPMM_KERNEL spmm_kernel(void) {
+    switch (simdLevel) {
+        case SIMD_AVX512:
+            return (struct SPMM_KERNEL){.lanes = 16, .func = helper_spmm_avx512};
+        case SIMD_AVX2:
+            return (struct SPMM_KERNEL){.lanes = 8, .func = helper_spmm_avx2};
+        default:
+            return (struct SPMM_KERNEL){.lanes = 4, .func = helper_spmm_sse41};
+    }
+}
+
+/// @brief copies a dense matrix into a panel for kernel (the panel is an input like a and b and therefore not taken
+/// from boundWorkspace)
+/// @return panel, free with spmm_panel_free
+struct SPMM_PANEL spmm_pack(const struct DENSE_MATRIX matrix, const struct SPMM_KERNEL kernel) {
+    struct SPMM_PANEL panel;
+    panel.noRows = matrix.noRows;
+    panel.noCols = matrix.noCols;
+    panel.stride = (matrix.noCols + kernel.lanes - 1) / kernel.lanes * kernel.lanes;
+    uint64_t size = (panel.noRows * panel.stride * sizeof(float) + 63) / 64 * 64;
+    panel.values = (float*)abortIfNULL(aligned_alloc(64, size ? size : 64));
+    for (uint64_t i = 0; i < panel.noRows; i++) {
+        memcpy(&panel.values[i * panel.stride], &matrix.values[i * matrix.noCols], matrix.noCols * sizeof(float));
+        memset(&panel.values[i * panel.stride + matrix.noCols], 0, (panel.stride - matrix.noCols) * sizeof(float));
+    }
+    return panel;
+}
+
+/// @brief convenience/wrapper function to free SPMM_PANEL struct
+void spmm_panel_free(struct SPMM_PANEL panel) { free(panel.values); }
+
+/// @brief arguments shared by all threads of spmm_dense and spmm_ellpack
+struct SPMM_ARGS {
+    const struct ELLPACK* left;
+    const struct SPMM_PANEL* right;
+    const struct SPMM_KERNEL* kernel;
+    struct DENSE_MATRIX* dense;  // NULL: write the non-zero entries into result
+    struct ELLPACK* result;
+};
+
+/// @brief computes the rows of one thread into a row buffer and copies them into the dense or ELLPACK result
+static void helper_spmm_rows(int id, int n, void* p) {
+    const struct SPMM_ARGS* args = (struct SPMM_ARGS*)p;
+    const struct ELLPACK left = *args->left;
+    const struct SPMM_PANEL* right = args->right;
+    float* row = (float*)scratch_alloc(right->stride * sizeof(float));
+
+    for (uint64_t i = left.noRows * id / n; i < left.noRows * (id + 1) / n; i++) {
+        const float* values = &left.values[i * left.maxNoNonZero];
+        uint64_t length = left.maxNoNonZero;
+        while (length > 0 && values[length - 1] == 0.f) {
+            length--;  // trailing padding
+        }
+        args->kernel->func(values, &left.indices[i * left.maxNoNonZero], length, right, row);
+
+        if (args->dense != NULL) {
+            memcpy(&args->dense->values[i * right->noCols], row, right->noCols * sizeof(float));
+            continue;
+        }
+        const struct ELLPACK result = *args->result;
+        uint64_t resultPos = i * result.maxNoNonZero;
+        for (uint64_t j = 0; j < right->noCols; j++) {
+            if (row[j] != 0.f) {
+                result.indices[resultPos] = j;
+                result.values[resultPos++] = row[j];
+            }
+        }
+        // add padding
+        for (; resultPos < (i + 1) * result.maxNoNonZero; resultPos++) {
+            result.values[resultPos] = 0.f;
+            result.indices[resultPos] = 0;
+        }
+    }
+    scratch_free(row);
+}
+
+/// @brief helper: runs helper_spmm_rows on noThreads threads (at most one per row)
+static void helper_spmm(struct SPMM_ARGS* args) {
+    int n = noThreads < 1 ? 1 : noThreads;
+    if ((uint64_t)n > args->left->noRows) {
+        n = args->left->noRows < 1 ? 1 : args->left->noRows;
+    }
+    parallel_run(n, helper_spmm_rows, args);
+}
+
+/// @brief helper: aborts if the dimensions of left and right do not match
+static void helper_validate(const struct ELLPACK left, const struct SPMM_PANEL right) {
+    if (left.noCols != right.noRows) {
+        fprintf(stderr, "ERROR: a has %lu columns, but the dense matrix has %lu rows\n", left.noCols, right.noRows);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/// @brief result = left * right as a dense matrix on noThreads threads (every thread owns a block of rows)
+/// @param left left operand in ELLPACK format
+/// @param right right operand packed with spmm_pack(..., kernel)
+/// @param kernel kernel right was packed for
+/// @param result output: left.noRows x right.noCols, allocated by the caller
+void spmm_dense(const struct ELLPACK left, const struct SPMM_PANEL right, const struct SPMM_KERNEL kernel,
+                struct DENSE_MATRIX result) {
+    helper_validate(left, right);
+    struct SPMM_ARGS args = {.left = &left, .right = &right, .kernel = &kernel, .dense = &result, .result = NULL};
+    helper_spmm(&args);
+}
+
+/// @brief result = left * right in ELLPACK format on noThreads threads, the rows are padded to the longest one
+/// @param left left operand in ELLPACK format
+/// @param right right operand packed with spmm_pack(..., kernel)
+/// @param kernel kernel right was packed for
+/// @return product, free with elpk_free
+struct ELLPACK spmm_ellpack(const struct ELLPACK left, const struct SPMM_PANEL right, const struct SPMM_KERNEL kernel) {
+    helper_validate(left, right);
+    if (right.noCols != 0 && right.noCols - 1 > ELPK_INDEX_MAX) {  // ELPK_INDEX_MAX + 1 overflows for 64 bit indices
+        fprintf(stderr, "ERROR: %lu columns do not fit into %d bit indices\n", right.noCols, INDEX_BITS);
+        exit(EXIT_FAILURE);
+    }
+    struct ELLPACK result = {0};
+    result.noRows = left.noRows;
+    result.noCols = right.noCols;
+    result.maxNoNonZero = right.noCols;  // every row may be dense, the padding is removed afterwards
+    elpk_alloc(&result);
+
+    struct SPMM_ARGS args = {.left = &left, .right = &right, .kernel = &kernel, .dense = NULL, .result = &result};
+    helper_spmm(&args);
+    return remove_unnecessary_padding(result);
+}
+
+/// @brief multiply-adds of one spmm (non-zero entries of left times columns of right)
+uint64_t spmm_multiplications(const struct ELLPACK left, const struct SPMM_PANEL right) {
+    uint64_t count = 0;
+    for (uint64_t k = 0; k < left.noRows * left.maxNoNonZero; k++) {
+        count += left.values[k] != 0.f;
+    }
+    return count * right.noCols;
+}
+
+/// @brief bytes one spmm has to move at least: the entries of left (padding included), right and the dense product
+/// once
+uint64_t spmm_bytes(const struct ELLPACK left, const struct SPMM_PANEL right) {
+    return left.noRows * left.maxNoNonZero * (sizeof(float) + sizeof(elpk_index_t)) +
+           (right.noRows + left.noRows) * right.noCols * sizeof(float);
+}
@@ -0,0 +1,58 @@
+#ifndef GUARD_SPMM
+#define GUARD_SPMM
+
+#include <stdint.h>
+
+#include "ellpack.h"
+
+/// @brief dense right operand of spmm: row-major, every row padded to stride columns (multiple of the lanes of the
+/// kernel, the padding is 0), so the kernel only does aligned full-register loads
+struct SPMM_PANEL {
+    uint64_t noRows;
+    uint64_t noCols;
+    uint64_t stride;
+    float* values;  // noRows * stride entries, 64 byte aligned
+};
+
+/// @brief SpMM kernel for one instruction set level: out[0..stride) = sum over k of values[k] * row indices[k] of
+/// right; vectorized across the columns of right, every entry of the left row is broadcast once per block of columns
+struct SPMM_KERNEL {
+    uint64_t lanes;
+    void (*func)(const float* values, const elpk_index_t* indices, uint64_t length, const struct SPMM_PANEL* right,
+                 float* out);
+};
+
+/// @brief returns the kernel for simdLevel
+struct SPMM_KERNEL spmm_kernel(void);
+
+/// @brief copies a dense matrix into a panel for kernel (the panel is an input like a and b and therefore not taken
+/// from boundWorkspace)
+/// @return panel, free with spmm_panel_free
+struct SPMM_PANEL spmm_pack(const struct DENSE_MATRIX matrix, const struct SPMM_KERNEL kernel);
+
+/// @brief convenience/wrapper function to free SPMM_PANEL struct
+void spmm_panel_free(struct SPMM_PANEL panel);
+
+/// @brief result = left * right as a dense matrix on noThreads threads (every thread owns a block of rows)
+/// @param left left operand in ELLPACK format
+/// @param right right operand packed with spmm_pack(..., kernel)
+/// @param kernel kernel right was packed for
+/// @param result output: left.noRows x right.noCols, allocated by the caller
+void spmm_dense(const struct ELLPACK left, const struct SPMM_PANEL right, const struct SPMM_KERNEL kernel,
+                struct DENSE_MATRIX result);
+
+/// @brief result = left * right in ELLPACK format on noThreads threads, the rows are padded to the longest one
+/// @param left left operand in ELLPACK format
+/// @param right right operand packed with spmm_pack(..., kernel)
+/// @param kernel kernel right was packed for
+/// @return product, free with elpk_free
+struct ELLPACK spmm_ellpack(const struct ELLPACK left, const struct SPMM_PANEL right, const struct SPMM_KERNEL kernel);
+
+/// @brief multiply-adds of one spmm (non-zero entries of left times columns of right)
+uint64_t spmm_multiplications(const struct ELLPACK left, const struct SPMM_PANEL right);
+
+/// @brief bytes one spmm has to move at least: the entries of left (padding included), right and the dense product
+/// once
+uint64_t spmm_bytes(const struct ELLPACK left, const struct SPMM_PANEL right);
+
+#endif
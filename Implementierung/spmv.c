@@ -0,0 +1,205 @@
+#include "spmv.h"
+
+#include <immintrin.h>
+#include <stdint.h>
+
+#include "ellpack.h"
+#include "half.h"
+#include "parallel.h"
+#include "sell.h"
+#include "simd.h"
+
+// chunks every thread multiplies with all vectors of a batch before moving on, so they stay in cache
+#define SPMV_TILE_CHUNKS 256
+
+/// @brief helper: writes the sums of the lanes of chunk c to the rows they belong to
+__attribute__((always_inline)) static inline void helper_store_chunk(const struct SELL* matrix, const float* sums,
+                                                                     uint64_t lanes, uint64_t c, float* y) {
+    for (uint64_t l = 0; l < lanes && c * lanes + l < matrix->noRows; l++) {
+        y[matrix->rowOf[c * lanes + l]] = sums[l];
+    }
+}
+
+/// @brief helper: values k..k+3 of matrix as floats (bf16: the bits are shifted into the upper half of a float, fp16
+/// has no conversion instruction before F16C)
+__attribute__((always_inline)) static inline __m128 helper_load4(const struct SELL* matrix, uint64_t k) {
+    switch (matrix->valueType) {
+        case VALUE_BF16:
+            return _mm_castsi128_ps(
+                _mm_slli_epi32(_mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*)&matrix->halfValues[k])), 16));
+        case VALUE_FP16: {
+            const uint16_t* h = &matrix->halfValues[k];
+            return _mm_set_ps(half_to_float(VALUE_FP16, h[3]), half_to_float(VALUE_FP16, h[2]),
+                              half_to_float(VALUE_FP16, h[1]), half_to_float(VALUE_FP16, h[0]));
+        }
+        default:
+            return _mm_loadu_ps(&matrix->values[k]);
+    }
+}
+
+/// @brief helper: values k..k+7 of matrix as floats (fp16 with F16C)
+__attribute__((target("avx2,f16c"), always_inline)) static inline __m256 helper_load8(const struct SELL* matrix,
+                                                                                      uint64_t k) {
+    switch (matrix->valueType) {
+        case VALUE_BF16:
+            return _mm256_castsi256_ps(
+                _mm256_slli_epi32(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)&matrix->halfValues[k])), 16));
+        case VALUE_FP16:
+            return _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)&matrix->halfValues[k]));
+        default:
+            return _mm256_loadu_ps(&matrix->values[k]);
+    }
+}
+
+/// @brief helper: values k..k+15 of matrix as floats
+__attribute__((target("avx512f"), always_inline)) static inline __m512 helper_load16(const struct SELL* matrix,
+                                                                                     uint64_t k) {
+    switch (matrix->valueType) {
+        case VALUE_BF16:
+            return _mm512_castsi512_ps(_mm512_slli_epi32(
+                _mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i*)&matrix->halfValues[k])), 16));
+        case VALUE_FP16:
+            return _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i*)&matrix->halfValues[k]));
+        default:
+            return _mm512_loadu_ps(&matrix->values[k]);
+    }
+}
+
+/// @brief 4 lanes, x is read with scalar loads (SSE has no gather); padding (value 0) is skipped
+static void helper_spmv_sse41(const struct SELL* matrix, const float* x, float* y, uint64_t firstChunk,
+                              uint64_t lastChunk) {
+    for (uint64_t c = firstChunk; c < lastChunk; c++) {
+        __m128 acc = _mm_setzero_ps();
+        for (uint64_t k = matrix->chunkStart[c]; k < matrix->chunkStart[c + 1]; k += 4) {
+            const elpk_index_t* idx = &matrix->indices[k];
+            float v[4];
+            _mm_storeu_ps(v, helper_load4(matrix, k));
+            __m128 xv = _mm_set_ps(v[3] != 0.f ? x[idx[3]] : 0.f, v[2] != 0.f ? x[idx[2]] : 0.f,
+                                   v[1] != 0.f ? x[idx[1]] : 0.f, v[0] != 0.f ? x[idx[0]] : 0.f);
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(v), xv));
+        }
+        float sums[4];
+        _mm_storeu_ps(sums, acc);
+        helper_store_chunk(matrix, sums, 4, c, y);
+    }
+}
+
+/// @brief 8 lanes with gathers and fused multiply-add, padding is masked out of the gather
+__attribute__((target("avx2,fma,f16c"))) static void helper_spmv_avx2(const struct SELL* matrix, const float* x,
+                                                                      float* y, uint64_t firstChunk,
+                                                                      uint64_t lastChunk) {
+    const __m256 zero = _mm256_setzero_ps();
+    for (uint64_t c = firstChunk; c < lastChunk; c++) {
+        __m256 acc = zero;
+        for (uint64_t k = matrix->chunkStart[c]; k < matrix->chunkStart[c + 1]; k += 8) {
+            __m256 v = helper_load8(matrix, k);
+            __m256 mask = _mm256_cmp_ps(v, zero, _CMP_NEQ_UQ);
+            __m256 xv = _mm256_mask_i32gather_ps(zero, x, simd_load_indices8(&matrix->indices[k]), mask, 4);
+            acc = _mm256_fmadd_ps(v, xv, acc);
+        }
+        float sums[8];
+        _mm256_storeu_ps(sums, acc);
+        helper_store_chunk(matrix, sums, 8, c, y);
+    }
+}
+
+/// @brief 16 lanes with masked gathers and fused multiply-add
+__attribute__((target("avx512f"))) static void helper_spmv_avx512(const struct SELL* matrix, const float* x, float* y,
+                                                                  uint64_t firstChunk, uint64_t lastChunk) {
+    const __m512 zero = _mm512_setzero_ps();
+    for (uint64_t c = firstChunk; c < lastChunk; c++) {
+        __m512 acc = zero;
+        for (uint64_t k = matrix->chunkStart[c]; k < matrix->chunkStart[c + 1]; k += 16) {
+            __m512 v = helper_load16(matrix, k);
+            __mmask16 mask = _mm512_cmp_ps_mask(v, zero, _CMP_NEQ_UQ);
+            __m512 xv = _mm512_mask_i32gather_ps(zero, mask, simd_load_indices16(&matrix->indices[k]), x, 4);
+            acc = _mm512_fmadd_ps(v, xv, acc);
+        }
+        float sums[16];
+        _mm512_storeu_ps(sums, acc);
+        helper_store_chunk(matrix, sums, 16, c, y);
+    }
+}
+
+/// @brief returns the kernel for simdLevel (the scalar SSE4.1 kernel if the column indices do not fit into the 32 bit
+/// offsets of the gather instructions)
+/// @param noCols number of columns of the matrix
+struct SPMV_KERNEL spmv_kernel(uint64_t noCols) {
+    if (noCols > INT32_MAX) {
+        return (struct SPMV_KERNEL){.lanes = 4, .func = helper_spmv_sse41};
+    }
+    switch (simdLevel) {
+        case SIMD_AVX512:
+            return (struct SPMV_KERNEL){.lanes = 16, .func = helper_spmv_avx512};
+        case SIMD_AVX2:
+            return (struct SPMV_KERNEL){.lanes = 8, .func = helper_spmv_avx2};
+        default:
+            return (struct SPMV_KERNEL){.lanes = 4, .func = helper_spmv_sse41};
+    }
+}
+
+/// @brief converts matrix to the SELL-C-sigma layout of kernel (C = kernel.lanes, sigma = SELL_SIGMA): the rows of a
+/// chunk are adjacent in memory, so one SIMD load reads an entry of every lane
+/// @return matrix for spmv, free with sell_free
+struct SELL spmv_prepare(const struct ELLPACK matrix, const struct SPMV_KERNEL kernel) {
+    return sell_from_ellpack(matrix, kernel.lanes, SELL_SIGMA);
+}
+
+/// @brief arguments shared by all threads of a batch
+struct SPMV_ARGS {
+    const struct SELL* matrix;
+    const struct SPMV_KERNEL* kernel;
+    const struct DENSE_MATRIX* x;
+    struct DENSE_MATRIX* y;
+    const uint64_t* chunkBounds;  // chunks of thread t are [chunkBounds[t], chunkBounds[t + 1])
+};
+
+/// @brief multiplies the chunks of thread id with every vector, SPMV_TILE_CHUNKS chunks at a time
+static void helper_spmv_chunks(int id, int n, void* p) {
+    (void)n;
+    const struct SPMV_ARGS* args = (struct SPMV_ARGS*)p;
+    const struct DENSE_MATRIX x = *args->x;
+    const struct DENSE_MATRIX y = *args->y;
+    for (uint64_t first = args->chunkBounds[id]; first < args->chunkBounds[id + 1]; first += SPMV_TILE_CHUNKS) {
+        uint64_t last = first + SPMV_TILE_CHUNKS < args->chunkBounds[id + 1] ? first + SPMV_TILE_CHUNKS
+                                                                            : args->chunkBounds[id + 1];
+        for (uint64_t v = 0; v < x.noRows; v++) {
+            args->kernel->func(args->matrix, &x.values[v * x.noCols], &y.values[v * y.noCols], first, last);
+        }
+    }
+}
+
+/// @brief y = matrix * x for every vector of a batch on noThreads threads (split by stored entries of the chunks)
+/// @param matrix matrix converted with spmv_prepare
+/// @param kernel kernel matrix was prepared for
+/// @param x vectors, one per row (x.noCols = matrix.noCols)
+/// @param y output: one vector per row (y.noRows = x.noRows, y.noCols = matrix.noRows), allocated by the caller
+void spmv(const struct SELL* matrix, const struct SPMV_KERNEL kernel, const struct DENSE_MATRIX x,
+          struct DENSE_MATRIX y) {
+    int n = noThreads < 1 ? 1 : noThreads;
+    if ((uint64_t)n > matrix->noChunks) {
+        n = matrix->noChunks < 1 ? 1 : matrix->noChunks;
+    }
+    // chunkStart is the prefix sum of the stored entries of the chunks
+    uint64_t chunkBounds[n + 1];
+    partition_rows(matrix->chunkStart, matrix->noChunks, n, chunkBounds);
+
+    struct SPMV_ARGS args = {.matrix = matrix, .kernel = &kernel, .x = &x, .y = &y, .chunkBounds = chunkBounds};
+    parallel_run(n, helper_spmv_chunks, &args);
+}
+
+/// @brief multiply-adds one spmv of a single vector computes (non-zero entries of the matrix)
+uint64_t spmv_multiplications(const struct SELL* matrix) {
+    uint64_t count = 0;
+    for (uint64_t k = 0; k < matrix->chunkStart[matrix->noChunks]; k++) {
+        count += matrix->valueType == VALUE_FP32 ? matrix->values[k] != 0.f : (matrix->halfValues[k] & 0x7fffu) != 0;
+    }
+    return count;
+}
+
+/// @brief bytes one spmv of a single vector has to move at least: stored entries (values and indices, padding
+/// included), x and y once
+uint64_t spmv_bytes(const struct SELL* matrix) {
+    return matrix->chunkStart[matrix->noChunks] * (value_bytes(matrix->valueType) + sizeof(elpk_index_t)) +
+           (matrix->noCols + matrix->noRows) * sizeof(float);
+}
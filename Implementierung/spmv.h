@@ -0,0 +1,42 @@
+#ifndef GUARD_SPMV
+#define GUARD_SPMV
+
+#include <stdint.h>
+
+#include "ellpack.h"
+#include "sell.h"
+
+/// @brief SpMV kernel for one instruction set level: y[rowOf[s]] = sum over j of the entries of slot s * x for the
+/// chunks [firstChunk, lastChunk) of a SELL-C-sigma matrix with C = lanes; every lane handles one row of the chunk and
+/// gathers the entries of x it needs
+struct SPMV_KERNEL {
+    uint64_t lanes;
+    void (*func)(const struct SELL* matrix, const float* x, float* y, uint64_t firstChunk, uint64_t lastChunk);
+};
+
+/// @brief returns the kernel for simdLevel (the scalar SSE4.1 kernel if the column indices do not fit into the 32 bit
+/// offsets of the gather instructions)
+/// @param noCols number of columns of the matrix
+struct SPMV_KERNEL spmv_kernel(uint64_t noCols);
+
+/// @brief converts matrix to the SELL-C-sigma layout of kernel (C = kernel.lanes, sigma = SELL_SIGMA): the rows of a
+/// chunk are adjacent in memory, so one SIMD load reads an entry of every lane
+/// @return matrix for spmv, free with sell_free
+struct SELL spmv_prepare(const struct ELLPACK matrix, const struct SPMV_KERNEL kernel);
+
+/// @brief y = matrix * x for every vector of a batch on noThreads threads (split by stored entries of the chunks)
+/// @param matrix matrix converted with spmv_prepare
+/// @param kernel kernel matrix was prepared for
+/// @param x vectors, one per row (x.noCols = matrix.noCols)
+/// @param y output: one vector per row (y.noRows = x.noRows, y.noCols = matrix.noRows), allocated by the caller
+void spmv(const struct SELL* matrix, const struct SPMV_KERNEL kernel, const struct DENSE_MATRIX x,
+          struct DENSE_MATRIX y);
+
+/// @brief multiply-adds one spmv of a single vector computes (non-zero entries of the matrix)
+uint64_t spmv_multiplications(const struct SELL* matrix);
+
+/// @brief bytes one spmv of a single vector has to move at least: stored entries (values and indices, padding
+/// included), x and y once
+uint64_t spmv_bytes(const struct SELL* matrix);
+
+#endif
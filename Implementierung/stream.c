@@ -0,0 +1,206 @@
+#include "stream.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "accumulator.h"
+#include "autoselect.h"
+#include "ellpack.h"
+#include "file_io.h"
+#include "gemm.h"
+#include "half.h"
+#include "intersect.h"
+#include "mult.h"
+#include "parallel.h"
+#include "perfcount.h"
+#include "util.h"
+#include "workspace.h"
+
+/// @brief memory a multiplication of a block of rows of left with right takes: independent of the size of the block,
+/// per thread (every thread gets at least one row of the block) and per row of the block
+struct STREAM_MEMORY {
+    uint64_t fixed;
+    uint64_t perThread;
+    uint64_t perRow;
+};
+
+/// @brief helper: largest number of entries in a column of matrix (the row length of its transpose)
+static uint64_t helper_max_col_entries(const struct ELLPACK matrix) {
+    uint64_t* count = (uint64_t*)scratch_calloc((matrix.noCols + 1) * sizeof(uint64_t));
+    uint64_t max = 0;
+    for (uint64_t j = 0; j < matrix.noRows * matrix.maxNoNonZero; j++) {
+        if (!elpk_is_zero(&matrix, j) && ++count[matrix.indices[j]] > max) {
+            max = count[matrix.indices[j]];
+        }
+    }
+    scratch_free(count);
+    return max;
+}
+
+/// @brief helper: scratch memory of mult for a block whose rows have leftRowLength entries, the block and its product
+/// are not included
+static struct STREAM_MEMORY helper_scratch_memory(void (*mult)(const void*, const void*, void*),
+                                                  uint64_t leftRowLength, const struct ELLPACK right) {
+    const uint64_t entryBytes = sizeof(float) + sizeof(elpk_index_t);
+    uint64_t resultRowLength = leftRowLength * right.maxNoNonZero;
+    resultRowLength = resultRowLength < right.noCols ? resultRowLength : right.noCols;
+    // accumulators (dense or hashed, see acc_bytes) have at most resultRowLength entries in every version using them
+    const uint64_t accumulator = acc_bytes(right.noCols, resultRowLength);
+
+    if (mult == matr_mult_ellpack_auto) {
+        // auto only chooses V4 for nearly dense products, whose rows cost about as much as its packed copies
+        struct STREAM_MEMORY gustavson = helper_scratch_memory(matr_mult_ellpack, leftRowLength, right);
+        struct STREAM_MEMORY sell = helper_scratch_memory(matr_mult_ellpack_V6, leftRowLength, right);
+        return (struct STREAM_MEMORY){
+            .fixed = gustavson.fixed > sell.fixed ? gustavson.fixed : sell.fixed,
+            .perThread = gustavson.perThread > sell.perThread ? gustavson.perThread : sell.perThread,
+            .perRow = gustavson.perRow > sell.perRow ? gustavson.perRow : sell.perRow};
+    }
+    if (mult == matr_mult_ellpack_V4) {
+        // packed copies of both operands and a tile of the result per thread, no symbolic phase
+        return (struct STREAM_MEMORY){.fixed = right.noRows * right.noCols * sizeof(float),
+                                      .perThread = GEMM_MC * GEMM_NC * sizeof(float),
+                                      .perRow = right.noRows * sizeof(float)};
+    }
+    if (mult == matr_mult_ellpack_V6) {
+        // SELL copies of both operands (entries and four words of bookkeeping per row), accumulators, row lengths
+        const uint64_t sellRow = 4 * sizeof(uint64_t);
+        return (struct STREAM_MEMORY){.fixed = right.noRows * (right.maxNoNonZero * entryBytes + sellRow),
+                                      .perThread = accumulator,
+                                      .perRow = leftRowLength * entryBytes + sellRow + sizeof(uint64_t)};
+    }
+
+    // all other versions start with the symbolic phase of initialize_result: accumulators, the lengths of the rows of
+    // right and the flops and lengths of the rows of the block
+    struct STREAM_MEMORY memory = {
+        .fixed = right.noRows * sizeof(uint64_t), .perThread = accumulator, .perRow = 2 * sizeof(uint64_t)};
+    if (mult == matr_mult_ellpack_V2) {
+        // transposed copy of right and the summaries of its rows and of the rows of the block
+        memory.fixed += right.noCols * (helper_max_col_entries(right) * entryBytes + sizeof(struct ROW_SUMMARY));
+        memory.perRow += sizeof(struct ROW_SUMMARY);
+    } else if (mult == matr_mult_ellpack_V3) {
+        // dense copies of both operands
+        memory.fixed += right.noRows * right.noCols * sizeof(float);
+        memory.perRow += right.noRows * sizeof(float);
+    } else if (mult == matr_mult_ellpack_V5) {
+        // a heap of merge cursors (four words each) per thread
+        memory.perThread += leftRowLength * 4 * sizeof(uint64_t);
+    } else if (mult == matr_mult_ellpack_V7) {
+        // expanded keys and products of every thread (twice for the radix sort), the flops of every row
+        uint64_t tuples = leftRowLength * right.maxNoNonZero;
+        tuples = tuples > ESC_BLOCK_TUPLES ? tuples : ESC_BLOCK_TUPLES;
+        memory.perThread += 2 * tuples * (sizeof(uint64_t) + sizeof(float));
+        memory.perRow += sizeof(uint64_t);
+    }
+    // the main version and V1 need nothing beyond the symbolic phase (the numeric phase reuses its accumulators)
+    return memory;
+}
+
+/// @brief number of rows of left that are multiplied at once within budget bytes: a block of left (and its float copy
+/// if mult needs one), its product (and its copy in resultType) and the scratch memory of mult have to fit, the
+/// accumulators are counted dense or hashed as acc_init creates them; exits with an error if not even one row fits
+/// @param mult multiplication used for every block
+/// @param leftRowLength maximum number of non-zero entries per row of the rows of left (see elpk_stream_row_length)
+/// @param leftType value type of left
+/// @param right right operand
+/// @param resultType value type the products are written with
+/// @param budget bytes available for the blocks
+/// @return at least 1
+uint64_t stream_block_rows(void (*mult)(const void*, const void*, void*), uint64_t leftRowLength,
+                           enum VALUE_TYPE leftType, const struct ELLPACK right, enum VALUE_TYPE resultType,
+                           uint64_t budget) {
+    const uint64_t entryBytes = sizeof(float) + sizeof(elpk_index_t);
+    uint64_t resultRowLength = leftRowLength * right.maxNoNonZero;
+    resultRowLength = resultRowLength < right.noCols ? resultRowLength : right.noCols;
+
+    struct STREAM_MEMORY memory = helper_scratch_memory(mult, leftRowLength, right);
+    // the rows as read and widened, the product rows (compacted in place) and narrowed
+    memory.perRow += leftRowLength * (value_bytes(leftType) + sizeof(elpk_index_t)) + resultRowLength * entryBytes;
+    if (leftType != VALUE_FP32 && mult != matr_mult_ellpack) {
+        memory.perRow += leftRowLength * entryBytes;
+    }
+    if (resultType != VALUE_FP32) {
+        memory.perRow += resultRowLength * (value_bytes(resultType) + sizeof(elpk_index_t));
+    }
+
+    const uint64_t threads = noThreads < 1 ? 1 : noThreads;
+    const uint64_t allThreads = memory.fixed + threads * memory.perThread;
+    if (budget >= allThreads + threads * memory.perRow) {
+        return memory.perRow > 0 ? (budget - allThreads) / memory.perRow : UINT64_MAX;
+    }
+    // fewer rows than threads: every row has a thread (and its scratch memory) of its own
+    if (budget < memory.fixed + memory.perThread + memory.perRow) {
+        fprintf(stderr, "ERROR: -M %lu is too small, the multiplication of one row of a needs %lu MiB\n", budget >> 20,
+                (memory.fixed + memory.perThread + memory.perRow + (1ul << 20) - 1) >> 20);
+        exit(EXIT_FAILURE);
+    }
+    return (budget - memory.fixed) / (memory.perThread + memory.perRow);
+}
+
+/// @brief out-of-core multiplication: left is read from file one block of rows at a time, every block is multiplied
+/// with the resident right operand and its product is written (row-blocked binary format) before the next block is
+/// read; with boundWorkspace the workspace is reset after every block; bf16/fp16 blocks are widened to float unless
+/// mult is the main version, which reads them directly
+/// @param mult multiplication used for every block (signature of the matr_mult_ellpack versions)
+/// @param left binary matrix (plain binary: seekable file, row-blocked: also pipes, which keep one stored block in
+/// memory while it is split), positioned at the header
+/// @param right right operand, stays in memory (mmap-ed if it was read from a binary file)
+/// @param resultType value type the products are written with
+/// @param budget bytes available for a block of left, its product and the scratch memory of the kernel
+/// @param out result file
+void stream_multiply(void (*mult)(const void*, const void*, void*), FILE* left, const struct ELLPACK right,
+                     enum VALUE_TYPE resultType, uint64_t budget, FILE* out) {
+    struct ELPK_STREAM stream = elpk_stream_open(left);
+    if (stream.header.noCols != right.noRows) {
+        fprintf(stderr, "ERROR: a has %lu columns, but b has %lu rows\n", stream.header.noCols, right.noRows);
+        exit(EXIT_FAILURE);
+    }
+    // the first block is sized before anything is written, so a too small budget leaves no partial result behind
+    uint64_t blockRows = stream_block_rows(mult, elpk_stream_row_length(&stream), stream.header.valueType, right,
+                                           resultType, budget);
+    elpk_write_blocked_header(stream.header.noRows, right.noCols, resultType, out);
+    struct ELLPACK block;
+    uint64_t firstRow;
+    while (true) {
+        perf_begin(PHASE_READ_A);
+        bool more = elpk_stream_next(&stream, blockRows, &block, &firstRow);
+        if (more) {
+            // the row length (and so the number of rows that fit) can change with every stored block
+            blockRows = stream_block_rows(mult, elpk_stream_row_length(&stream), stream.header.valueType, right,
+                                          resultType, budget);
+        }
+        perf_end(PHASE_READ_A);
+        if (!more) {
+            break;
+        }
+        if (block.valueType != VALUE_FP32 && mult != matr_mult_ellpack) {
+            struct ELLPACK widened = elpk_with_value_type(block, VALUE_FP32);
+            elpk_free(block);
+            block = widened;
+        }
+
+        struct ELLPACK product;
+        perf_begin(PHASE_MULTIPLY);
+        mult(&block, &right, &product);
+        perf_end(PHASE_MULTIPLY);
+        pdebug("block at row %lu: %lu rows, maxNoNonZero %lu -> %lu\n", firstRow, block.noRows, block.maxNoNonZero,
+               product.maxNoNonZero);
+
+        perf_begin(PHASE_WRITE);
+        if (resultType != VALUE_FP32) {
+            struct ELLPACK narrowed = elpk_with_value_type(product, resultType);
+            elpk_free(product);
+            product = narrowed;
+        }
+        elpk_write_block(product, firstRow, out);
+        perf_end(PHASE_WRITE);
+        elpk_free(product);
+        elpk_free(block);
+        if (boundWorkspace != NULL) {
+            workspace_reset(boundWorkspace);
+        }
+    }
+    fflush(out);
+}
@@ -0,0 +1,38 @@
+#ifndef GUARD_STREAM
+#define GUARD_STREAM
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "ellpack.h"
+#include "file_io.h"
+
+/// @brief number of rows of left that are multiplied at once within budget bytes: a block of left (and its float copy
+/// if mult needs one), its product (and its copy in resultType) and the scratch memory of mult have to fit, the
+/// accumulators are counted dense or hashed as acc_init creates them; exits with an error if not even one row fits
+/// @param mult multiplication used for every block
+/// @param leftRowLength maximum number of non-zero entries per row of the rows of left (see elpk_stream_row_length)
+/// @param leftType value type of left
+/// @param right right operand
+/// @param resultType value type the products are written with
+/// @param budget bytes available for the blocks
+/// @return at least 1
+uint64_t stream_block_rows(void (*mult)(const void*, const void*, void*), uint64_t leftRowLength,
+                           enum VALUE_TYPE leftType, const struct ELLPACK right, enum VALUE_TYPE resultType,
+                           uint64_t budget);
+
+/// @brief out-of-core multiplication: left is read from file one block of rows at a time, every block is multiplied
+/// with the resident right operand and its product is written (row-blocked binary format) before the next block is
+/// read; with boundWorkspace the workspace is reset after every block; bf16/fp16 blocks are widened to float unless
+/// mult is the main version, which reads them directly
+/// @param mult multiplication used for every block (signature of the matr_mult_ellpack versions)
+/// @param left binary matrix (plain binary: seekable file, row-blocked: also pipes, which keep one stored block in
+/// memory while it is split), positioned at the header
+/// @param right right operand, stays in memory (mmap-ed if it was read from a binary file)
+/// @param resultType value type the products are written with
+/// @param budget bytes available for a block of left, its product and the scratch memory of the kernel
+/// @param out result file
+void stream_multiply(void (*mult)(const void*, const void*, void*), FILE* left, const struct ELLPACK right,
+                     enum VALUE_TYPE resultType, uint64_t budget, FILE* out);
+
+#endif
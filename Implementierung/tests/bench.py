@@ -2,8 +2,10 @@
 
 """Usage:
     bench.py test <executable> [<impl-ver>...] [options] [-p N -e FLOAT] -t PATH...
+    bench.py features <executable> [<impl-ver>...] [options] [-p N -e FLOAT] -t PATH...
     bench.py bench <executable> [<impl-ver>...] [options] [-i N] -t PATH...
     bench.py show <csv-file>... [-s]
+    bench.py calibrate <executable> [options] [-i N] [-c PATH] -t PATH...
 
 Options:
     -t PATH     dir with tests (eg: tests/generated)
@@ -17,16 +19,29 @@ Bench:
     -i N        iterations [default: 3]
 Show:
     -s          show plot
+Calibrate:
+    -c PATH     thresholds file for `<executable> -V auto -C PATH` [default: auto-thresholds.conf]
 
 Notes:
     if no <impl-ver> is specified, all impl_versions will be used,
     `<executable> -x` is executed to find out the max impl version
 
-    when benchmarking, (timeout + 1) * iterations will be used as bench_timeout for
-    `<executable> ... -B`, if bench_timeout hit -> value of timeout set in data
+    when benchmarking, timeout * (iterations + 1) will be used as bench_timeout for
+    `<executable> ... -B -J` (one untimed warmup run), if bench_timeout hit -> value of timeout
+    set in data; the median of the timed multiplications is recorded
+
+    features runs the tests in tests/features: every test dir holds the command line in
+    `args` (paths relative to the test dir, `-V<impl-ver>` is appended), the file used as
+    stdin in `in` (optional), the inputs it names and the expected result `res` (ELLPACK
+    text, or dense vectors for -v; the result itself may be binary)
+
+    calibrate benchmarks the versions `-V auto` chooses from (0, 4 and 6) on all tests
+    and fits the thresholds of the cost model (`<executable> -m`) to the measured times
 """
 
 
+import json
+import math
 import sys
 import subprocess
 import re
@@ -63,6 +78,9 @@ class Opt:
     csv_files: str = field(init=False)
     show_plot: bool = field(init=False)
 
+    # calibrate
+    thresholds_file: Path = field(init=False)
+
 
 opt = Opt()
 
@@ -127,9 +145,9 @@ def get_max_impl_ver():
 
 def exec_bench(a: Path, b: Path, impl_version: int) -> float:
     """execute benchmark and get time"""
-    eprint(f"run: {opt.executable} -a {a} -b {b} -V{impl_version} -B{opt.iterations}")
+    eprint(f"run: {opt.executable} -a {a} -b {b} -V{impl_version} -B{opt.iterations} -J")
 
-    # {executable} -a {a} -b {b} -B{iterations} | awk '{{print $6}}'
+    # {executable} -a {a} -b {b} -B{iterations} -J, median of the timed multiplications
     try:
         result = subprocess.run(
             [
@@ -140,6 +158,7 @@ def exec_bench(a: Path, b: Path, impl_version: int) -> float:
                 b,
                 f"-V{impl_version}",
                 f"-B{opt.iterations}",
+                "-J",
             ],
             capture_output=True,
             text=True,
@@ -161,7 +180,7 @@ def exec_bench(a: Path, b: Path, impl_version: int) -> float:
 
     eprint("...finished")
 
-    return float(result.stdout.split(" ")[5])
+    return json.loads(result.stdout)["multiply"]["median"]
 
 
 def exec_test(a: Path, b: Path, res: Path, impl_version: int):
@@ -216,6 +235,109 @@ def exec_test(a: Path, b: Path, res: Path, impl_version: int):
     eprint(" -> PASSED")
 
 
+def read_dense(content: bytes) -> list[list[float]]:
+    """parse the dense format of -v (`noVectors,noCols`, then one vector per line)"""
+    lines = content.decode("ascii").splitlines()[1:]
+    return [[float(x) for x in line.split(",")] for line in lines]
+
+
+def exec_feature(test: Path, impl_version: int):
+    """execute a feature test (see Notes) in its dir"""
+    args = test.joinpath("args").read_text(encoding="ascii").split()
+    stdin = test.joinpath("in")
+    executable = str(Path(opt.executable).resolve())
+    redirect = " <in" if stdin.exists() else ""
+    eprint(f"run: cd {test} && {opt.executable} {' '.join(args)} -V{impl_version}{redirect}")
+
+    try:
+        # the file itself is stdin (not a pipe): a second matrix starts in the middle of it
+        with open(stdin if stdin.exists() else "/dev/null", "rb") as f:
+            result = subprocess.run(
+                [executable, *args, f"-V{impl_version}"],
+                stdin=f,
+                capture_output=True,
+                check=True,
+                timeout=opt.timeout,
+                cwd=test,
+            )
+    except subprocess.TimeoutExpired as e:
+        eprint(
+            f"\n---------------------\nFAILED: TIMEOUT after {opt.timeout} seconds\n"
+        )
+        eprint_std_out_err(e)
+        return
+
+    except subprocess.CalledProcessError as e:
+        eprint("\n---------------------\nFAILED")
+        eprint_std_out_err(e)
+        sys.exit(1)
+
+    res = test.joinpath("res")
+    if len(res.read_text(encoding="ascii").split("\n", 1)[0].split(",")) == 2:
+        # dense vectors (-v), compared here
+        expected, got = read_dense(res.read_bytes()), read_dense(result.stdout)
+        equal = len(expected) == len(got) and all(
+            len(e) == len(g) and all(abs(x - y) <= opt.max_error for x, y in zip(e, g))
+            for e, g in zip(expected, got)
+        )
+        if not equal:
+            eprint("\n---------------------\nFAILED")
+            eprint("\nexpected:")
+            eprint_file_if_small(res)
+            eprint("\nbut got:")
+            eprint_if_short(result.stdout.decode("ascii"))
+            sys.exit(1)
+        eprint(" -> PASSED")
+        return
+
+    eprint(f'check result: {opt.executable} -a {res} -e{opt.max_error} <<<"$RESULT"')
+
+    try:
+        subprocess.run(
+            [opt.executable, "-a", res, f"-e{opt.max_error}"],
+            input=result.stdout,
+            capture_output=True,
+            check=True,
+            timeout=1,
+        )
+    except subprocess.CalledProcessError as e:
+        eprint("\n---------------------\nFAILED")
+        eprint("\nargs:")
+        eprint_file_if_small(test.joinpath("args"))
+        eprint("\nexpected:")
+        eprint_file_if_small(res)
+        eprint("\n")
+        eprint_std_out_err(e)
+        sys.exit(1)
+
+    eprint(" -> PASSED")
+
+
+def exec_estimate(a: Path, b: Path) -> dict[str, float]:
+    """get the cost model estimate (`name=value` lines) of the executable"""
+    eprint(f"run: {opt.executable} -a {a} -b {b} -m")
+
+    try:
+        result = subprocess.run(
+            [opt.executable, "-a", a, "-b", b, "-m"],
+            capture_output=True,
+            text=True,
+            check=True,
+            timeout=opt.timeout,
+        )
+    except (subprocess.CalledProcessError, subprocess.TimeoutExpired) as e:
+        eprint("failed to get estimate")
+        eprint_std_out_err(e)
+        sys.exit(1)
+
+    eprint("...finished")
+
+    return {
+        name: float(value)
+        for name, value in (line.split("=") for line in result.stdout.splitlines())
+    }
+
+
 def natural_keys(obj):
     return [int(c) if c.isdigit() else c for c in re.split(r"(\d+)", str(obj))]
 
@@ -259,6 +381,19 @@ def test():
     eprint("SUCCESS")
 
 
+def features():
+    tests = []
+    for test_dir in opt.test_dirs:
+        tests.extend(p for p in test_dir.iterdir() if p.is_dir())
+    tests = sorted(tests, key=natural_keys)
+
+    for v in opt.impl_versions:
+        for p in tests:
+            exec_feature(p, v)
+
+    eprint("SUCCESS")
+
+
 def show():
     files = sorted(opt.csv_files, key=natural_keys)
 
@@ -281,6 +416,63 @@ def show():
             plt.show()
 
 
+def calibrate():
+    tests = []
+    for test_dir in opt.test_dirs:
+        tests.extend(p for p in test_dir.iterdir() if p.is_dir())
+    tests = sorted(tests, key=natural_keys)
+
+    data = []
+    for p in tests:
+        a, b = p.joinpath("a"), p.joinpath("b")
+        est = exec_estimate(a, b)
+        times = {v: exec_bench(a, b, v) for v in (0, 6)}
+        # the dense version can only win (and only fits into memory) on almost dense products
+        dense_plausible = est["denseFlops"] <= 1000 * est["flops"]
+        times[4] = exec_bench(a, b, 4) if dense_plausible else float("inf")
+        data.append((p.name, est, times))
+
+    def ns_per_flop(version: int, work):
+        # total time over total work, dominated by the large tests; timeouts are left out, None if
+        # nothing was measured (the built-in default is kept then)
+        measured = [(t[version], work(e)) for _, e, t in data if t[version] < opt.timeout]
+        if sum(w for _, w in measured) <= 0:
+            return None
+        return 1e9 * sum(t for t, _ in measured) / sum(w for _, w in measured)
+
+    sparse = ns_per_flop(0, lambda e: e["flops"] + e["storedEntries"])
+    dense = ns_per_flop(4, lambda e: e["denseFlops"])
+
+    # skew above which V6 is used instead of the main version (on the tests not going to V4): the
+    # threshold with the smallest sum of log slowdowns against the faster of both, so every test counts
+    def goes_sparse(e) -> bool:
+        # without both measurements V4 cannot be compared, every test counts then
+        if sparse is None or dense is None:
+            return True
+        return e["denseFlops"] * dense >= (e["flops"] + e["storedEntries"]) * sparse
+
+    sparse_tests = [(e["skew"], t) for _, e, t in data if goes_sparse(e)]
+    candidates = sorted({s for s, _ in sparse_tests} | {float("inf")})
+    sell_skew = min(
+        candidates,
+        key=lambda c: sum(
+            math.log((t[6] if s > c else t[0]) / min(t[0], t[6])) for s, t in sparse_tests
+        ),
+    )
+
+    for name, est, times in data:
+        eprint(f"{name}: skew {est['skew']:g}, flops {est['flops']:g}, times {times}")
+
+    with open(opt.thresholds_file, "w", encoding="ascii") as f:
+        f.write(f"# written by bench.py calibrate from {', '.join(map(str, opt.test_dirs))}\n")
+        if sparse is not None:
+            f.write(f"sparseNsPerFlop={sparse:g}\n")
+        if dense is not None:
+            f.write(f"denseNsPerFlop={dense:g}\n")
+        f.write(f"sellSkew={sell_skew:g}\n")
+    print("thresholds in:", opt.thresholds_file)
+
+
 def main():
     args = docopt(__doc__)
     # print(args)
@@ -294,7 +486,7 @@ def main():
     opt.iterations = int(args["-i"])
     opt.benchmark_dir = Path(args["-b"])
     opt.benchmark_dir.parent.mkdir(exist_ok=True, parents=True)
-    opt.bench_timeout = (opt.timeout + 1) * opt.iterations
+    opt.bench_timeout = opt.timeout * (opt.iterations + 1)
 
     opt.print_thresh = int(args["-p"])
     opt.max_error = float(args["-e"])
@@ -302,15 +494,21 @@ def main():
     opt.csv_files = args["<csv-file>"]
     opt.show_plot = args["-s"]
 
+    opt.thresholds_file = Path(args["-c"])
+
     if len(opt.impl_versions) == 0 and opt.executable:
         opt.impl_versions = list(map(str, range(1 + get_max_impl_ver())))
 
     if args["test"]:
         test()
+    elif args["features"]:
+        features()
     elif args["bench"]:
         bench()
     elif args["show"]:
         show()
+    elif args["calibrate"]:
+        calibrate()
 
 
 if __name__ == "__main__":
@@ -0,0 +1,143 @@
+#include "workspace.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "ellpack.h"
+#include "util.h"
+
+/// @brief header written into the first bytes of a retired block
+struct ARENA_BLOCK {
+    char* next;
+    uint64_t size;
+};
+
+struct WORKSPACE* boundWorkspace = NULL;
+
+/// @brief helper: maps a block of at least size bytes (huge pages are advised for large blocks)
+/// @return start of the block, its size is written to size
+static char* helper_map_block(uint64_t* size) {
+    uint64_t granularity = *size >= WS_HUGE_PAGE_SIZE ? WS_HUGE_PAGE_SIZE : 4096;
+    *size = (*size + granularity - 1) / granularity * granularity;
+    void* block = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (block == MAP_FAILED) {
+        abortIfNULL_msg(0, "could not map workspace block");
+    }
+    if (granularity == WS_HUGE_PAGE_SIZE) {
+        madvise(block, *size, MADV_HUGEPAGE);  // only a hint, fails without transparent huge page support
+    }
+    return (char*)block;
+}
+
+/// @brief helper: allocates bytes from arena, replaces the current block by a larger one if it is full; the first
+/// WS_ALIGNMENT bytes of every block are reserved for its ARENA_BLOCK header
+static void* helper_arena_alloc(struct ARENA* arena, uint64_t bytes) {
+    bytes = (bytes + WS_ALIGNMENT - 1) / WS_ALIGNMENT * WS_ALIGNMENT;
+    pthread_mutex_lock(&arena->lock);
+    if (arena->base == NULL || arena->size - arena->used < bytes) {
+        uint64_t size = 2 * arena->size > WS_MIN_BLOCK_SIZE ? 2 * arena->size : WS_MIN_BLOCK_SIZE;
+        size = size > bytes + WS_ALIGNMENT ? size : bytes + WS_ALIGNMENT;
+        if (arena->base != NULL) {
+            // the current block is retired, the allocations in it stay valid until the next reset
+            *(struct ARENA_BLOCK*)arena->base = (struct ARENA_BLOCK){.next = arena->oldBlocks, .size = arena->size};
+            arena->oldBlocks = arena->base;
+            arena->retired += arena->used;
+        }
+        arena->base = helper_map_block(&size);
+        arena->size = size;
+        arena->used = WS_ALIGNMENT;
+        arena->noBlocks++;
+    }
+    void* p = arena->base + arena->used;
+    arena->used += bytes;
+    pthread_mutex_unlock(&arena->lock);
+    return p;
+}
+
+/// @brief helper: releases all allocations of arena, keeps one block for all of them
+static void helper_arena_reset(struct ARENA* arena) {
+    uint64_t needed = arena->retired + arena->used;
+    while (arena->oldBlocks != NULL) {
+        struct ARENA_BLOCK block = *(struct ARENA_BLOCK*)arena->oldBlocks;
+        munmap(arena->oldBlocks, block.size);
+        arena->oldBlocks = block.next;
+    }
+    if (arena->retired != 0) {
+        // the last round did not fit into one block: replace it by one that does
+        munmap(arena->base, arena->size);
+        arena->size = needed;
+        arena->base = helper_map_block(&arena->size);
+        arena->noBlocks++;
+    }
+    arena->retired = 0;
+    arena->used = WS_ALIGNMENT;
+}
+
+/// @brief creates an empty workspace (no memory is mapped until the first allocation)
+struct WORKSPACE* workspace_create(void) {
+    struct WORKSPACE* ws = (struct WORKSPACE*)abortIfNULL(calloc(1, sizeof(struct WORKSPACE)));
+    pthread_mutex_init(&ws->scratch.lock, NULL);
+    pthread_mutex_init(&ws->result.lock, NULL);
+    return ws;
+}
+
+/// @brief invalidates everything allocated from the workspace (including results) and keeps one block per arena that
+/// is large enough for everything allocated since the last reset
+void workspace_reset(struct WORKSPACE* ws) {
+    helper_arena_reset(&ws->scratch);
+    helper_arena_reset(&ws->result);
+}
+
+/// @brief unmaps all blocks and frees the workspace
+void workspace_free(struct WORKSPACE* ws) {
+    workspace_reset(ws);
+    if (ws->scratch.base != NULL) {
+        munmap(ws->scratch.base, ws->scratch.size);
+    }
+    if (ws->result.base != NULL) {
+        munmap(ws->result.base, ws->result.size);
+    }
+    pthread_mutex_destroy(&ws->scratch.lock);
+    pthread_mutex_destroy(&ws->result.lock);
+    free(ws);
+}
+
+/// @brief allocates WS_ALIGNMENT aligned scratch memory from boundWorkspace (or the heap), thread-safe; aborts if out
+/// of memory
+void* scratch_alloc(uint64_t bytes) {
+    if (boundWorkspace != NULL) {
+        return helper_arena_alloc(&boundWorkspace->scratch, bytes);
+    }
+    bytes = (bytes + WS_ALIGNMENT - 1) / WS_ALIGNMENT * WS_ALIGNMENT;
+    return abortIfNULL(aligned_alloc(WS_ALIGNMENT, bytes ? bytes : WS_ALIGNMENT));
+}
+
+/// @brief same as scratch_alloc, but zeroed
+void* scratch_calloc(uint64_t bytes) { return memset(scratch_alloc(bytes), 0, bytes); }
+
+/// @brief frees memory of scratch_alloc (no-op if it was taken from boundWorkspace)
+void scratch_free(void* p) {
+    if (boundWorkspace == NULL) {
+        free(p);
+    }
+}
+
+/// @brief allocates values and indices for matrix->noRows * matrix->maxNoNonZero entries from the result arena of
+/// boundWorkspace (or the heap) and sets matrix->storage accordingly; the values are floats (VALUE_FP32)
+void elpk_alloc(struct ELLPACK* matrix) {
+    uint64_t itemsCount = matrix->noRows * matrix->maxNoNonZero;
+    matrix->valueType = VALUE_FP32;
+    matrix->halfValues = NULL;
+    if (boundWorkspace != NULL) {
+        matrix->storage = ELPK_WORKSPACE;
+        matrix->values = (float*)helper_arena_alloc(&boundWorkspace->result, itemsCount * sizeof(float));
+        matrix->indices = (elpk_index_t*)helper_arena_alloc(&boundWorkspace->result, itemsCount * sizeof(elpk_index_t));
+        return;
+    }
+    matrix->storage = ELPK_HEAP;
+    matrix->values = (float*)abortIfNULL(malloc(itemsCount * sizeof(float)));
+    matrix->indices = (elpk_index_t*)abortIfNULL(malloc(itemsCount * sizeof(elpk_index_t)));
+}
@@ -0,0 +1,67 @@
+#ifndef GUARD_WORKSPACE
+#define GUARD_WORKSPACE
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "ellpack.h"
+
+// alignment of every allocation (one cache line, enough for AVX-512 loads)
+#define WS_ALIGNMENT 64
+
+// blocks of at least this size are rounded up to it and advised to use transparent huge pages
+#define WS_HUGE_PAGE_SIZE (2ul << 20)
+
+// size of the first block of an arena
+#define WS_MIN_BLOCK_SIZE (1ul << 20)
+
+/// @brief bump allocator: allocations are taken from the current block, if it is full a larger one replaces it (the
+/// old blocks stay valid until the next reset); a reset replaces all blocks by a single one as large as everything
+/// allocated since the last reset, so a repeated sequence of allocations needs no new block after the first round
+struct ARENA {
+    char* base;         // current block, NULL before the first allocation
+    uint64_t size;      // size of the current block
+    uint64_t used;      // bytes handed out from the current block
+    uint64_t retired;   // bytes handed out from older blocks since the last reset
+    char* oldBlocks;    // list of older blocks, linked through their first bytes (see ARENA_BLOCK in workspace.c)
+    uint64_t noBlocks;  // number of blocks mapped so far (statistics)
+    pthread_mutex_t lock;
+};
+
+/// @brief memory reused by consecutive multiplications: scratch for the kernels (accumulators, transposed, packed or
+/// SELL copies, row lengths, ...) and the result matrices; create once, bind it (see boundWorkspace) and reset it
+/// between multiplications
+struct WORKSPACE {
+    struct ARENA scratch;
+    struct ARENA result;
+};
+
+/// @brief workspace used by the kernels, NULL -> scratch and results are allocated on the heap; must not change during
+/// a multiplication
+extern struct WORKSPACE* boundWorkspace;
+
+/// @brief creates an empty workspace (no memory is mapped until the first allocation)
+struct WORKSPACE* workspace_create(void);
+
+/// @brief invalidates everything allocated from the workspace (including results) and keeps one block per arena that
+/// is large enough for everything allocated since the last reset
+void workspace_reset(struct WORKSPACE* ws);
+
+/// @brief unmaps all blocks and frees the workspace
+void workspace_free(struct WORKSPACE* ws);
+
+/// @brief allocates WS_ALIGNMENT aligned scratch memory from boundWorkspace (or the heap), thread-safe; aborts if out
+/// of memory
+void* scratch_alloc(uint64_t bytes);
+
+/// @brief same as scratch_alloc, but zeroed
+void* scratch_calloc(uint64_t bytes);
+
+/// @brief frees memory of scratch_alloc (no-op if it was taken from boundWorkspace)
+void scratch_free(void* p);
+
+/// @brief allocates values and indices for matrix->noRows * matrix->maxNoNonZero entries from the result arena of
+/// boundWorkspace (or the heap) and sets matrix->storage accordingly; the values are floats (VALUE_FP32)
+void elpk_alloc(struct ELLPACK* matrix);
+
+#endif